@@ -11,6 +11,9 @@ extern FVehicleDebugParams GVehicleDebugParams;
 
 DECLARE_CYCLE_STAT(TEXT("AsyncCallback:OnPreSimulate_Internal"), STAT_AsyncCallback_OnPreSimulate, STATGROUP_ChaosVehicleManager);
 
+FOnPreSimulateVehicles FChaosVehicleManagerAsyncCallback::OnPreSimulateVehicles;
+FOnPostSimulateVehicles FChaosVehicleManagerAsyncCallback::OnPostSimulateVehicles;
+
 /**
  * Callback from Physics thread
  */
@@ -72,9 +75,13 @@ void FChaosVehicleManagerAsyncCallback::OnPreSimulate_Internal()
 
 	};
 
+	OnPreSimulateVehicles.Broadcast();
+
 	bool ForceSingleThread = !GVehicleDebugParams.EnableMultithreading;
 	PhysicsParallelFor(OutputVehiclesBatch.Num(), LambdaParallelUpdate, ForceSingleThread);
 
+	OnPostSimulateVehicles.Broadcast();
+
 	// Delayed application of forces - This is separate from Simulate because forces cannot be executed multi-threaded
 	for (const TUniquePtr<FChaosVehicleAsyncInput>& VehicleInput : InputVehiclesBatch)
 	{
@@ -162,11 +162,21 @@ struct FChaosVehicleManagerAsyncOutput : public Chaos::FSimCallbackOutput
 	}
 };
 
+DECLARE_MULTICAST_DELEGATE(FOnPreSimulateVehicles);
+DECLARE_MULTICAST_DELEGATE(FOnPostSimulateVehicles);
+
 /**
  * Async callback from the Physics Engine where we can perform our vehicle simulation
  */
 class FChaosVehicleManagerAsyncCallback : public Chaos::TSimCallbackObject<FChaosVehicleManagerAsyncInput, FChaosVehicleManagerAsyncOutput>
 {
+public:
+	/** Broadcast on the physics thread every tick, right before the vehicles are simulated */
+	static CHAOSVEHICLES_API FOnPreSimulateVehicles OnPreSimulateVehicles;
+
+	/** Broadcast on the physics thread every tick, once every vehicle has been simulated */
+	static CHAOSVEHICLES_API FOnPostSimulateVehicles OnPostSimulateVehicles;
+
 private:
 	virtual void OnPreSimulate_Internal() override;
 	virtual void OnContactModification_Internal(Chaos::FCollisionContactModifier& Modifications) override;
@@ -7,6 +7,9 @@ public class EngineSimulatorPlugin : ModuleRules
 	public EngineSimulatorPlugin(ReadOnlyTargetRules Target) : base(Target)
 	{
 		PCHUsage = ModuleRules.PCHUsageMode.UseExplicitOrSharedPCHs;			
+
+        // Engine descriptions tell engine-sim's throttle and valvetrain types apart with dynamic_cast
+        bUseRTTI = true;
 		
 		PublicDependencyModuleNames.AddRange(
 			new string[]
@@ -24,10 +27,17 @@ public class EngineSimulatorPlugin : ModuleRules
 			{
 				"EngineSim",
                 "ChaosVehiclesCore",
-                "ChaosVehiclesEngine"
+                "ChaosVehiclesEngine",
+                "SignalProcessing",
+                "Json"
             }
 		);
 
+        if (Target.bBuildEditor)
+        {
+            PrivateDependencyModuleNames.Add("DirectoryWatcher");
+        }
+
         if (Target.bBuildDeveloperTools || (Target.Configuration != UnrealTargetConfiguration.Shipping && Target.Configuration != UnrealTargetConfiguration.Test))
         {
             PrivateDependencyModuleNames.Add("GameplayDebugger");
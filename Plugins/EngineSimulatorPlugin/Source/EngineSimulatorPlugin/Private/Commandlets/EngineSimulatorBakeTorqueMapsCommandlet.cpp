@@ -0,0 +1,104 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Commandlets/EngineSimulatorBakeTorqueMapsCommandlet.h"
+#include "EngineSimulatorPlugin.h"
+#include "EngineDefinitionRegistry.h"
+#include "EngineTorqueMap.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+int32 UEngineSimulatorBakeTorqueMapsCommandlet::Main(const FString& Params)
+{
+	FString Filter;
+	FParse::Value(*Params, TEXT("Filter="), Filter);
+	const bool bForce = FParse::Param(*Params, TEXT("Force"));
+
+	const FString AssetDirectory = FEngineSimulatorPluginModule::GetAssetDirectory();
+
+	TArray<FString> Files;
+	IFileManager::Get().FindFilesRecursive(Files, *FPaths::Combine(AssetDirectory, TEXT("engines")), TEXT("*.mr"), true, false);
+	Files.Sort();
+
+	FString Csv = TEXT("Script,Engine,PeakTorqueNm,PeakTorqueRPM,PeakPowerKW,PeakPowerRPM,IdleRPM,Inertia,BakeSeconds\n");
+
+	int32 NumFailed = 0;
+	const double TotalStart = FPlatformTime::Seconds();
+	for (const FString& File : Files)
+	{
+		if (!Filter.IsEmpty() && !File.Contains(Filter))
+		{
+			continue;
+		}
+
+		// Only scripts with a main node build a whole engine, the rest are parts other scripts import
+		FString Source;
+		if (!FFileHelper::LoadFileToString(Source, *File) || !Source.Contains(TEXT("public node main")))
+		{
+			continue;
+		}
+
+		FString ScriptPath = File;
+		FPaths::MakePathRelativeTo(ScriptPath, *(AssetDirectory / TEXT("")));
+
+		const FEngineDefinitionPtr Definition = FEngineDefinitionRegistry::Get().FindOrAdd(ScriptPath);
+		if (!Definition.IsValid() || !Definition->GetDescription().bCompiled)
+		{
+			UE_LOG(LogTemp, Error, TEXT("%s doesn't compile"), *ScriptPath);
+			++NumFailed;
+			continue;
+		}
+
+		const FString MapPath = FEngineTorqueMapCache::GetMapPath(*Definition);
+
+		FEngineTorqueMap Map;
+		const double Start = FPlatformTime::Seconds();
+		if (bForce || !Map.Load(MapPath))
+		{
+			if (!FEngineTorqueMap::Bake(*Definition, FEngineTorqueMapBakeSettings(), Map))
+			{
+				UE_LOG(LogTemp, Error, TEXT("Failed to bake torque map for %s"), *ScriptPath);
+				++NumFailed;
+				continue;
+			}
+
+			if (!Map.Save(MapPath))
+			{
+				UE_LOG(LogTemp, Error, TEXT("Failed to write torque map %s"), *MapPath);
+				++NumFailed;
+				continue;
+			}
+		}
+		const double BakeSeconds = FPlatformTime::Seconds() - Start;
+
+		float PeakTorque = 0.f, PeakTorqueRPM = 0.f, PeakPower = 0.f, PeakPowerRPM = 0.f;
+		for (const float RPM : Map.RPMs)
+		{
+			const float Torque = Map.SampleTorque(RPM, 1.f);
+			const float Power = Map.SamplePower(RPM, 1.f);
+			if (Torque > PeakTorque)
+			{
+				PeakTorque = Torque;
+				PeakTorqueRPM = RPM;
+			}
+			if (Power > PeakPower)
+			{
+				PeakPower = Power;
+				PeakPowerRPM = RPM;
+			}
+		}
+		const float IdleRPM = Map.SteadyRPMs.Num() > 0 ? Map.SteadyRPMs[0] : 0.f;
+
+		UE_LOG(LogTemp, Display, TEXT("%-50s %6.0f Nm @ %5.0f rpm  %6.1f kW @ %5.0f rpm  idle %5.0f rpm  %.3f kg m^2  %.2f s"),
+			*ScriptPath, PeakTorque, PeakTorqueRPM, PeakPower / 1000.f, PeakPowerRPM, IdleRPM, Map.Inertia, BakeSeconds);
+
+		Csv += FString::Printf(TEXT("%s,%s,%f,%f,%f,%f,%f,%f,%f\n"),
+			*ScriptPath, *Map.EngineName, PeakTorque, PeakTorqueRPM, PeakPower / 1000.f, PeakPowerRPM, IdleRPM, Map.Inertia, BakeSeconds);
+	}
+
+	const FString CsvPath = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("EngineSimulator"), TEXT("TorqueMaps"), TEXT("Summary.csv"));
+	FFileHelper::SaveStringToFile(Csv, *CsvPath);
+	UE_LOG(LogTemp, Display, TEXT("Wrote %s in %.2f s"), *CsvPath, FPlatformTime::Seconds() - TotalStart);
+
+	return NumFailed > 0 ? 1 : 0;
+}
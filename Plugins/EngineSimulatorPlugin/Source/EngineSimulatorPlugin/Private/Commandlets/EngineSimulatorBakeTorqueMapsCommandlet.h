@@ -0,0 +1,21 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "EngineSimulatorBakeTorqueMapsCommandlet.generated.h"
+
+/**
+ * Bakes the torque map of every runnable engine script under the asset directory's engines folder, see FEngineTorqueMap.
+ * Usage: -run=EngineSimulatorBakeTorqueMaps [-Filter=ferrari] [-Force]
+ * Maps land in the cache the surrogates load from, with a summary in Saved/EngineSimulator/TorqueMaps/Summary.csv
+ */
+UCLASS()
+class UEngineSimulatorBakeTorqueMapsCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,369 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Commandlets/EngineSimulatorBenchmarkCommandlet.h"
+#include "EngineSimulator.h"
+#include "EngineSimulatorScheduler.h"
+#include "EngineSimulatorWheeledVehicleSimulation.h"
+#include "Async/ParallelFor.h"
+#include "Dom/JsonObject.h"
+#include "HAL/PlatformMemory.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonSerializer.h"
+#include "Sound/SoundWaveProcedural.h"
+#include "UObject/StrongObjectPtr.h"
+
+namespace
+{
+	const int32 BenchmarkSampleRate = 44100;
+
+	// Crank, idle, blip the throttle in neutral, then pull through the gears at full throttle on the dyno. Repeats.
+	struct FBenchmarkDriveCycle
+	{
+		static constexpr float StartTime = 1.f;
+		static constexpr float IdleTime = 2.f;
+		static constexpr float RevTime = 3.f;
+		static constexpr float GearTime = 4.f;
+
+		int32 NumGears = 1;
+		float Redline = 6000.f;
+
+		float GetLength() const { return StartTime + IdleTime + RevTime + NumGears * GearTime; }
+
+		struct FControls
+		{
+			bool bStarter = false;
+			int32 Gear = -1;
+			float Throttle = 0.f;
+			bool bDyno = false;
+			float DynoRPM = 0.f;
+		};
+
+		FControls Evaluate(float Time) const
+		{
+			Time = FMath::Fmod(Time, GetLength());
+
+			FControls Controls;
+			Controls.bStarter = Time < StartTime;
+			Time -= StartTime + IdleTime;
+			if (Time < 0.f)
+			{
+				// The dyno is still on from the last gear when the cycle wraps around, it's turned off here too
+				return Controls;
+			}
+
+			if (Time < RevTime)
+			{
+				Controls.Throttle = 0.5f - 0.5f * FMath::Cos(2.f * PI * Time);
+				return Controls;
+			}
+			Time -= RevTime;
+
+			// Each gear picks up where the last one left off, like the wheels would have
+			const int32 Gear = FMath::Min(FMath::FloorToInt(Time / GearTime), NumGears - 1);
+			const float Alpha = (Time - Gear * GearTime) / GearTime;
+			Controls.Gear = Gear;
+			Controls.Throttle = 1.f;
+			Controls.bDyno = true;
+			Controls.DynoRPM = FMath::Lerp(0.4f, 0.9f, Alpha) * Redline;
+			return Controls;
+		}
+
+		void Apply(IEngineSimulatorInterface& Engine, float Time) const
+		{
+			const FControls Controls = Evaluate(Time);
+			Engine.SetStarterEnabled(Controls.bStarter);
+			Engine.SetDynoEnabled(Controls.bDyno);
+			Engine.SetGear(Controls.Gear);
+			Engine.SetSpeedControl(Controls.Throttle);
+			if (Controls.bDyno)
+			{
+				Engine.SetDynoSpeed(Controls.DynoRPM);
+			}
+		}
+
+		// The same controls the way a vehicle sends them, as commands and the wheel side speed the dyno follows
+		void Apply(FEngineSimulatorCommandQueue& Commands, FEngineSimulatorInput& Input, float GearRatio, float Time) const
+		{
+			const FControls Controls = Evaluate(Time);
+			Commands.Enqueue(FEngineSimulatorCommand::SetStarter(Controls.bStarter));
+			Commands.Enqueue(FEngineSimulatorCommand::SetGear(Controls.Gear));
+			Commands.Enqueue(FEngineSimulatorCommand::SetThrottle(Controls.Throttle));
+			Input.InContactWithGround = Controls.bDyno;
+			Input.EngineRPM = GearRatio != 0.f ? Controls.DynoRPM / GearRatio : 0.f;
+		}
+	};
+
+	struct FBenchmarkEngine
+	{
+		TUniquePtr<IEngineSimulatorInterface> Engine;
+
+		// With -Scheduler the engine belongs to an instance the scheduler steps, and Engine stays empty
+		TUniquePtr<FEngineSimulatorInstance> Instance;
+
+		// Whichever of the two is running
+		IEngineSimulatorInterface* Simulator = nullptr;
+
+		TStrongObjectPtr<USoundWaveProcedural> Wave;
+		TArray<uint8> PCM;
+		double AudioClock = 0.0;
+		double SimulateSeconds = 0.0;
+	};
+
+	FString LODToString(EEngineSimulatorLOD LOD)
+	{
+		return StaticEnum<EEngineSimulatorLOD>()->GetNameStringByValue(static_cast<int64>(LOD));
+	}
+}
+
+int32 UEngineSimulatorBenchmarkCommandlet::Main(const FString& Params)
+{
+	FString Script = TEXT("engines/atg-video-2/08_ferrari_f136_v8.mr");
+	int32 NumEngines = 8;
+	float Seconds = 20.f;
+	float FrameRate = 60.f;
+	FString LODName = TEXT("Full");
+	float BudgetMs = 0.f;
+	FParse::Value(*Params, TEXT("Script="), Script);
+	FParse::Value(*Params, TEXT("Engines="), NumEngines);
+	FParse::Value(*Params, TEXT("Seconds="), Seconds);
+	FParse::Value(*Params, TEXT("FrameRate="), FrameRate);
+	FParse::Value(*Params, TEXT("LOD="), LODName);
+	FParse::Value(*Params, TEXT("BudgetMs="), BudgetMs);
+	const bool bScheduler = FParse::Param(*Params, TEXT("Scheduler"));
+	const bool bParallel = !bScheduler && FParse::Param(*Params, TEXT("Parallel"));
+
+	const int64 LODValue = StaticEnum<EEngineSimulatorLOD>()->GetValueByNameString(LODName);
+	if (LODValue == INDEX_NONE || LODValue == static_cast<int64>(EEngineSimulatorLOD::Num))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Unknown LOD %s"), *LODName);
+		return 1;
+	}
+	const EEngineSimulatorLOD LOD = static_cast<EEngineSimulatorLOD>(LODValue);
+
+	if (NumEngines < 1 || Seconds <= 0.f || FrameRate <= 0.f)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Engines, Seconds and FrameRate have to be positive"));
+		return 1;
+	}
+
+	const uint64 MemoryBefore = FPlatformMemory::GetStats().UsedPhysical;
+
+	TArray<FBenchmarkEngine> Engines;
+	Engines.SetNum(NumEngines);
+
+	const double CreateStart = FPlatformTime::Seconds();
+	for (FBenchmarkEngine& Entry : Engines)
+	{
+		Entry.Wave.Reset(NewObject<USoundWaveProcedural>());
+		Entry.Wave->SetSampleRate(BenchmarkSampleRate);
+		Entry.Wave->NumChannels = 1;
+		Entry.Wave->Duration = INDEFINITELY_LOOPING_DURATION;
+
+		FEngineSimulatorParameters Parameters;
+		Parameters.SoundWaveOutput = Entry.Wave.Get();
+		Parameters.ScriptPath = Script;
+		Parameters.bPartitionedConvolution = FParse::Param(*Params, TEXT("PartitionedConvolution"));
+		Parameters.StepBudgetMs = BudgetMs;
+
+		if (bScheduler)
+		{
+			Entry.Instance = MakeUnique<FEngineSimulatorInstance>(Parameters);
+			Entry.Instance->CreateTask.Wait();
+
+			// Nothing is stepping it yet, so the engine can be set up directly
+			FScopeLock Lock(&Entry.Instance->StateMutex);
+			Entry.Instance->AcquireEngine();
+			Entry.Simulator = Entry.Instance->EngineSimulator.Get();
+			Entry.Wave->OnSoundWaveProceduralUnderflow.BindRaw(Entry.Instance.Get(), &FEngineSimulatorInstance::FillAudio);
+		}
+		else
+		{
+			Entry.Engine = CreateEngine(Parameters);
+			Entry.Simulator = Entry.Engine.Get();
+			if (Entry.Simulator != nullptr)
+			{
+				Entry.Wave->OnSoundWaveProceduralUnderflow.BindRaw(Entry.Simulator, &IEngineSimulatorInterface::FillAudio);
+			}
+		}
+
+		if (Entry.Simulator == nullptr || !Entry.Simulator->HasEngine())
+		{
+			UE_LOG(LogTemp, Error, TEXT("Failed to load %s"), *Script);
+			return 1;
+		}
+
+		Entry.Simulator->SetLOD(LOD);
+		Entry.Simulator->SetIgnitionEnabled(true);
+	}
+	const double CreateSeconds = FPlatformTime::Seconds() - CreateStart;
+	const uint64 MemoryAfterCreate = FPlatformMemory::GetStats().UsedPhysical;
+
+	FBenchmarkDriveCycle Cycle;
+	Cycle.NumGears = FMath::Max(1, Engines[0].Simulator->GetGearCount());
+	Cycle.Redline = Engines[0].Simulator->GetRedLine();
+
+	const float DeltaTime = 1.f / FrameRate;
+	const int32 NumFrames = FMath::CeilToInt(Seconds * FrameRate);
+
+	// Stagger the engines through the cycle so they aren't all doing the same thing at once
+	auto GetCycleTime = [DeltaTime](int32 Index, int32 Frame)
+	{
+		return Frame * DeltaTime + Index * 0.37f;
+	};
+
+	// Drain audio at the rate the mixer would while this much simulated time passes
+	auto DrainAudio = [DeltaTime](FBenchmarkEngine& Entry)
+	{
+		Entry.AudioClock += DeltaTime * BenchmarkSampleRate;
+		const int32 SamplesNeeded = FMath::FloorToInt(Entry.AudioClock);
+		Entry.AudioClock -= SamplesNeeded;
+		if (SamplesNeeded > 0)
+		{
+			Entry.PCM.SetNumUninitialized(SamplesNeeded * sizeof(int16), false);
+			Entry.Wave->GeneratePCMData(Entry.PCM.GetData(), SamplesNeeded);
+		}
+	};
+
+	auto StepEngine = [&Engines, &Cycle, &GetCycleTime, &DrainAudio, DeltaTime](int32 Index, int32 Frame)
+	{
+		FBenchmarkEngine& Entry = Engines[Index];
+		Cycle.Apply(*Entry.Simulator, GetCycleTime(Index, Frame));
+
+		const double Start = FPlatformTime::Seconds();
+		Entry.Simulator->Simulate(DeltaTime);
+		Entry.SimulateSeconds += FPlatformTime::Seconds() - Start;
+
+		DrainAudio(Entry);
+	};
+
+	UE_LOG(LogTemp, Display, TEXT("Running %d x %s at %s LOD for %.1f s at %.0f fps%s"),
+		NumEngines, *Script, *LODToString(LOD), Seconds, FrameRate,
+		bScheduler ? TEXT(", through the scheduler") : bParallel ? TEXT(", in parallel") : TEXT(""));
+
+	const double RunStart = FPlatformTime::Seconds();
+	for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+	{
+		if (bScheduler)
+		{
+			// What a physics tick does: every vehicle submits, the steps launch together and are joined before the next
+			FEngineSimulatorScheduler& Scheduler = FEngineSimulatorScheduler::Get();
+			for (int32 Index = 0; Index < Engines.Num(); ++Index)
+			{
+				FBenchmarkEngine& Entry = Engines[Index];
+
+				FEngineSimulatorInput Input;
+				Input.DeltaTime = DeltaTime;
+				Input.FrameCounter = Frame;
+				Cycle.Apply(Entry.Instance->Commands, Input, Entry.Simulator->GetGearRatio(), GetCycleTime(Index, Frame));
+
+				Entry.Instance->InputBuffer.Write(Input);
+				Scheduler.Submit(*Entry.Instance);
+			}
+			Scheduler.Flush();
+			Scheduler.Join();
+
+			for (FBenchmarkEngine& Entry : Engines)
+			{
+				DrainAudio(Entry);
+			}
+		}
+		else if (bParallel)
+		{
+			ParallelFor(Engines.Num(), [&StepEngine, Frame](int32 Index) { StepEngine(Index, Frame); });
+		}
+		else
+		{
+			for (int32 Index = 0; Index < Engines.Num(); ++Index)
+			{
+				StepEngine(Index, Frame);
+			}
+		}
+	}
+	const double RunSeconds = FPlatformTime::Seconds() - RunStart;
+	const uint64 PeakMemory = FPlatformMemory::GetStats().PeakUsedPhysical;
+
+	FString Csv = TEXT("Engine,Frames,Steps,MicrosecondsPerStep,StepsPerSecond,MinFrameSteps,MaxFrameSteps,SimulateMsPerFrame,SamplesProduced,SamplesConsumed,Underruns,UnderrunSamples,DegradedFrames,DroppedSeconds\n");
+
+	TArray<TSharedPtr<FJsonValue>> EngineResults;
+	uint64 TotalSteps = 0;
+	double TotalStepSeconds = 0.0;
+	for (int32 Index = 0; Index < Engines.Num(); ++Index)
+	{
+		IEngineSimulatorInterface& Engine = *Engines[Index].Simulator;
+		const FEngineSimulatorPerformanceStats Performance = Engine.GetPerformanceStats();
+		const FEngineSimulatorAudioStats Audio = Engine.GetAudioStats();
+
+		const double MicrosecondsPerStep = Performance.Steps > 0 ? Performance.StepSeconds * 1e6 / Performance.Steps : 0.0;
+		const double StepsPerSecond = Performance.StepSeconds > 0.0 ? Performance.Steps / Performance.StepSeconds : 0.0;
+		// Steps run on the scheduler's tasks aren't timed from here, their stepping time stands in
+		const double SimulateSeconds = bScheduler ? Performance.StepSeconds : Engines[Index].SimulateSeconds;
+		const double SimulateMsPerFrame = SimulateSeconds * 1e3 / NumFrames;
+		TotalSteps += Performance.Steps;
+		TotalStepSeconds += Performance.StepSeconds;
+
+		UE_LOG(LogTemp, Display, TEXT("Engine %2d  %8llu steps  %6.2f us/step  %9.0f steps/s  %3u-%3u steps/frame  %6.3f ms/frame  audio %llu/%llu  %llu underruns"),
+			Index, Performance.Steps, MicrosecondsPerStep, StepsPerSecond, Performance.MinFrameSteps, Performance.MaxFrameSteps,
+			SimulateMsPerFrame, Performance.SamplesProduced, Performance.SamplesConsumed, Audio.Underruns);
+
+		Csv += FString::Printf(TEXT("%d,%llu,%llu,%f,%f,%u,%u,%f,%llu,%llu,%llu,%llu,%llu,%f\n"),
+			Index, Performance.Frames, Performance.Steps, MicrosecondsPerStep, StepsPerSecond, Performance.MinFrameSteps,
+			Performance.MaxFrameSteps, SimulateMsPerFrame, Performance.SamplesProduced, Performance.SamplesConsumed,
+			Audio.Underruns, Audio.UnderrunSamples, Performance.DegradedFrames, Performance.DroppedSeconds);
+
+		TSharedRef<FJsonObject> Result = MakeShared<FJsonObject>();
+		Result->SetNumberField(TEXT("frames"), static_cast<double>(Performance.Frames));
+		Result->SetNumberField(TEXT("steps"), static_cast<double>(Performance.Steps));
+		Result->SetNumberField(TEXT("microsecondsPerStep"), MicrosecondsPerStep);
+		Result->SetNumberField(TEXT("stepsPerSecond"), StepsPerSecond);
+		Result->SetNumberField(TEXT("minFrameSteps"), Performance.MinFrameSteps);
+		Result->SetNumberField(TEXT("maxFrameSteps"), Performance.MaxFrameSteps);
+		Result->SetNumberField(TEXT("simulateMsPerFrame"), SimulateMsPerFrame);
+		Result->SetNumberField(TEXT("samplesProduced"), static_cast<double>(Performance.SamplesProduced));
+		Result->SetNumberField(TEXT("samplesConsumed"), static_cast<double>(Performance.SamplesConsumed));
+		Result->SetNumberField(TEXT("underruns"), static_cast<double>(Audio.Underruns));
+		Result->SetNumberField(TEXT("underrunSamples"), static_cast<double>(Audio.UnderrunSamples));
+		Result->SetNumberField(TEXT("degradedFrames"), static_cast<double>(Performance.DegradedFrames));
+		Result->SetNumberField(TEXT("droppedSeconds"), Performance.DroppedSeconds);
+		EngineResults.Add(MakeShared<FJsonValueObject>(Result));
+	}
+
+	const double RealtimeFactor = Seconds / RunSeconds;
+	UE_LOG(LogTemp, Display, TEXT("%.2f s wall for %.1f s simulated (x%.2f realtime), %.2f us/step overall, created in %.2f s, %.1f MB per engine, peak %.1f MB"),
+		RunSeconds, Seconds, RealtimeFactor, TotalSteps > 0 ? TotalStepSeconds * 1e6 / TotalSteps : 0.0, CreateSeconds,
+		(MemoryAfterCreate - FMath::Min(MemoryBefore, MemoryAfterCreate)) / (1024.0 * 1024.0) / NumEngines, PeakMemory / (1024.0 * 1024.0));
+
+	TSharedRef<FJsonObject> Root = MakeShared<FJsonObject>();
+	Root->SetStringField(TEXT("script"), Script);
+	Root->SetStringField(TEXT("lod"), LODToString(LOD));
+	Root->SetNumberField(TEXT("engines"), NumEngines);
+	Root->SetNumberField(TEXT("seconds"), Seconds);
+	Root->SetNumberField(TEXT("frameRate"), FrameRate);
+	Root->SetBoolField(TEXT("parallel"), bParallel);
+	Root->SetBoolField(TEXT("scheduler"), bScheduler);
+	Root->SetNumberField(TEXT("budgetMs"), BudgetMs);
+	Root->SetNumberField(TEXT("createSeconds"), CreateSeconds);
+	Root->SetNumberField(TEXT("wallSeconds"), RunSeconds);
+	Root->SetNumberField(TEXT("realtimeFactor"), RealtimeFactor);
+	Root->SetNumberField(TEXT("memoryPerEngineBytes"), static_cast<double>(MemoryAfterCreate - FMath::Min(MemoryBefore, MemoryAfterCreate)) / NumEngines);
+	Root->SetNumberField(TEXT("peakMemoryBytes"), static_cast<double>(PeakMemory));
+	Root->SetArrayField(TEXT("results"), EngineResults);
+
+	FString Json;
+	const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+	FJsonSerializer::Serialize(Root, Writer);
+
+	const FString Directory = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("EngineSimulator"));
+	FFileHelper::SaveStringToFile(Json, *FPaths::Combine(Directory, TEXT("Benchmark.json")));
+	FFileHelper::SaveStringToFile(Csv, *FPaths::Combine(Directory, TEXT("Benchmark.csv")));
+	UE_LOG(LogTemp, Display, TEXT("Wrote %s"), *FPaths::Combine(Directory, TEXT("Benchmark.json")));
+
+	// Nothing pulls from the waves any more, so the engines bound to them can go first
+	for (FBenchmarkEngine& Entry : Engines)
+	{
+		Entry.Engine.Reset();
+		Entry.Instance.Reset();
+	}
+
+	return 0;
+}
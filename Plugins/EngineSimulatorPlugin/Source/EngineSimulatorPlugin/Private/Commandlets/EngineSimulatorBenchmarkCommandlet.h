@@ -0,0 +1,24 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "EngineSimulatorBenchmarkCommandlet.generated.h"
+
+/**
+ * Runs a number of full engine simulations headless through a scripted drive cycle and reports what they cost.
+ * Audio is pulled from each engine's procedural wave at the simulated rate, standing in for the audio mixer.
+ * -Scheduler steps the engines the way vehicles do, through FEngineSimulatorScheduler, instead of calling them directly.
+ * Usage: -run=EngineSimulatorBenchmark [-Script=engines/atg-video-2/08_ferrari_f136_v8.mr] [-Engines=8] [-Seconds=20]
+ *        [-FrameRate=60] [-LOD=Full] [-BudgetMs=0] [-Parallel | -Scheduler] [-PartitionedConvolution]
+ * Results are logged and written to Saved/EngineSimulator/Benchmark.json and Benchmark.csv
+ */
+UCLASS()
+class UEngineSimulatorBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	virtual int32 Main(const FString& Params) override;
+};
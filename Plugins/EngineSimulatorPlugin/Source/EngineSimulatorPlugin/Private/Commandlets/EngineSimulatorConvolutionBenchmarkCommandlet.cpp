@@ -0,0 +1,244 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Commandlets/EngineSimulatorConvolutionBenchmarkCommandlet.h"
+#include "EngineSimulator.h"
+#include "EngineSimulatorPlugin.h"
+#include "ImpulseResponseCache.h"
+#include "PartitionedConvolver.h"
+#include "HAL/FileManager.h"
+#include "Math/RandomStream.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Sound/SoundWaveProcedural.h"
+#include "UObject/StrongObjectPtr.h"
+
+namespace
+{
+	// Same per sample multiply-add over the whole impulse response the synthesizer's convolution filter does
+	void ConvolveDirect(const TArray<float>& ImpulseResponse, const TArray<float>& Input, TArray<float>& Output)
+	{
+		const int32 Length = ImpulseResponse.Num();
+
+		// Doubled history so every sample reads one contiguous window
+		TArray<float> History;
+		History.SetNumZeroed(2 * Length);
+		int32 Head = 0;
+
+		Output.SetNumUninitialized(Input.Num());
+		for (int32 n = 0; n < Input.Num(); ++n)
+		{
+			Head = (Head == 0 ? Length : Head) - 1;
+			History[Head] = History[Head + Length] = Input[n];
+
+			const float* RESTRICT Window = History.GetData() + Head;
+			float Sum = 0.f;
+			for (int32 k = 0; k < Length; ++k)
+			{
+				Sum += ImpulseResponse[k] * Window[k];
+			}
+			Output[n] = Sum;
+		}
+	}
+
+	struct FEngineSoundLevels
+	{
+		double RMS = 0.0;
+		int32 Peak = 0;
+		int64 Clipped = 0;
+		int64 Samples = 0;
+
+		double GetRMSDecibels() const { return 20.0 * FMath::LogX(10.0, FMath::Max(RMS, 1.0) / 32768.0); }
+		double GetClippedFraction() const { return Samples > 0 ? static_cast<double>(Clipped) / Samples : 0.0; }
+	};
+
+	// Cranks the engine and sweeps the throttle in neutral for Seconds, measuring the sound it makes
+	bool MeasureEngineSound(const FString& Script, bool bPartitionedConvolution, float Seconds, FEngineSoundLevels& OutLevels)
+	{
+		const int32 SampleRate = 44100;
+		TStrongObjectPtr<USoundWaveProcedural> Wave(NewObject<USoundWaveProcedural>());
+		Wave->SetSampleRate(SampleRate);
+		Wave->NumChannels = 1;
+		Wave->Duration = INDEFINITELY_LOOPING_DURATION;
+
+		FEngineSimulatorParameters Parameters;
+		Parameters.SoundWaveOutput = Wave.Get();
+		Parameters.ScriptPath = Script;
+		Parameters.bPartitionedConvolution = bPartitionedConvolution;
+
+		TUniquePtr<IEngineSimulatorInterface> Engine = CreateEngine(Parameters);
+		if (!Engine.IsValid() || !Engine->HasEngine())
+		{
+			return false;
+		}
+
+		Wave->OnSoundWaveProceduralUnderflow.BindRaw(Engine.Get(), &IEngineSimulatorInterface::FillAudio);
+		Engine->SetIgnitionEnabled(true);
+
+		const float DeltaTime = 1.f / 60.f;
+		const int32 NumFrames = FMath::CeilToInt(Seconds / DeltaTime);
+		double AudioClock = 0.0;
+		double SumSquares = 0.0;
+		TArray<uint8> PCM;
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			// Slow enough for the leveler to follow, so the comparison is of where it sits rather than how fast it reacts
+			const float Time = Frame * DeltaTime;
+			Engine->SetStarterEnabled(Time < 1.f);
+			Engine->SetSpeedControl(0.5f - 0.5f * FMath::Cos(0.5f * PI * Time));
+			Engine->Simulate(DeltaTime);
+
+			AudioClock += DeltaTime * SampleRate;
+			const int32 SamplesNeeded = FMath::FloorToInt(AudioClock);
+			AudioClock -= SamplesNeeded;
+			PCM.SetNumUninitialized(SamplesNeeded * sizeof(int16), false);
+			const int32 NumSamples = Wave->GeneratePCMData(PCM.GetData(), SamplesNeeded) / sizeof(int16);
+
+			const int16* Samples = reinterpret_cast<const int16*>(PCM.GetData());
+			for (int32 i = 0; i < NumSamples; ++i)
+			{
+				SumSquares += static_cast<double>(Samples[i]) * Samples[i];
+				OutLevels.Peak = FMath::Max<int32>(OutLevels.Peak, FMath::Abs<int32>(Samples[i]));
+				OutLevels.Clipped += Samples[i] == INT16_MAX || Samples[i] == INT16_MIN;
+			}
+			OutLevels.Samples += NumSamples;
+		}
+
+		OutLevels.RMS = OutLevels.Samples > 0 ? FMath::Sqrt(SumSquares / OutLevels.Samples) : 0.0;
+
+		Wave->OnSoundWaveProceduralUnderflow.Unbind();
+		return true;
+	}
+}
+
+int32 UEngineSimulatorConvolutionBenchmarkCommandlet::Main(const FString& Params)
+{
+	float Seconds = 1.f;
+	int32 BlockSize = 256;
+	FString Script;
+	float EngineSeconds = 10.f;
+	float LevelTolerance = 1.f;
+	FParse::Value(*Params, TEXT("Seconds="), Seconds);
+	FParse::Value(*Params, TEXT("BlockSize="), BlockSize);
+	FParse::Value(*Params, TEXT("Script="), Script);
+	FParse::Value(*Params, TEXT("EngineSeconds="), EngineSeconds);
+	FParse::Value(*Params, TEXT("LevelTolerance="), LevelTolerance);
+
+	if (!FMath::IsPowerOfTwo(BlockSize))
+	{
+		UE_LOG(LogTemp, Error, TEXT("BlockSize has to be a power of two"));
+		return 1;
+	}
+
+	const FString AssetDirectory = FEngineSimulatorPluginModule::GetAssetDirectory();
+
+	TArray<FString> Files;
+	IFileManager::Get().FindFilesRecursive(Files, *FPaths::Combine(AssetDirectory, TEXT("sound-library")), TEXT("*.wav"), true, false);
+	IFileManager::Get().FindFilesRecursive(Files, *FPaths::Combine(AssetDirectory, TEXT("../es/sound-library")), TEXT("*.wav"), true, false, false);
+
+	// White noise is as good as anything for timing, and exercises the whole spectrum for the error check
+	const int32 NumSamples = FMath::Max(1, FMath::RoundToInt(Seconds * 44100));
+	TArray<float> Input;
+	Input.SetNumUninitialized(NumSamples);
+	FRandomStream Random(0);
+	for (float& Sample : Input)
+	{
+		Sample = Random.FRandRange(-30000.f, 30000.f);
+	}
+
+	FString Csv = TEXT("File,ImpulseResponseSamples,Partitions,DirectNsPerSample,PartitionedNsPerSample,Speedup,MaxError\n");
+
+	TArray<float> DirectOutput;
+	TArray<float> PartitionedOutput;
+	for (const FString& File : Files)
+	{
+		const FImpulseResponseSamplesPtr Samples = FImpulseResponseCache::Get().FindOrLoad(File);
+		if (!Samples.IsValid())
+		{
+			continue;
+		}
+
+		TArray<float> ImpulseResponse;
+		Samples->ToFloat(1.f, ImpulseResponse);
+		if (ImpulseResponse.Num() == 0)
+		{
+			continue;
+		}
+
+		double Start = FPlatformTime::Seconds();
+		ConvolveDirect(ImpulseResponse, Input, DirectOutput);
+		const double DirectSeconds = FPlatformTime::Seconds() - Start;
+
+		FPartitionedConvolver Convolver;
+		if (!Convolver.Initialize(ImpulseResponse.GetData(), ImpulseResponse.Num(), BlockSize))
+		{
+			UE_LOG(LogTemp, Error, TEXT("No FFT algorithm available for block size %d"), BlockSize);
+			return 1;
+		}
+
+		// Push one extra block through so the partitioned output covers the same span despite its latency
+		PartitionedOutput.SetNumZeroed(NumSamples + Convolver.GetLatency());
+		TArray<float> PaddedInput = Input;
+		PaddedInput.AddZeroed(Convolver.GetLatency());
+
+		Start = FPlatformTime::Seconds();
+		Convolver.Process(PaddedInput.GetData(), PartitionedOutput.GetData(), PaddedInput.Num());
+		const double PartitionedSeconds = FPlatformTime::Seconds() - Start;
+
+		float MaxError = 0.f;
+		for (int32 n = 0; n < NumSamples; ++n)
+		{
+			MaxError = FMath::Max(MaxError, FMath::Abs(PartitionedOutput[n + Convolver.GetLatency()] - DirectOutput[n]));
+		}
+
+		const double DirectNs = DirectSeconds * 1e9 / NumSamples;
+		const double PartitionedNs = PartitionedSeconds * 1e9 / PaddedInput.Num();
+		const FString Name = FPaths::GetCleanFilename(File);
+		const int32 Partitions = FMath::DivideAndRoundUp(ImpulseResponse.Num(), BlockSize);
+
+		UE_LOG(LogTemp, Display, TEXT("%-40s %6d samples  direct %9.1f ns/sample  partitioned %7.1f ns/sample  x%.1f  max error %f"),
+			*Name, ImpulseResponse.Num(), DirectNs, PartitionedNs, DirectNs / PartitionedNs, MaxError);
+
+		Csv += FString::Printf(TEXT("%s,%d,%d,%f,%f,%f,%f\n"), *Name, ImpulseResponse.Num(), Partitions, DirectNs, PartitionedNs, DirectNs / PartitionedNs, MaxError);
+	}
+
+	const FString CsvPath = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("EngineSimulator"), TEXT("ConvolutionBenchmark.csv"));
+	FFileHelper::SaveStringToFile(Csv, *CsvPath);
+	UE_LOG(LogTemp, Display, TEXT("Wrote %s"), *CsvPath);
+
+	if (!Script.IsEmpty())
+	{
+		// The engine's noise is random, so the two runs are compared by level rather than sample by sample
+		FEngineSoundLevels Direct;
+		FEngineSoundLevels Partitioned;
+		if (!MeasureEngineSound(Script, false, EngineSeconds, Direct) || !MeasureEngineSound(Script, true, EngineSeconds, Partitioned))
+		{
+			UE_LOG(LogTemp, Error, TEXT("Failed to load %s"), *Script);
+			return 1;
+		}
+
+		FString LevelsCsv = TEXT("Script,Convolution,RmsDbfs,Peak,ClippedFraction\n");
+		auto AddLevels = [&Script, &LevelsCsv](const TCHAR* Convolution, const FEngineSoundLevels& Levels)
+		{
+			UE_LOG(LogTemp, Display, TEXT("%-12s %6.1f dBFS RMS  peak %5d  %.3f%% clipped"),
+				Convolution, Levels.GetRMSDecibels(), Levels.Peak, Levels.GetClippedFraction() * 100.0);
+			LevelsCsv += FString::Printf(TEXT("%s,%s,%f,%d,%f\n"), *Script, Convolution, Levels.GetRMSDecibels(), Levels.Peak, Levels.GetClippedFraction());
+		};
+		AddLevels(TEXT("Direct"), Direct);
+		AddLevels(TEXT("Partitioned"), Partitioned);
+
+		const double LevelDelta = Partitioned.GetRMSDecibels() - Direct.GetRMSDecibels();
+		UE_LOG(LogTemp, Display, TEXT("Partitioned comes out %+.1f dB against direct for %s"), LevelDelta, *Script);
+
+		const FString LevelsCsvPath = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("EngineSimulator"), TEXT("ConvolutionLevels.csv"));
+		FFileHelper::SaveStringToFile(LevelsCsv, *LevelsCsvPath);
+		UE_LOG(LogTemp, Display, TEXT("Wrote %s"), *LevelsCsvPath);
+
+		if (FMath::Abs(LevelDelta) > LevelTolerance)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Partitioned convolution is more than %.1f dB off direct for %s"), LevelTolerance, *Script);
+			return 1;
+		}
+	}
+
+	return 0;
+}
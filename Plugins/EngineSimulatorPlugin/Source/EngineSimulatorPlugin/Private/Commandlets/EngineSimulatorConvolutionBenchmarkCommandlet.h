@@ -0,0 +1,23 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "EngineSimulatorConvolutionBenchmarkCommandlet.generated.h"
+
+/**
+ * Times direct against partitioned FFT convolution for every impulse response in the sound library.
+ * With -Script it also revs that engine with each and compares the sound levels. Partitioned convolution runs after the
+ * synthesizer's leveler instead of before it, and fails the run if that moves the level more than LevelTolerance dB.
+ * Usage: -run=EngineSimulatorConvolutionBenchmark [-Seconds=1] [-BlockSize=256] [-Script=engines/...mr] [-EngineSeconds=10] [-LevelTolerance=1]
+ * Results are logged and written to Saved/EngineSimulator/ConvolutionBenchmark.csv, and ConvolutionLevels.csv with -Script
+ */
+UCLASS()
+class UEngineSimulatorConvolutionBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	virtual int32 Main(const FString& Params) override;
+};
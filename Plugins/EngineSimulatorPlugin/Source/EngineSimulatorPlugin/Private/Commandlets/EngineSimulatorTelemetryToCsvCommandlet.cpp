@@ -0,0 +1,42 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Commandlets/EngineSimulatorTelemetryToCsvCommandlet.h"
+#include "EngineTelemetry.h"
+#include "HAL/FileManager.h"
+#include "Misc/Paths.h"
+
+int32 UEngineSimulatorTelemetryToCsvCommandlet::Main(const FString& Params)
+{
+	FString Input;
+	FString Output;
+	FParse::Value(*Params, TEXT("Input="), Input);
+	FParse::Value(*Params, TEXT("Output="), Output);
+
+	TArray<FString> Captures;
+	if (!Input.IsEmpty())
+	{
+		Captures.Add(Input);
+	}
+	else
+	{
+		IFileManager::Get().FindFilesRecursive(Captures, *FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("EngineSimulator"), TEXT("Telemetry")), TEXT("*.estl"), true, false);
+		Output.Empty();
+	}
+
+	int32 NumFailed = 0;
+	for (const FString& Capture : Captures)
+	{
+		const FString CsvPath = Output.IsEmpty() ? FPaths::ChangeExtension(Capture, TEXT("csv")) : Output;
+		if (!FEngineTelemetryRecorder::ConvertToCsv(Capture, CsvPath))
+		{
+			++NumFailed;
+		}
+	}
+
+	if (Captures.Num() == 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("No engine telemetry captures found"));
+	}
+
+	return NumFailed > 0 ? 1 : 0;
+}
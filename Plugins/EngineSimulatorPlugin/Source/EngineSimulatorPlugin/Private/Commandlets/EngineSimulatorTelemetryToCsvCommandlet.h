@@ -0,0 +1,21 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "EngineSimulatorTelemetryToCsvCommandlet.generated.h"
+
+/**
+ * Converts engine telemetry captures to CSV, see FEngineTelemetryRecorder.
+ * Usage: -run=EngineSimulatorTelemetryToCsv [-Input=Capture.estl] [-Output=Capture.csv]
+ * Without -Input every capture in Saved/EngineSimulator/Telemetry is converted next to itself.
+ */
+UCLASS()
+class UEngineSimulatorTelemetryToCsvCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,139 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EngineAudioResampler.h"
+#include "Math/VectorRegister.h"
+
+namespace
+{
+	// Around 80dB of stopband attenuation with the taps used here
+	const double KaiserBeta = 8.0;
+
+	// Fraction of the lower Nyquist frequency passed, the rest is the filter's transition band
+	const double PassBand = 0.92;
+
+	// Zeroth order modified Bessel function of the first kind, what the Kaiser window is made of
+	double BesselI0(double X)
+	{
+		double Sum = 1.0;
+		double Term = 1.0;
+		for (int32 k = 1; k < 32; ++k)
+		{
+			Term *= (X * 0.5 / k) * (X * 0.5 / k);
+			Sum += Term;
+			if (Term < Sum * 1e-12)
+			{
+				break;
+			}
+		}
+		return Sum;
+	}
+}
+
+FEngineAudioResampler::FEngineAudioResampler(int32 InInputRate, int32 InOutputRate)
+	: InputRate(InInputRate)
+	, OutputRate(InOutputRate)
+	, Step(static_cast<double>(InInputRate) / InOutputRate)
+	, Position(0.0)
+{
+	check(InputRate > 0 && OutputRate > 0);
+
+	// Cutoff in cycles per input sample, downsampling has to filter out what the output rate can't hold
+	const double Cutoff = 0.5 * PassBand * FMath::Min(1.0, static_cast<double>(OutputRate) / InputRate);
+	const double HalfWidth = NumTaps / 2;
+	const double WindowScale = 1.0 / BesselI0(KaiserBeta);
+
+	Filter.SetNumZeroed((NumPhases + 1) * NumTaps);
+	for (int32 Phase = 0; Phase <= NumPhases; ++Phase)
+	{
+		float* const Row = Filter.GetData() + Phase * NumTaps;
+		const double Fraction = static_cast<double>(Phase) / NumPhases;
+
+		double Sum = 0.0;
+		for (int32 k = 0; k < NumTaps; ++k)
+		{
+			// Distance from the tap to the point being interpolated, which lies between taps HalfWidth - 1 and HalfWidth
+			const double T = k - (HalfWidth - 1.0) - Fraction;
+			const double X = 2.0 * Cutoff * T;
+			const double Sinc = FMath::IsNearlyZero(X) ? 1.0 : FMath::Sin(PI * X) / (PI * X);
+			const double R = FMath::Clamp(T / HalfWidth, -1.0, 1.0);
+			const double Window = BesselI0(KaiserBeta * FMath::Sqrt(1.0 - R * R)) * WindowScale;
+
+			const double Tap = 2.0 * Cutoff * Sinc * Window;
+			Row[k] = static_cast<float>(Tap);
+			Sum += Tap;
+		}
+
+		// Unity gain at DC for every phase, otherwise the phases ripple against each other as the position moves
+		for (int32 k = 0; k < NumTaps; ++k)
+		{
+			Row[k] = static_cast<float>(Row[k] / Sum);
+		}
+	}
+
+	// Silence before the first sample, so the first output lines up with it
+	Pending.SetNumZeroed(NumTaps / 2 - 1);
+}
+
+uint32 FEngineAudioResampler::GetInputNeeded(uint32 OutputCount) const
+{
+	if (OutputCount == 0)
+	{
+		return 0;
+	}
+
+	const int64 LastFirstTap = static_cast<int64>(Position + (OutputCount - 1) * Step);
+	return static_cast<uint32>(FMath::Max<int64>(LastFirstTap + NumTaps - Pending.Num(), 0));
+}
+
+uint32 FEngineAudioResampler::Process(const float* Input, uint32 InputCount, float* Output, uint32 MaxOutput)
+{
+	Pending.Append(Input, InputCount);
+
+	const float* const Samples = Pending.GetData();
+	uint32 NumOutput = 0;
+	while (NumOutput < MaxOutput)
+	{
+		const int32 FirstTap = static_cast<int32>(Position);
+		if (FirstTap + NumTaps > Pending.Num())
+		{
+			break;
+		}
+
+		const float PhasePosition = static_cast<float>((Position - FirstTap) * NumPhases);
+		const int32 Phase = FMath::Min(static_cast<int32>(PhasePosition), NumPhases - 1);
+		Output[NumOutput++] = Interpolate(Samples + FirstTap, Phase, PhasePosition - Phase);
+
+		Position += Step;
+	}
+
+	// Keep the position small so it doesn't lose precision over a long session
+	const int32 Consumed = FMath::Min(static_cast<int32>(Position), Pending.Num());
+	Pending.RemoveAt(0, Consumed, false);
+	Position -= Consumed;
+
+	return NumOutput;
+}
+
+float FEngineAudioResampler::Interpolate(const float* Input, int32 Phase, float Blend) const
+{
+	static_assert(NumTaps % 4 == 0, "Taps are processed four at a time");
+
+	// Filter rows are a multiple of four floats into an aligned buffer, the input can be anywhere
+	const float* const Low = Filter.GetData() + Phase * NumTaps;
+	const float* const High = Low + NumTaps;
+
+	VectorRegister4Float AccumulatedLow = VectorZeroFloat();
+	VectorRegister4Float AccumulatedHigh = VectorZeroFloat();
+	for (int32 k = 0; k < NumTaps; k += 4)
+	{
+		const VectorRegister4Float Samples = VectorLoad(Input + k);
+		AccumulatedLow = VectorMultiplyAdd(Samples, VectorLoadAligned(Low + k), AccumulatedLow);
+		AccumulatedHigh = VectorMultiplyAdd(Samples, VectorLoadAligned(High + k), AccumulatedHigh);
+	}
+
+	const VectorRegister4Float Accumulated = VectorMultiplyAdd(VectorSubtract(AccumulatedHigh, AccumulatedLow), VectorSetFloat1(Blend), AccumulatedLow);
+
+	alignas(16) float Lanes[4];
+	VectorStoreAligned(Accumulated, Lanes);
+	return (Lanes[0] + Lanes[1]) + (Lanes[2] + Lanes[3]);
+}
@@ -0,0 +1,48 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DSP/AlignedBuffer.h"
+
+/**
+ * Streaming sample rate converter for mono float audio. Band limited interpolation with a Kaiser windowed sinc: the filter
+ * is tabulated for NumPhases fractional offsets up front, each output sample blends the two nearest phases and costs two
+ * NumTaps long dot products on vector registers. Input that can't be used yet is kept for the next call.
+ * Output lags input by NumTaps / 2 input samples.
+ */
+class FEngineAudioResampler
+{
+public:
+	FEngineAudioResampler(int32 InInputRate, int32 InOutputRate);
+
+	int32 GetInputRate() const { return InputRate; }
+	int32 GetOutputRate() const { return OutputRate; }
+
+	// How many more input samples OutputCount outputs need on top of what's already buffered
+	uint32 GetInputNeeded(uint32 OutputCount) const;
+
+	// Buffers Input and writes up to MaxOutput converted samples, returns how many were written
+	uint32 Process(const float* Input, uint32 InputCount, float* Output, uint32 MaxOutput);
+
+private:
+	static constexpr int32 NumTaps = 32;
+	static constexpr int32 NumPhases = 256;
+
+	float Interpolate(const float* Input, int32 Phase, float Blend) const;
+
+	int32 InputRate;
+	int32 OutputRate;
+
+	// Input samples per output sample
+	double Step;
+
+	// (NumPhases + 1) rows of NumTaps, the extra row so the last phase has one to blend towards
+	Audio::FAlignedFloatBuffer Filter;
+
+	// Input not consumed yet, starting with the history the next output's first tap reads
+	TArray<float> Pending;
+
+	// Where the next output's first tap falls in Pending, the fraction picks the filter phase
+	double Position;
+};
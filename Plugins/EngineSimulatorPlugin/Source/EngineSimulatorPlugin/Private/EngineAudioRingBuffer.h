@@ -0,0 +1,89 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+/**
+ * Lock-free single producer, single consumer ring of audio samples.
+ * All memory is allocated up front, both sides hand out pointers straight into the ring so the data is never staged.
+ */
+class FEngineAudioRingBuffer
+{
+public:
+	struct FRegions
+	{
+		int16* First = nullptr;
+		uint32 FirstCount = 0;
+		int16* Second = nullptr;
+		uint32 SecondCount = 0;
+
+		uint32 Num() const { return FirstCount + SecondCount; }
+	};
+
+	// Capacity gets rounded up to a power of two
+	explicit FEngineAudioRingBuffer(uint32 InCapacity)
+		: WriteIndex(0)
+		, ReadIndex(0)
+	{
+		Buffer.SetNumZeroed(FMath::RoundUpToPowerOfTwo(FMath::Max(InCapacity, 2u)));
+		Mask = Buffer.Num() - 1;
+	}
+
+	uint32 GetCapacity() const { return Buffer.Num(); }
+
+	// Number of samples waiting to be read, safe from either side
+	uint32 Num() const
+	{
+		return WriteIndex.load(std::memory_order_acquire) - ReadIndex.load(std::memory_order_acquire);
+	}
+
+	// Producer: up to NumSamples of free space, split in two where it wraps
+	FRegions GetWriteRegions(uint32 NumSamples)
+	{
+		const uint32 Write = WriteIndex.load(std::memory_order_relaxed);
+		const uint32 Free = GetCapacity() - (Write - ReadIndex.load(std::memory_order_acquire));
+		return MakeRegions(Write, FMath::Min(NumSamples, Free));
+	}
+
+	// Producer: publishes samples written through GetWriteRegions()
+	void CommitWrite(uint32 NumSamples)
+	{
+		WriteIndex.store(WriteIndex.load(std::memory_order_relaxed) + NumSamples, std::memory_order_release);
+	}
+
+	// Consumer: up to NumSamples of queued audio, split in two where it wraps
+	FRegions GetReadRegions(uint32 NumSamples)
+	{
+		const uint32 Read = ReadIndex.load(std::memory_order_relaxed);
+		const uint32 Available = WriteIndex.load(std::memory_order_acquire) - Read;
+		return MakeRegions(Read, FMath::Min(NumSamples, Available));
+	}
+
+	// Consumer: releases samples read through GetReadRegions() back to the producer
+	void CommitRead(uint32 NumSamples)
+	{
+		ReadIndex.store(ReadIndex.load(std::memory_order_relaxed) + NumSamples, std::memory_order_release);
+	}
+
+private:
+	FRegions MakeRegions(uint32 Index, uint32 NumSamples)
+	{
+		const uint32 Start = Index & Mask;
+
+		FRegions Regions;
+		Regions.First = Buffer.GetData() + Start;
+		Regions.FirstCount = FMath::Min(NumSamples, GetCapacity() - Start);
+		Regions.Second = Buffer.GetData();
+		Regions.SecondCount = NumSamples - Regions.FirstCount;
+		return Regions;
+	}
+
+	TArray<int16> Buffer;
+	uint32 Mask;
+
+	// Free running counters, only their difference matters so wrapping around 2^32 is fine
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint32> WriteIndex;
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint32> ReadIndex;
+};
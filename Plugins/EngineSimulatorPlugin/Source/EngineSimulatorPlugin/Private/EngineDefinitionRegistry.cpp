@@ -0,0 +1,466 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EngineDefinitionRegistry.h"
+#include "EngineSimulatorPlugin.h"
+#include "EngineSimulatorStats.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Tasks/Task.h"
+
+#include "EngineSimulatorInternals/HeaderFixesStart.h"
+
+#include "compiler.h"
+#include "engine.h"
+#include "crankshaft.h"
+#include "piston.h"
+#include "connecting_rod.h"
+#include "combustion_chamber.h"
+#include "intake.h"
+#include "exhaust_system.h"
+#include "ignition_module.h"
+#include "transmission.h"
+#include "vehicle.h"
+
+#include "EngineSimulatorInternals/HeaderFixesEnd.h"
+
+DECLARE_CYCLE_STAT(TEXT("EngineSimulator:CompileScript"), STAT_EngineSimulatorPlugin_CompileScript, STATGROUP_EngineSimulatorPlugin);
+
+void FEngineGraph::Destroy()
+{
+	if (engine != nullptr)
+	{
+		engine->destroy();
+		delete engine;
+		engine = nullptr;
+	}
+
+	delete vehicle;
+	vehicle = nullptr;
+
+	delete transmission;
+	transmission = nullptr;
+
+	Objects.Reset();
+}
+
+static void SerializeGas(FArchive& Ar, GasSystem& System)
+{
+	GasSystem::State& state = System.m_state;
+	Ar << state.n_mol << state.E_k << state.volume;
+	Ar << state.momentum[0] << state.momentum[1];
+	Ar << state.mix.p_fuel << state.mix.p_inert << state.mix.p_o2;
+}
+
+void FEngineGraph::SerializeBody(FArchive& Ar, atg_scs::RigidBody& Body)
+{
+	Ar << Body.p_x << Body.p_y << Body.theta;
+	Ar << Body.v_x << Body.v_y << Body.v_theta;
+}
+
+void FEngineGraph::SerializeState(FArchive& Ar)
+{
+	IgnitionModule* ignition = engine->getIgnitionModule();
+
+	int32 Shape[] = {
+		engine->getCrankshaftCount(),
+		engine->getCylinderCount(),
+		engine->getIntakeCount(),
+		engine->getExhaustSystemCount(),
+		ignition != nullptr ? 1 : 0
+	};
+	int32 ExpectedShape[UE_ARRAY_COUNT(Shape)];
+	FMemory::Memcpy(ExpectedShape, Shape, sizeof(Shape));
+	for (int32& Count : Shape)
+	{
+		Ar << Count;
+	}
+	if (Ar.IsError() || FMemory::Memcmp(Shape, ExpectedShape, sizeof(Shape)) != 0)
+	{
+		Ar.SetError();
+		return;
+	}
+
+	if (ignition != nullptr)
+	{
+		Ar << ignition->m_enabled;
+	}
+
+	for (int i = 0; i < engine->getCrankshaftCount(); ++i)
+	{
+		SerializeBody(Ar, engine->getCrankshaft(i)->m_body);
+	}
+	for (int i = 0; i < engine->getCylinderCount(); ++i)
+	{
+		SerializeBody(Ar, engine->getPiston(i)->m_body);
+		SerializeBody(Ar, engine->getConnectingRod(i)->m_body);
+	}
+
+	// The gas in every cylinder, intake and exhaust, so the next stroke burns what the last one left behind
+	for (int i = 0; i < engine->getCylinderCount(); ++i)
+	{
+		CombustionChamber* chamber = engine->getChamber(i);
+		SerializeGas(Ar, chamber->m_system);
+		Ar << chamber->m_lit;
+	}
+	for (int i = 0; i < engine->getIntakeCount(); ++i)
+	{
+		SerializeGas(Ar, engine->getIntake(i)->m_system);
+	}
+	for (int i = 0; i < engine->getExhaustSystemCount(); ++i)
+	{
+		SerializeGas(Ar, engine->getExhaustSystem(i)->m_system);
+	}
+}
+
+FEngineDefinition::FEngineDefinition(const FString& InScriptPath, const FString& InCompilePath, const TArray<FString>& InSearchPaths)
+	: ScriptPath(InScriptPath)
+	, CompilePath(InCompilePath)
+	, SearchPaths(InSearchPaths)
+{
+	TArray<FString> Closure;
+	Key = FEngineScriptCache::Get().ComputeKey(CompilePath, SearchPaths, &Closure);
+
+	if (!FEngineScriptCache::Get().Find(Key, Description))
+	{
+		// Compile once up front to fill in the description, the graph becomes the first spare
+		FEngineGraph Graph;
+		Compile(Graph);
+
+		Description = Describe(Graph);
+		Description.Closure = MoveTemp(Closure);
+		FEngineScriptCache::Get().Store(Key, Description);
+
+		AddDefaults(Graph);
+		SaveCompiledState(Graph);
+		SpareGraphs.Add(Graph);
+	}
+	else if (!Description.bCompiled)
+	{
+		// This exact set of scripts failed to compile before, don't pay for Piranha just to fail again
+		UE_LOG(LogTemp, Warning, TEXT("Skipping compile of %s, it failed to compile last time"), *CompilePath);
+	}
+
+	// With a cached description graphs are built from it, Piranha only runs for engines the description can't capture
+
+	for (const FEngineScriptDescription::FImpulseResponse& Response : Description.ImpulseResponses)
+	{
+		ImpulseResponses.Add(FImpulseResponseCache::Get().FindOrLoad(Response.Filename));
+	}
+}
+
+FEngineDefinition::~FEngineDefinition()
+{
+	for (FEngineGraph& Graph : SpareGraphs)
+	{
+		Graph.Destroy();
+	}
+}
+
+FEngineGraph FEngineDefinition::AcquireGraph() const
+{
+	{
+		FScopeLock Lock(&SpareGraphsMutex);
+		++NumInUse;
+		PeakInUse = FMath::Max(PeakInUse, NumInUse);
+
+		if (SpareGraphs.Num() > 0)
+		{
+			const FEngineGraph Graph = SpareGraphs.Pop(false);
+
+			// Engines the description can't capture still compile, which takes a while, so start on the next
+			// vehicle's graph now. Built graphs are cheap enough to make when they're asked for.
+			if (SpareGraphs.Num() == 0 && NumCreatingSpares == 0 && Description.bCompiled && !Description.Graph.bValid)
+			{
+				++NumCreatingSpares;
+				UE::Tasks::Launch(UE_SOURCE_LOCATION, [Definition = AsShared()]()
+				{
+					Definition->CreateSpare();
+				});
+			}
+			return Graph;
+		}
+	}
+
+	return CreateGraph();
+}
+
+void FEngineDefinition::ReleaseGraph(FEngineGraph Graph) const
+{
+	ResetGraph(Graph);
+
+	{
+		// Only as many graphs are kept as were ever in use at once, enough for the same vehicles to respawn
+		FScopeLock Lock(&SpareGraphsMutex);
+		--NumInUse;
+		if (NumInUse + SpareGraphs.Num() + NumCreatingSpares < PeakInUse)
+		{
+			SpareGraphs.Add(Graph);
+			return;
+		}
+	}
+
+	Graph.Destroy();
+}
+
+void FEngineDefinition::ReserveGraphs(int32 Count) const
+{
+	if (!Description.bCompiled)
+	{
+		return;
+	}
+
+	while (true)
+	{
+		{
+			FScopeLock Lock(&SpareGraphsMutex);
+			PeakInUse = FMath::Max(PeakInUse, NumInUse + Count);
+			if (SpareGraphs.Num() + NumCreatingSpares >= Count)
+			{
+				return;
+			}
+			++NumCreatingSpares;
+		}
+
+		CreateSpare();
+	}
+}
+
+FEngineGraph FEngineDefinition::CreateGraph() const
+{
+	FEngineGraph Graph;
+	if (!Description.Graph.Build(Graph) && Description.bCompiled)
+	{
+		Compile(Graph);
+	}
+	AddDefaults(Graph);
+	SaveCompiledState(Graph);
+	return Graph;
+}
+
+void FEngineDefinition::SaveCompiledState(FEngineGraph& Graph) const
+{
+	FScopeLock Lock(&SpareGraphsMutex);
+	if (Graph.engine != nullptr && CompiledState.Num() == 0)
+	{
+		FMemoryWriter Ar(CompiledState);
+		Graph.SerializeState(Ar);
+	}
+}
+
+void FEngineDefinition::CreateSpare() const
+{
+	const FEngineGraph Graph = CreateGraph();
+
+	FScopeLock Lock(&SpareGraphsMutex);
+	--NumCreatingSpares;
+	SpareGraphs.Add(Graph);
+}
+
+void FEngineDefinition::ResetGraph(FEngineGraph& Graph) const
+{
+	// Everything a simulator changes goes back to how the compiler left it, only the controls are set directly
+	if (Graph.engine != nullptr)
+	{
+		FScopeLock Lock(&SpareGraphsMutex);
+		FMemoryReader Ar(CompiledState);
+		Graph.SerializeState(Ar);
+		Graph.engine->setSpeedControl(0.0);
+	}
+	if (Graph.transmission != nullptr)
+	{
+		Graph.transmission->changeGear(-1);
+	}
+}
+
+void FEngineDefinition::Compile(FEngineGraph& OutGraph) const
+{
+	UE_LOG(LogTemp, Warning, TEXT("Compiling engine script %s"), *CompilePath);
+	ENGINESIMULATOR_SCOPE_CYCLE_COUNTER(STAT_EngineSimulatorPlugin_CompileScript);
+
+#ifdef ATG_ENGINE_SIM_PIRANHA_ENABLED
+	// Only compiles of the same script wait on each other, e.g. torque map bake workers on an engine that can't be
+	// described. Different scripts compiling at once may mix their errors in error_log.log.
+	FScopeLock Lock(&CompileMutex);
+
+	es_script::Compiler compiler;
+	compiler.initialize();
+	for (const FString& SearchPath : SearchPaths)
+	{
+		compiler.addSearchPath(TCHAR_TO_UTF8(*SearchPath));
+	}
+
+	if (FPaths::FileExists(TEXT("error_log.log")))
+	{
+		IFileManager& FileManager = IFileManager::Get();
+		FileManager.Delete(TEXT("error_log.log"));
+	}
+
+	const bool compiled = compiler.compile(TCHAR_TO_UTF8(*CompilePath));
+	if (compiled)
+	{
+		const es_script::Compiler::Output output = compiler.execute();
+
+		OutGraph.engine = output.engine;
+		OutGraph.vehicle = output.vehicle;
+		OutGraph.transmission = output.transmission;
+	}
+
+	compiler.destroy();
+#endif /* ATG_ENGINE_SIM_PIRANHA_ENABLED */
+}
+
+void FEngineDefinition::AddDefaults(FEngineGraph& Graph)
+{
+	if (Graph.vehicle == nullptr)
+	{
+		Vehicle::Parameters vehParams;
+		vehParams.mass = units::mass(1597, units::kg);
+		vehParams.diffRatio = 3.42;
+		vehParams.tireRadius = units::distance(10, units::inch);
+		vehParams.dragCoefficient = 0.25;
+		vehParams.crossSectionArea = units::distance(6.0, units::foot) * units::distance(6.0, units::foot);
+		vehParams.rollingResistance = 2000.0;
+		Graph.vehicle = new Vehicle;
+		Graph.vehicle->initialize(vehParams);
+	}
+
+	if (Graph.transmission == nullptr)
+	{
+		const double gearRatios[] = { 2.97, 2.07, 1.43, 1.00, 0.84, 0.56 };
+		Transmission::Parameters tParams;
+		tParams.GearCount = 6;
+		tParams.GearRatios = gearRatios;
+		tParams.MaxClutchTorque = units::torque(1000.0, units::ft_lb);
+		Graph.transmission = new Transmission;
+		Graph.transmission->initialize(tParams);
+	}
+}
+
+FEngineScriptDescription FEngineDefinition::Describe(const FEngineGraph& Graph)
+{
+	FEngineScriptDescription Result;
+	Result.bCompiled = Graph.engine != nullptr;
+	Result.Graph.Capture(Graph);
+	if (Result.bCompiled && !Result.Graph.bValid)
+	{
+		UE_LOG(LogTemp, Log, TEXT("%s can't be described, every vehicle using it compiles it"), UTF8_TO_TCHAR(Graph.engine->getName().c_str()));
+	}
+
+	if (Engine* engine = Graph.engine)
+	{
+		Result.EngineName = UTF8_TO_TCHAR(engine->getName().c_str());
+		Result.Redline = static_cast<float>(units::toRpm(engine->getRedline()));
+		Result.SimulationFrequency = static_cast<float>(engine->getSimulationFrequency());
+
+		for (int i = 0; i < engine->getExhaustSystemCount(); ++i)
+		{
+			ImpulseResponse* response = engine->getExhaustSystem(i)->getImpulseResponse();
+
+			FEngineScriptDescription::FImpulseResponse& Response = Result.ImpulseResponses.AddDefaulted_GetRef();
+			Response.Filename = UTF8_TO_TCHAR(response->getFilename().c_str());
+			Response.Volume = static_cast<float>(response->getVolume());
+		}
+	}
+
+	if (Transmission* transmission = Graph.transmission)
+	{
+		Result.GearRatios.Append(transmission->getGearRatios(), transmission->getGearCount());
+		Result.MaxClutchTorque = transmission->getMaxClutchTorque();
+	}
+
+	return Result;
+}
+
+FEngineDefinitionRegistry& FEngineDefinitionRegistry::Get()
+{
+	static FEngineDefinitionRegistry Registry;
+	return Registry;
+}
+
+FEngineDefinitionPtr FEngineDefinitionRegistry::FindOrAdd(const FString& ScriptPath)
+{
+	const FString AssetDirectory = FPaths::ConvertRelativePathToFull(FEngineSimulatorPluginModule::GetAssetDirectory());
+	const FString esPath = FPaths::ConvertRelativePathToFull(FPaths::Combine(AssetDirectory, "../es/"));
+
+	// Only this script's lock is held while it compiles, so vehicles using engines that are already registered don't wait on it
+	TSharedPtr<FCriticalSection, ESPMode::ThreadSafe> ScriptMutex;
+	{
+		FScopeLock Lock(&Mutex);
+		TSharedPtr<FCriticalSection, ESPMode::ThreadSafe>& Found = ScriptMutexes.FindOrAdd(ScriptPath);
+		if (!Found.IsValid())
+		{
+			Found = MakeShared<FCriticalSection, ESPMode::ThreadSafe>();
+		}
+		ScriptMutex = Found;
+	}
+	FScopeLock ScriptLock(ScriptMutex.Get());
+
+	FString CompilePath;
+	if (ScriptPath.IsEmpty())
+	{
+		CompilePath = FPaths::Combine(AssetDirectory, TEXT("main.mr"));
+	}
+	else
+	{
+		// Engine scripts only declare a main node, so they get a small entry script that imports and runs it
+		const FString WrapperName = ScriptPath.Replace(TEXT("/"), TEXT("_")).Replace(TEXT("\\"), TEXT("_"));
+		CompilePath = FPaths::ConvertRelativePathToFull(FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("EngineSimulator"), TEXT("Scripts"), WrapperName));
+
+		const FString Wrapper = FString::Printf(TEXT("import \"engine_sim.mr\"\nimport \"%s\"\n\nmain()\n"), *ScriptPath);
+		FString ExistingWrapper;
+		if (!FFileHelper::LoadFileToString(ExistingWrapper, *CompilePath) || ExistingWrapper != Wrapper)
+		{
+			FFileHelper::SaveStringToFile(Wrapper, *CompilePath);
+		}
+	}
+
+	const TArray<FString> SearchPaths = { esPath, AssetDirectory };
+
+	// A changed script or import gives a new key, so stale definitions get replaced here
+	FEngineDefinitionPtr Existing;
+	{
+		FScopeLock Lock(&Mutex);
+		Existing = Definitions.FindRef(ScriptPath);
+	}
+	if (Existing.IsValid() && Existing->GetKey() == FEngineScriptCache::Get().ComputeKey(CompilePath, SearchPaths))
+	{
+		return Existing;
+	}
+
+	FEngineDefinitionPtr Definition = MakeShared<FEngineDefinition, ESPMode::ThreadSafe>(ScriptPath, CompilePath, SearchPaths);
+	{
+		FScopeLock Lock(&Mutex);
+		Definitions.Add(ScriptPath, Definition);
+	}
+	return Definition;
+}
+
+TArray<FString> FEngineDefinitionRegistry::FindImporting(const TArray<FString>& Files)
+{
+	FScopeLock Lock(&Mutex);
+
+	TArray<FString> Importing;
+	for (const TPair<FString, FEngineDefinitionPtr>& Definition : Definitions)
+	{
+		const TArray<FString>& Closure = Definition.Value->GetDescription().Closure;
+		const bool bImports = Files.ContainsByPredicate([&Closure](const FString& File)
+		{
+			return Closure.ContainsByPredicate([&File](const FString& Path) { return FPaths::IsSamePath(Path, File); });
+		});
+
+		if (bImports)
+		{
+			Importing.Add(Definition.Key);
+		}
+	}
+	return Importing;
+}
+
+void FEngineDefinitionRegistry::Reset()
+{
+	FScopeLock Lock(&Mutex);
+	Definitions.Reset();
+}
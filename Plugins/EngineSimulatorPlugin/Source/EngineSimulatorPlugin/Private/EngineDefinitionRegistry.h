@@ -0,0 +1,127 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EngineScriptCache.h"
+#include "ImpulseResponseCache.h"
+
+class Engine;
+class Vehicle;
+class Transmission;
+namespace atg_scs { class RigidBody; }
+struct FEngineGraphObjects;
+
+/**
+ * The object graph a compiled engine script produces, mirrors es_script::Compiler::Output.
+ * One of these is owned by each running simulator.
+ */
+struct FEngineGraph
+{
+	Engine* engine = nullptr;
+	Vehicle* vehicle = nullptr;
+	Transmission* transmission = nullptr;
+
+	// Functions, camshafts and the like a graph built from a description owns, see FEngineGraphDescription::Build().
+	// Null for graphs straight from the compiler, whose script nodes own those.
+	TSharedPtr<FEngineGraphObjects, ESPMode::ThreadSafe> Objects;
+
+	void Destroy();
+
+	// The state running the engine changes: ignition, bodies and the gas in every cylinder, intake and exhaust. The
+	// engine's shape goes first, loading into a different engine sets an error on the archive and changes nothing.
+	void SerializeState(FArchive& Ar);
+
+	static void SerializeBody(FArchive& Ar, atg_scs::RigidBody& Body);
+};
+
+/**
+ * An engine script compiled once and shared between every vehicle that uses it.
+ * The definition itself never changes after it's registered, per vehicle state lives in the graphs handed out by AcquireGraph().
+ * Graphs are built from the description rather than compiled, so a definition found in the script cache never runs
+ * Piranha, unless the engine has parts the description can't capture.
+ */
+class FEngineDefinition : public TSharedFromThis<FEngineDefinition, ESPMode::ThreadSafe>
+{
+public:
+	FEngineDefinition(const FString& InScriptPath, const FString& InCompilePath, const TArray<FString>& InSearchPaths);
+	~FEngineDefinition();
+
+	const FString& GetScriptPath() const { return ScriptPath; }
+	const FString& GetKey() const { return Key; }
+	const FEngineScriptDescription& GetDescription() const { return Description; }
+
+	// Hands out a graph for a new simulator, reusing one a previous simulator gave back when possible, or else building
+	// one from the description
+	FEngineGraph AcquireGraph() const;
+
+	// Takes back a graph from a simulator that's going away and puts it back the way it was compiled, so nothing carries
+	// over to the next vehicle. It's kept while fewer graphs exist than were ever in use at once, and destroyed otherwise.
+	// The graph must already be released from its simulator.
+	void ReleaseGraph(FEngineGraph Graph) const;
+
+	// Builds graphs until Count are spare, e.g. before a group of vehicles using this engine spawns at once
+	void ReserveGraphs(int32 Count) const;
+
+private:
+	void Compile(FEngineGraph& OutGraph) const;
+
+	// Builds a graph from the description, compiling only if it can't
+	FEngineGraph CreateGraph() const;
+	void ResetGraph(FEngineGraph& Graph) const;
+
+	// Keeps the state of the first graph compiled as CompiledState
+	void SaveCompiledState(FEngineGraph& Graph) const;
+
+	// Creates a graph NumCreatingSpares already counts and adds it to the spares
+	void CreateSpare() const;
+
+	static void AddDefaults(FEngineGraph& Graph);
+	static FEngineScriptDescription Describe(const FEngineGraph& Graph);
+
+	FString ScriptPath;
+	FString CompilePath;
+	TArray<FString> SearchPaths;
+	FString Key;
+	FEngineScriptDescription Description;
+
+	// Keeps the decoded impulse responses alive between respawns of vehicles using this definition
+	TArray<FImpulseResponseSamplesPtr> ImpulseResponses;
+
+	mutable FCriticalSection CompileMutex;
+
+	mutable FCriticalSection SpareGraphsMutex;
+	mutable TArray<FEngineGraph> SpareGraphs;
+	mutable int32 NumCreatingSpares = 0;
+
+	// Graphs handed out and not yet released, and the most there ever were, which caps how many are kept.
+	// ReserveGraphs() raises the peak too.
+	mutable int32 NumInUse = 0;
+	mutable int32 PeakInUse = 0;
+
+	// SerializeState() of a graph straight out of the compiler, what released graphs are reset to. Empty until the first
+	// compile, guarded by SpareGraphsMutex.
+	mutable TArray<uint8> CompiledState;
+};
+
+using FEngineDefinitionPtr = TSharedPtr<const FEngineDefinition, ESPMode::ThreadSafe>;
+
+class FEngineDefinitionRegistry
+{
+public:
+	static FEngineDefinitionRegistry& Get();
+
+	// ScriptPath is relative to the plugin asset directory, an empty path means main.mr
+	FEngineDefinitionPtr FindOrAdd(const FString& ScriptPath);
+
+	// Script paths of the registered definitions that import any of the files, directly or not
+	TArray<FString> FindImporting(const TArray<FString>& Files);
+
+	// Drops every registered definition. Running simulators keep theirs alive until they're destroyed.
+	void Reset();
+
+private:
+	FCriticalSection Mutex;
+	TMap<FString, FEngineDefinitionPtr> Definitions;
+	TMap<FString, TSharedPtr<FCriticalSection, ESPMode::ThreadSafe>> ScriptMutexes;
+};
@@ -0,0 +1,765 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EngineGraphDescription.h"
+#include "EngineDefinitionRegistry.h"
+
+#include "EngineSimulatorInternals/HeaderFixesStart.h"
+
+#include "engine.h"
+#include "crankshaft.h"
+#include "cylinder_bank.h"
+#include "cylinder_head.h"
+#include "piston.h"
+#include "connecting_rod.h"
+#include "camshaft.h"
+#include "standard_valvetrain.h"
+#include "intake.h"
+#include "exhaust_system.h"
+#include "impulse_response.h"
+#include "ignition_module.h"
+#include "fuel.h"
+#include "combustion_chamber.h"
+#include "direct_throttle_linkage.h"
+#include "governor.h"
+#include "function.h"
+#include "transmission.h"
+#include "vehicle.h"
+
+#include "EngineSimulatorInternals/HeaderFixesEnd.h"
+
+/**
+ * What the script nodes would have allocated alongside the engine and never freed: functions, camshafts, valvetrains,
+ * the throttle and impulse responses. A built graph owns them through this and frees them after the engine.
+ */
+struct FEngineGraphObjects
+{
+	TArray<Function*> Functions;
+	TArray<Camshaft*> Camshafts;
+	TArray<Valvetrain*> Valvetrains;
+	TArray<ImpulseResponse*> ImpulseResponses;
+	Throttle* ThrottleLinkage = nullptr;
+
+	~FEngineGraphObjects()
+	{
+		for (Function* function : Functions)
+		{
+			function->destroy();
+			delete function;
+		}
+		for (Camshaft* camshaft : Camshafts)
+		{
+			camshaft->destroy();
+			delete camshaft;
+		}
+		for (Valvetrain* valvetrain : Valvetrains)
+		{
+			delete valvetrain;
+		}
+		for (ImpulseResponse* response : ImpulseResponses)
+		{
+			delete response;
+		}
+		delete ThrottleLinkage;
+	}
+};
+
+template <typename T>
+static int32 FindPart(const T* Part, int32 Count, TFunctionRef<const T*(int32)> GetPart)
+{
+	for (int32 i = 0; i < Count; ++i)
+	{
+		if (GetPart(i) == Part)
+		{
+			return i;
+		}
+	}
+	return INDEX_NONE;
+}
+
+void FEngineGraphDescription::Capture(const FEngineGraph& Graph)
+{
+	*this = FEngineGraphDescription();
+
+	if (::Transmission* transmission = Graph.transmission)
+	{
+		bHasTransmission = true;
+		Transmission.GearRatios.Append(transmission->getGearRatios(), transmission->getGearCount());
+		Transmission.MaxClutchTorque = transmission->getMaxClutchTorque();
+	}
+
+	if (::Vehicle* vehicle = Graph.vehicle)
+	{
+		bHasVehicle = true;
+		Vehicle.Mass = vehicle->getMass();
+		Vehicle.DiffRatio = vehicle->getDiffRatio();
+		Vehicle.TireRadius = vehicle->getTireRadius();
+		Vehicle.DragCoefficient = vehicle->getDragCoefficient();
+		Vehicle.CrossSectionArea = vehicle->getCrossSectionArea();
+		Vehicle.RollingResistance = vehicle->getRollingResistance();
+	}
+
+	Engine* engine = Graph.engine;
+	if (engine == nullptr || engine->getIgnitionModule() == nullptr)
+	{
+		return;
+	}
+
+	// Functions are shared between parts the same way the script shared them
+	TMap<const Function*, int32> FunctionIndices;
+	auto AddFunction = [this, &FunctionIndices](const Function* function) -> int32
+	{
+		if (function == nullptr)
+		{
+			return INDEX_NONE;
+		}
+		if (const int32* Existing = FunctionIndices.Find(function))
+		{
+			return *Existing;
+		}
+
+		FFunction& Table = Functions.AddDefaulted_GetRef();
+		Table.FilterRadius = function->getFilterRadius();
+		Table.InputScale = function->getInputScale();
+		Table.OutputScale = function->getOutputScale();
+		for (int i = 0; i < function->getSampleCount(); ++i)
+		{
+			Table.X.Add(function->getSampleX(i));
+			Table.Y.Add(function->getSampleY(i));
+		}
+		return FunctionIndices.Add(function, Functions.Num() - 1);
+	};
+
+	auto FindCrankshaft = [engine](const Crankshaft* crankshaft)
+	{
+		return FindPart<Crankshaft>(crankshaft, engine->getCrankshaftCount(), [engine](int32 i) { return engine->getCrankshaft(i); });
+	};
+
+	Name = UTF8_TO_TCHAR(engine->getName().c_str());
+	StarterTorque = engine->getStarterTorque();
+	StarterSpeed = engine->getStarterSpeed();
+	Redline = engine->getRedline();
+	DynoMinSpeed = engine->getDynoMinSpeed();
+	DynoMaxSpeed = engine->getDynoMaxSpeed();
+	DynoHoldStep = engine->getDynoHoldStep();
+	SimulationFrequency = engine->getSimulationFrequency();
+	HighFrequencyGain = engine->getInitialHighFrequencyGain();
+	Noise = engine->getInitialNoise();
+	Jitter = engine->getInitialJitter();
+
+	if (const Governor* governor = dynamic_cast<const Governor*>(engine->getThrottle()))
+	{
+		Throttle.bGovernor = true;
+		Throttle.MinSpeed = governor->getMinSpeed();
+		Throttle.MaxSpeed = governor->getMaxSpeed();
+		Throttle.MinVelocity = governor->getMinVelocity();
+		Throttle.MaxVelocity = governor->getMaxVelocity();
+		Throttle.K_s = governor->getK_s();
+		Throttle.K_d = governor->getK_d();
+		Throttle.Gamma = governor->getGamma();
+	}
+	else if (const DirectThrottleLinkage* linkage = dynamic_cast<const DirectThrottleLinkage*>(engine->getThrottle()))
+	{
+		Throttle.Gamma = linkage->getGamma();
+	}
+	else
+	{
+		return;
+	}
+
+	const ::Fuel* fuel = engine->getFuel();
+	Fuel.Name = UTF8_TO_TCHAR(fuel->getName().c_str());
+	Fuel.MolecularMass = fuel->getMolecularMass();
+	Fuel.EnergyDensity = fuel->getEnergyDensity();
+	Fuel.Density = fuel->getDensity();
+	Fuel.MolecularAfr = fuel->getMolecularAfr();
+	Fuel.TurbulenceToFlameSpeedRatio = AddFunction(fuel->getTurbulenceToFlameSpeedRatio());
+	Fuel.MaxBurningEfficiency = fuel->getMaxBurningEfficiency();
+	Fuel.BurningEfficiencyRandomness = fuel->getBurningEfficiencyRandomness();
+	Fuel.LowEfficiencyAttenuation = fuel->getLowEfficiencyAttenuation();
+	Fuel.MaxTurbulenceEffect = fuel->getMaxTurbulenceEffect();
+	Fuel.MaxDilutionEffect = fuel->getMaxDilutionEffect();
+
+	for (int i = 0; i < engine->getCrankshaftCount(); ++i)
+	{
+		const Crankshaft* crankshaft = engine->getCrankshaft(i);
+
+		FCrankshaft& Out = Crankshafts.AddDefaulted_GetRef();
+		Out.Mass = crankshaft->getMass();
+		Out.FlywheelMass = crankshaft->getFlywheelMass();
+		Out.MomentOfInertia = crankshaft->getMomentOfInertia();
+		Out.CrankThrow = crankshaft->getCrankThrow();
+		Out.PositionX = crankshaft->getPosX();
+		Out.PositionY = crankshaft->getPosY();
+		Out.TDC = crankshaft->getTdc();
+		Out.FrictionTorque = crankshaft->getFrictionTorque();
+		for (int j = 0; j < crankshaft->getRodJournalCount(); ++j)
+		{
+			Out.RodJournalAngles.Add(crankshaft->getRodJournalAngle(j));
+		}
+	}
+
+	for (int i = 0; i < engine->getIntakeCount(); ++i)
+	{
+		const Intake* intake = engine->getIntake(i);
+
+		FIntake& Out = Intakes.AddDefaulted_GetRef();
+		Out.PlenumVolume = intake->getPlenumVolume();
+		Out.PlenumCrossSectionArea = intake->getPlenumCrossSectionArea();
+		Out.IntakeFlowRate = intake->getInputFlowK();
+		Out.IdleFlowRate = intake->getIdleFlowK();
+		Out.RunnerFlowRate = intake->getRunnerFlowRate();
+		Out.MolecularAfr = intake->getMolecularAfrRatio();
+		Out.IdleThrottlePlatePosition = intake->getIdleThrottlePlatePosition();
+		Out.ThrottleGamma = intake->getThrottleGamma();
+		Out.RunnerLength = intake->getRunnerLength();
+		Out.VelocityDecay = intake->getVelocityDecay();
+	}
+
+	for (int i = 0; i < engine->getExhaustSystemCount(); ++i)
+	{
+		const ExhaustSystem* exhaust = engine->getExhaustSystem(i);
+
+		FExhaustSystem& Out = ExhaustSystems.AddDefaulted_GetRef();
+		Out.Length = exhaust->getLength();
+		Out.CollectorCrossSectionArea = exhaust->getCollectorCrossSectionArea();
+		Out.OutletFlowRate = exhaust->getOutletFlowRate();
+		Out.PrimaryTubeLength = exhaust->getPrimaryTubeLength();
+		Out.PrimaryFlowRate = exhaust->getPrimaryFlowRate();
+		Out.AudioVolume = exhaust->getAudioVolume();
+		Out.VelocityDecay = exhaust->getVelocityDecay();
+		if (ImpulseResponse* response = exhaust->getImpulseResponse())
+		{
+			Out.ImpulseResponse = UTF8_TO_TCHAR(response->getFilename().c_str());
+			Out.ImpulseResponseVolume = response->getVolume();
+		}
+	}
+
+	// Heads go with banks, and only a standard valvetrain is described. VTEC engines keep going through the compiler.
+	TMap<const Camshaft*, int32> CamshaftIndices;
+	auto AddCamshaft = [this, &CamshaftIndices, &AddFunction, &FindCrankshaft](const Camshaft* camshaft) -> int32
+	{
+		if (const int32* Existing = CamshaftIndices.Find(camshaft))
+		{
+			return *Existing;
+		}
+
+		FCamshaft& Out = Camshafts.AddDefaulted_GetRef();
+		Out.Crankshaft = FindCrankshaft(camshaft->getCrankshaft());
+		Out.LobeProfile = AddFunction(camshaft->getLobeProfile());
+		Out.Advance = camshaft->getAdvance();
+		Out.BaseRadius = camshaft->getBaseRadius();
+		for (int j = 0; j < camshaft->getLobeCount(); ++j)
+		{
+			Out.LobeCenterlines.Add(camshaft->getLobeCenterline(j));
+		}
+		return CamshaftIndices.Add(camshaft, Camshafts.Num() - 1);
+	};
+
+	for (int i = 0; i < engine->getCylinderBankCount(); ++i)
+	{
+		const CylinderBank* bank = engine->getCylinderBank(i);
+
+		FCylinderBank& OutBank = Banks.AddDefaulted_GetRef();
+		OutBank.Crankshaft = FindCrankshaft(bank->getCrankshaft());
+		OutBank.Angle = bank->getAngle();
+		OutBank.Bore = bank->getBore();
+		OutBank.DeckHeight = bank->getDeckHeight();
+		OutBank.DisplayDepth = bank->getDisplayDepth();
+		OutBank.PositionX = bank->getX();
+		OutBank.PositionY = bank->getY();
+		OutBank.CylinderCount = bank->getCylinderCount();
+
+		const CylinderHead* head = engine->getHead(i);
+		const StandardValvetrain* valvetrain = dynamic_cast<const StandardValvetrain*>(head->getValvetrain());
+		if (valvetrain == nullptr)
+		{
+			return;
+		}
+
+		FCylinderHead& OutHead = Heads.AddDefaulted_GetRef();
+		OutHead.IntakeCamshaft = AddCamshaft(valvetrain->getIntakeCamshaft());
+		OutHead.ExhaustCamshaft = AddCamshaft(valvetrain->getExhaustCamshaft());
+		OutHead.IntakePortFlow = AddFunction(head->getIntakePortFlow());
+		OutHead.ExhaustPortFlow = AddFunction(head->getExhaustPortFlow());
+		OutHead.CombustionChamberVolume = head->getCombustionChamberVolume();
+		OutHead.IntakeRunnerVolume = head->getIntakeRunnerVolume();
+		OutHead.IntakeRunnerCrossSectionArea = head->getIntakeRunnerCrossSectionArea();
+		OutHead.ExhaustRunnerVolume = head->getExhaustRunnerVolume();
+		OutHead.ExhaustRunnerCrossSectionArea = head->getExhaustRunnerCrossSectionArea();
+		OutHead.bFlipDisplay = head->getFlipDisplay();
+	}
+
+	for (int i = 0; i < engine->getCylinderCount(); ++i)
+	{
+		const Piston* piston = engine->getPiston(i);
+		const ConnectingRod* rod = engine->getConnectingRod(i);
+
+		FCylinder& Out = Cylinders.AddDefaulted_GetRef();
+		Out.Bank = piston->getCylinderBank()->getIndex();
+		Out.IndexInBank = piston->getCylinderIndex();
+
+		Out.PistonMass = piston->getMass();
+		Out.BlowbyFlowCoefficient = piston->getBlowbyK();
+		Out.CompressionHeight = piston->getCompressionHeight();
+		Out.WristPinPosition = piston->getWristPinLocation();
+		Out.Displacement = piston->getDisplacement();
+
+		Out.RodMass = rod->getMass();
+		Out.RodMomentOfInertia = rod->getMomentOfInertia();
+		Out.RodCenterOfMass = rod->getCenterOfMass();
+		Out.RodLength = rod->getLength();
+		Out.SlaveThrow = rod->getSlaveThrow();
+		Out.Crankshaft = FindCrankshaft(rod->getCrankshaft());
+		Out.Journal = rod->getJournal();
+		Out.MasterRod = FindPart<ConnectingRod>(rod->getMasterRod(), engine->getCylinderCount(), [engine](int32 c) { return engine->getConnectingRod(c); });
+		for (int j = 0; j < rod->getRodJournalCount(); ++j)
+		{
+			Out.RodJournalAngles.Add(rod->getRodJournalAngle(j));
+		}
+
+		const CylinderHead* head = engine->getHead(Out.Bank);
+		Out.Intake = FindPart<Intake>(head->getIntake(Out.IndexInBank), engine->getIntakeCount(), [engine](int32 k) { return engine->getIntake(k); });
+		Out.ExhaustSystem = FindPart<ExhaustSystem>(head->getExhaustSystem(Out.IndexInBank), engine->getExhaustSystemCount(), [engine](int32 k) { return engine->getExhaustSystem(k); });
+		Out.SoundAttenuation = head->getSoundAttenuation(Out.IndexInBank);
+		Out.HeaderPrimaryLength = head->getHeaderPrimaryLength(Out.IndexInBank);
+		if (Out.Crankshaft == INDEX_NONE || Out.Intake == INDEX_NONE || Out.ExhaustSystem == INDEX_NONE)
+		{
+			return;
+		}
+	}
+
+	const IgnitionModule* ignition = engine->getIgnitionModule();
+	Ignition.Crankshaft = FindCrankshaft(ignition->getCrankshaft());
+	Ignition.TimingCurve = AddFunction(ignition->getTimingCurve());
+	Ignition.RevLimit = ignition->getRevLimit();
+	Ignition.LimiterDuration = ignition->getLimiterDuration();
+	for (int i = 0; i < engine->getCylinderCount(); ++i)
+	{
+		Ignition.FiringAngles.Add(ignition->getFiringAngle(i));
+	}
+
+	// Every chamber gets the same parameters from the engine node, the starting gas is what the compiler left in them
+	if (engine->getCylinderCount() > 0)
+	{
+		const CombustionChamber* chamber = engine->getChamber(0);
+		Chamber.MeanPistonSpeedToTurbulence = AddFunction(chamber->getMeanPistonSpeedToTurbulence());
+		Chamber.StartingPressure = chamber->m_system.pressure();
+		Chamber.StartingTemperature = chamber->m_system.temperature();
+		Chamber.CrankcasePressure = chamber->getCrankcasePressure();
+	}
+
+	bValid = Ignition.Crankshaft != INDEX_NONE;
+}
+
+bool FEngineGraphDescription::Build(FEngineGraph& OutGraph) const
+{
+	if (!bValid)
+	{
+		return false;
+	}
+
+	TSharedRef<FEngineGraphObjects, ESPMode::ThreadSafe> Objects = MakeShared<FEngineGraphObjects, ESPMode::ThreadSafe>();
+
+	for (const FFunction& Table : Functions)
+	{
+		Function* function = new Function;
+		function->initialize(Table.X.Num(), Table.FilterRadius);
+		function->setInputScale(Table.InputScale);
+		function->setOutputScale(Table.OutputScale);
+		for (int32 i = 0; i < Table.X.Num(); ++i)
+		{
+			function->addSample(Table.X[i], Table.Y[i]);
+		}
+		Objects->Functions.Add(function);
+	}
+	auto GetFunction = [&Objects](int32 Index) { return Index != INDEX_NONE ? Objects->Functions[Index] : nullptr; };
+
+	if (Throttle.bGovernor)
+	{
+		Governor::Parameters params;
+		params.MinSpeed = Throttle.MinSpeed;
+		params.MaxSpeed = Throttle.MaxSpeed;
+		params.MinVelocity = Throttle.MinVelocity;
+		params.MaxVelocity = Throttle.MaxVelocity;
+		params.k_s = Throttle.K_s;
+		params.k_d = Throttle.K_d;
+		params.gamma = Throttle.Gamma;
+		Governor* governor = new Governor;
+		governor->initialize(params);
+		Objects->ThrottleLinkage = governor;
+	}
+	else
+	{
+		DirectThrottleLinkage::Parameters params;
+		params.Gamma = Throttle.Gamma;
+		DirectThrottleLinkage* linkage = new DirectThrottleLinkage;
+		linkage->initialize(params);
+		Objects->ThrottleLinkage = linkage;
+	}
+
+	Engine::Parameters engineParams;
+	engineParams.CylinderBanks = Banks.Num();
+	engineParams.CylinderCount = Cylinders.Num();
+	engineParams.CrankshaftCount = Crankshafts.Num();
+	engineParams.ExhaustSystemCount = ExhaustSystems.Num();
+	engineParams.IntakeCount = Intakes.Num();
+	engineParams.Name = TCHAR_TO_UTF8(*Name);
+	engineParams.StarterTorque = StarterTorque;
+	engineParams.StarterSpeed = StarterSpeed;
+	engineParams.Redline = Redline;
+	engineParams.DynoMinSpeed = DynoMinSpeed;
+	engineParams.DynoMaxSpeed = DynoMaxSpeed;
+	engineParams.DynoHoldStep = DynoHoldStep;
+	engineParams.throttle = Objects->ThrottleLinkage;
+	engineParams.initialSimulationFrequency = SimulationFrequency;
+	engineParams.initialHighFrequencyGain = HighFrequencyGain;
+	engineParams.initialNoise = Noise;
+	engineParams.initialJitter = Jitter;
+
+	Engine* engine = new Engine;
+	engine->initialize(engineParams);
+
+	for (int32 i = 0; i < Crankshafts.Num(); ++i)
+	{
+		const FCrankshaft& In = Crankshafts[i];
+
+		Crankshaft::Parameters params;
+		params.Mass = In.Mass;
+		params.FlywheelMass = In.FlywheelMass;
+		params.MomentOfInertia = In.MomentOfInertia;
+		params.CrankThrow = In.CrankThrow;
+		params.Pos_x = In.PositionX;
+		params.Pos_y = In.PositionY;
+		params.TDC = In.TDC;
+		params.FrictionTorque = In.FrictionTorque;
+		params.RodJournals = In.RodJournalAngles.Num();
+
+		Crankshaft* crankshaft = engine->getCrankshaft(i);
+		crankshaft->initialize(params);
+		for (int32 j = 0; j < In.RodJournalAngles.Num(); ++j)
+		{
+			crankshaft->setRodJournalAngle(j, In.RodJournalAngles[j]);
+		}
+	}
+
+	for (int32 i = 0; i < Banks.Num(); ++i)
+	{
+		const FCylinderBank& In = Banks[i];
+
+		CylinderBank::Parameters params;
+		params.crankshaft = engine->getCrankshaft(In.Crankshaft);
+		params.Angle = In.Angle;
+		params.Bore = In.Bore;
+		params.DeckHeight = In.DeckHeight;
+		params.DisplayDepth = In.DisplayDepth;
+		params.PositionX = In.PositionX;
+		params.PositionY = In.PositionY;
+		params.CylinderCount = In.CylinderCount;
+		params.Index = i;
+		engine->getCylinderBank(i)->initialize(params);
+	}
+
+	for (int32 i = 0; i < Intakes.Num(); ++i)
+	{
+		const FIntake& In = Intakes[i];
+
+		Intake::Parameters params;
+		params.Volume = In.PlenumVolume;
+		params.CrossSectionArea = In.PlenumCrossSectionArea;
+		params.InputFlowK = In.IntakeFlowRate;
+		params.IdleFlowK = In.IdleFlowRate;
+		params.RunnerFlowRate = In.RunnerFlowRate;
+		params.MolecularAfrRatio = In.MolecularAfr;
+		params.IdleThrottlePlatePosition = In.IdleThrottlePlatePosition;
+		params.ThrottleGamma = In.ThrottleGamma;
+		params.RunnerLength = In.RunnerLength;
+		params.VelocityDecay = In.VelocityDecay;
+		engine->getIntake(i)->initialize(params);
+	}
+
+	for (int32 i = 0; i < ExhaustSystems.Num(); ++i)
+	{
+		const FExhaustSystem& In = ExhaustSystems[i];
+
+		ImpulseResponse* response = new ImpulseResponse;
+		response->initialize(TCHAR_TO_UTF8(*In.ImpulseResponse), In.ImpulseResponseVolume);
+		Objects->ImpulseResponses.Add(response);
+
+		ExhaustSystem::Parameters params;
+		params.Length = In.Length;
+		params.CollectorCrossSectionArea = In.CollectorCrossSectionArea;
+		params.OutletFlowRate = In.OutletFlowRate;
+		params.PrimaryTubeLength = In.PrimaryTubeLength;
+		params.PrimaryFlowRate = In.PrimaryFlowRate;
+		params.AudioVolume = In.AudioVolume;
+		params.VelocityDecay = In.VelocityDecay;
+		params.ImpulseResponse = response;
+		engine->getExhaustSystem(i)->initialize(params);
+	}
+
+	// Pistons and rods refer to each other, and slave rods to their master, so every part is in place before any initializes
+	for (int32 i = 0; i < Cylinders.Num(); ++i)
+	{
+		const FCylinder& In = Cylinders[i];
+
+		Piston::Parameters pistonParams;
+		pistonParams.Bank = engine->getCylinderBank(In.Bank);
+		pistonParams.Rod = engine->getConnectingRod(i);
+		pistonParams.CylinderIndex = In.IndexInBank;
+		pistonParams.BlowbyFlowCoefficient = In.BlowbyFlowCoefficient;
+		pistonParams.CompressionHeight = In.CompressionHeight;
+		pistonParams.WristPinPosition = In.WristPinPosition;
+		pistonParams.Displacement = In.Displacement;
+		pistonParams.mass = In.PistonMass;
+		engine->getPiston(i)->initialize(pistonParams);
+
+		ConnectingRod::Parameters rodParams;
+		rodParams.Mass = In.RodMass;
+		rodParams.MomentOfInertia = In.RodMomentOfInertia;
+		rodParams.CenterOfMass = In.RodCenterOfMass;
+		rodParams.Length = In.RodLength;
+		rodParams.SlaveThrow = In.SlaveThrow;
+		rodParams.RodJournals = In.RodJournalAngles.Num();
+		rodParams.Crankshaft = engine->getCrankshaft(In.Crankshaft);
+		rodParams.Journal = In.Journal;
+		rodParams.Piston = engine->getPiston(i);
+		rodParams.Master = In.MasterRod != INDEX_NONE ? engine->getConnectingRod(In.MasterRod) : nullptr;
+
+		ConnectingRod* rod = engine->getConnectingRod(i);
+		rod->initialize(rodParams);
+		for (int32 j = 0; j < In.RodJournalAngles.Num(); ++j)
+		{
+			rod->setRodJournalAngle(j, In.RodJournalAngles[j]);
+		}
+	}
+
+	for (const FCamshaft& In : Camshafts)
+	{
+		Camshaft::Parameters params;
+		params.Lobes = In.LobeCenterlines.Num();
+		params.Crankshaft = engine->getCrankshaft(In.Crankshaft);
+		params.LobeProfile = GetFunction(In.LobeProfile);
+		params.Advance = In.Advance;
+		params.BaseRadius = In.BaseRadius;
+
+		Camshaft* camshaft = new Camshaft;
+		camshaft->initialize(params);
+		for (int32 j = 0; j < In.LobeCenterlines.Num(); ++j)
+		{
+			camshaft->setLobeCenterline(j, In.LobeCenterlines[j]);
+		}
+		Objects->Camshafts.Add(camshaft);
+	}
+
+	for (int32 i = 0; i < Heads.Num(); ++i)
+	{
+		const FCylinderHead& In = Heads[i];
+
+		StandardValvetrain::Parameters valvetrainParams;
+		valvetrainParams.IntakeCamshaft = Objects->Camshafts[In.IntakeCamshaft];
+		valvetrainParams.ExhaustCamshaft = Objects->Camshafts[In.ExhaustCamshaft];
+		StandardValvetrain* valvetrain = new StandardValvetrain;
+		valvetrain->initialize(valvetrainParams);
+		Objects->Valvetrains.Add(valvetrain);
+
+		CylinderHead::Parameters params;
+		params.Bank = engine->getCylinderBank(i);
+		params.Valvetrain = valvetrain;
+		params.IntakePortFlow = GetFunction(In.IntakePortFlow);
+		params.ExhaustPortFlow = GetFunction(In.ExhaustPortFlow);
+		params.CombustionChamberVolume = In.CombustionChamberVolume;
+		params.IntakeRunnerVolume = In.IntakeRunnerVolume;
+		params.IntakeRunnerCrossSectionArea = In.IntakeRunnerCrossSectionArea;
+		params.ExhaustRunnerVolume = In.ExhaustRunnerVolume;
+		params.ExhaustRunnerCrossSectionArea = In.ExhaustRunnerCrossSectionArea;
+		params.FlipDisplay = In.bFlipDisplay;
+		engine->getHead(i)->initialize(params);
+	}
+
+	for (const FCylinder& In : Cylinders)
+	{
+		CylinderHead* head = engine->getHead(In.Bank);
+		head->setIntake(In.IndexInBank, engine->getIntake(In.Intake));
+		head->setExhaustSystem(In.IndexInBank, engine->getExhaustSystem(In.ExhaustSystem));
+		head->setSoundAttenuation(In.IndexInBank, In.SoundAttenuation);
+		head->setHeaderPrimaryLength(In.IndexInBank, In.HeaderPrimaryLength);
+	}
+
+	::Fuel::Parameters fuelParams;
+	fuelParams.Name = TCHAR_TO_UTF8(*Fuel.Name);
+	fuelParams.MolecularMass = Fuel.MolecularMass;
+	fuelParams.EnergyDensity = Fuel.EnergyDensity;
+	fuelParams.Density = Fuel.Density;
+	fuelParams.MolecularAfr = Fuel.MolecularAfr;
+	fuelParams.TurbulenceToFlameSpeedRatio = GetFunction(Fuel.TurbulenceToFlameSpeedRatio);
+	fuelParams.MaxBurningEfficiency = Fuel.MaxBurningEfficiency;
+	fuelParams.BurningEfficiencyRandomness = Fuel.BurningEfficiencyRandomness;
+	fuelParams.LowEfficiencyAttenuation = Fuel.LowEfficiencyAttenuation;
+	fuelParams.MaxTurbulenceEffect = Fuel.MaxTurbulenceEffect;
+	fuelParams.MaxDilutionEffect = Fuel.MaxDilutionEffect;
+	engine->getFuel()->initialize(fuelParams);
+
+	IgnitionModule::Parameters ignitionParams;
+	ignitionParams.CylinderCount = Cylinders.Num();
+	ignitionParams.Crankshaft = engine->getCrankshaft(Ignition.Crankshaft);
+	ignitionParams.TimingCurve = GetFunction(Ignition.TimingCurve);
+	ignitionParams.RevLimit = Ignition.RevLimit;
+	ignitionParams.LimiterDuration = Ignition.LimiterDuration;
+	IgnitionModule* ignition = engine->getIgnitionModule();
+	ignition->initialize(ignitionParams);
+	for (int32 i = 0; i < Ignition.FiringAngles.Num(); ++i)
+	{
+		ignition->setFiringOrder(i, Ignition.FiringAngles[i]);
+	}
+
+	for (int32 i = 0; i < Cylinders.Num(); ++i)
+	{
+		CombustionChamber::Parameters params;
+		params.Piston = engine->getPiston(i);
+		params.Head = engine->getHead(Cylinders[i].Bank);
+		params.Fuel = engine->getFuel();
+		params.StartingPressure = Chamber.StartingPressure;
+		params.StartingTemperature = Chamber.StartingTemperature;
+		params.CrankcasePressure = Chamber.CrankcasePressure;
+		params.MeanPistonSpeedToTurbulence = GetFunction(Chamber.MeanPistonSpeedToTurbulence);
+		engine->getChamber(i)->initialize(params);
+	}
+
+	engine->calculateDisplacement();
+
+	OutGraph.engine = engine;
+	OutGraph.Objects = Objects;
+
+	if (bHasVehicle)
+	{
+		::Vehicle::Parameters params;
+		params.mass = Vehicle.Mass;
+		params.diffRatio = Vehicle.DiffRatio;
+		params.tireRadius = Vehicle.TireRadius;
+		params.dragCoefficient = Vehicle.DragCoefficient;
+		params.crossSectionArea = Vehicle.CrossSectionArea;
+		params.rollingResistance = Vehicle.RollingResistance;
+		OutGraph.vehicle = new ::Vehicle;
+		OutGraph.vehicle->initialize(params);
+	}
+
+	if (bHasTransmission)
+	{
+		::Transmission::Parameters params;
+		params.GearCount = Transmission.GearRatios.Num();
+		params.GearRatios = Transmission.GearRatios.GetData();
+		params.MaxClutchTorque = Transmission.MaxClutchTorque;
+		OutGraph.transmission = new ::Transmission;
+		OutGraph.transmission->initialize(params);
+	}
+
+	return true;
+}
+
+static FArchive& operator<<(FArchive& Ar, FEngineGraphDescription::FFunction& Function)
+{
+	Ar << Function.FilterRadius << Function.InputScale << Function.OutputScale;
+	Ar << Function.X << Function.Y;
+	return Ar;
+}
+
+static FArchive& operator<<(FArchive& Ar, FEngineGraphDescription::FCrankshaft& Crankshaft)
+{
+	Ar << Crankshaft.Mass << Crankshaft.FlywheelMass << Crankshaft.MomentOfInertia << Crankshaft.CrankThrow;
+	Ar << Crankshaft.PositionX << Crankshaft.PositionY << Crankshaft.TDC << Crankshaft.FrictionTorque;
+	Ar << Crankshaft.RodJournalAngles;
+	return Ar;
+}
+
+static FArchive& operator<<(FArchive& Ar, FEngineGraphDescription::FCylinderBank& Bank)
+{
+	Ar << Bank.Crankshaft << Bank.Angle << Bank.Bore << Bank.DeckHeight << Bank.DisplayDepth;
+	Ar << Bank.PositionX << Bank.PositionY << Bank.CylinderCount;
+	return Ar;
+}
+
+static FArchive& operator<<(FArchive& Ar, FEngineGraphDescription::FCylinder& Cylinder)
+{
+	Ar << Cylinder.Bank << Cylinder.IndexInBank;
+	Ar << Cylinder.PistonMass << Cylinder.BlowbyFlowCoefficient << Cylinder.CompressionHeight << Cylinder.WristPinPosition << Cylinder.Displacement;
+	Ar << Cylinder.RodMass << Cylinder.RodMomentOfInertia << Cylinder.RodCenterOfMass << Cylinder.RodLength << Cylinder.SlaveThrow;
+	Ar << Cylinder.Crankshaft << Cylinder.Journal << Cylinder.MasterRod << Cylinder.RodJournalAngles;
+	Ar << Cylinder.Intake << Cylinder.ExhaustSystem << Cylinder.SoundAttenuation << Cylinder.HeaderPrimaryLength;
+	return Ar;
+}
+
+static FArchive& operator<<(FArchive& Ar, FEngineGraphDescription::FCamshaft& Camshaft)
+{
+	Ar << Camshaft.Crankshaft << Camshaft.LobeProfile << Camshaft.Advance << Camshaft.BaseRadius << Camshaft.LobeCenterlines;
+	return Ar;
+}
+
+static FArchive& operator<<(FArchive& Ar, FEngineGraphDescription::FCylinderHead& Head)
+{
+	Ar << Head.IntakeCamshaft << Head.ExhaustCamshaft << Head.IntakePortFlow << Head.ExhaustPortFlow;
+	Ar << Head.CombustionChamberVolume << Head.IntakeRunnerVolume << Head.IntakeRunnerCrossSectionArea;
+	Ar << Head.ExhaustRunnerVolume << Head.ExhaustRunnerCrossSectionArea << Head.bFlipDisplay;
+	return Ar;
+}
+
+static FArchive& operator<<(FArchive& Ar, FEngineGraphDescription::FIntake& Intake)
+{
+	Ar << Intake.PlenumVolume << Intake.PlenumCrossSectionArea << Intake.IntakeFlowRate << Intake.IdleFlowRate << Intake.RunnerFlowRate;
+	Ar << Intake.MolecularAfr << Intake.IdleThrottlePlatePosition << Intake.ThrottleGamma << Intake.RunnerLength << Intake.VelocityDecay;
+	return Ar;
+}
+
+static FArchive& operator<<(FArchive& Ar, FEngineGraphDescription::FExhaustSystem& Exhaust)
+{
+	Ar << Exhaust.Length << Exhaust.CollectorCrossSectionArea << Exhaust.OutletFlowRate << Exhaust.PrimaryTubeLength;
+	Ar << Exhaust.PrimaryFlowRate << Exhaust.AudioVolume << Exhaust.VelocityDecay;
+	Ar << Exhaust.ImpulseResponse << Exhaust.ImpulseResponseVolume;
+	return Ar;
+}
+
+FArchive& operator<<(FArchive& Ar, FEngineGraphDescription& Description)
+{
+	Ar << Description.bValid;
+	if (!Description.bValid)
+	{
+		return Ar;
+	}
+
+	Ar << Description.Name;
+	Ar << Description.StarterTorque << Description.StarterSpeed << Description.Redline;
+	Ar << Description.DynoMinSpeed << Description.DynoMaxSpeed << Description.DynoHoldStep;
+	Ar << Description.SimulationFrequency << Description.HighFrequencyGain << Description.Noise << Description.Jitter;
+
+	FEngineGraphDescription::FThrottle& Throttle = Description.Throttle;
+	Ar << Throttle.bGovernor << Throttle.Gamma;
+	Ar << Throttle.MinSpeed << Throttle.MaxSpeed << Throttle.MinVelocity << Throttle.MaxVelocity << Throttle.K_s << Throttle.K_d;
+
+	FEngineGraphDescription::FFuel& Fuel = Description.Fuel;
+	Ar << Fuel.Name << Fuel.MolecularMass << Fuel.EnergyDensity << Fuel.Density << Fuel.MolecularAfr << Fuel.TurbulenceToFlameSpeedRatio;
+	Ar << Fuel.MaxBurningEfficiency << Fuel.BurningEfficiencyRandomness << Fuel.LowEfficiencyAttenuation;
+	Ar << Fuel.MaxTurbulenceEffect << Fuel.MaxDilutionEffect;
+
+	Ar << Description.Functions;
+	Ar << Description.Crankshafts;
+	Ar << Description.Banks;
+	Ar << Description.Cylinders;
+	Ar << Description.Camshafts;
+	Ar << Description.Heads;
+	Ar << Description.Intakes;
+	Ar << Description.ExhaustSystems;
+
+	FEngineGraphDescription::FIgnitionModule& Ignition = Description.Ignition;
+	Ar << Ignition.Crankshaft << Ignition.TimingCurve << Ignition.RevLimit << Ignition.LimiterDuration << Ignition.FiringAngles;
+
+	FEngineGraphDescription::FCombustionChamber& Chamber = Description.Chamber;
+	Ar << Chamber.MeanPistonSpeedToTurbulence << Chamber.StartingPressure << Chamber.StartingTemperature << Chamber.CrankcasePressure;
+
+	FEngineGraphDescription::FVehicle& Vehicle = Description.Vehicle;
+	Ar << Description.bHasVehicle;
+	Ar << Vehicle.Mass << Vehicle.DiffRatio << Vehicle.TireRadius << Vehicle.DragCoefficient << Vehicle.CrossSectionArea << Vehicle.RollingResistance;
+
+	Ar << Description.bHasTransmission;
+	Ar << Description.Transmission.GearRatios << Description.Transmission.MaxClutchTorque;
+
+	return Ar;
+}
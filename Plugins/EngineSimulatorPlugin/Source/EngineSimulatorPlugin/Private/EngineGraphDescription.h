@@ -0,0 +1,231 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FEngineGraph;
+
+/**
+ * Every initialize(Parameters) block of a compiled engine graph, as plain data, so the graph can be built again
+ * without Piranha. Parts refer to each other by index and the sampled functions are shared through Functions,
+ * the way the script shares them. Units are engine-sim's, as the compiler left them.
+ */
+struct FEngineGraphDescription
+{
+	struct FFunction
+	{
+		double FilterRadius = 0.0;
+		double InputScale = 1.0;
+		double OutputScale = 1.0;
+		TArray<double> X;
+		TArray<double> Y;
+	};
+
+	struct FThrottle
+	{
+		bool bGovernor = false;
+		double Gamma = 1.0;
+
+		// Governor only
+		double MinSpeed = 0.0;
+		double MaxSpeed = 0.0;
+		double MinVelocity = 0.0;
+		double MaxVelocity = 0.0;
+		double K_s = 0.0;
+		double K_d = 0.0;
+	};
+
+	struct FCrankshaft
+	{
+		double Mass = 0.0;
+		double FlywheelMass = 0.0;
+		double MomentOfInertia = 0.0;
+		double CrankThrow = 0.0;
+		double PositionX = 0.0;
+		double PositionY = 0.0;
+		double TDC = 0.0;
+		double FrictionTorque = 0.0;
+		TArray<double> RodJournalAngles;
+	};
+
+	struct FCylinderBank
+	{
+		int32 Crankshaft = 0;
+		double Angle = 0.0;
+		double Bore = 0.0;
+		double DeckHeight = 0.0;
+		double DisplayDepth = 0.0;
+		double PositionX = 0.0;
+		double PositionY = 0.0;
+		int32 CylinderCount = 0;
+	};
+
+	// Piston, connecting rod and what the cylinder head connects the cylinder to
+	struct FCylinder
+	{
+		int32 Bank = 0;
+		int32 IndexInBank = 0;
+
+		double PistonMass = 0.0;
+		double BlowbyFlowCoefficient = 0.0;
+		double CompressionHeight = 0.0;
+		double WristPinPosition = 0.0;
+		double Displacement = 0.0;
+
+		double RodMass = 0.0;
+		double RodMomentOfInertia = 0.0;
+		double RodCenterOfMass = 0.0;
+		double RodLength = 0.0;
+		double SlaveThrow = 0.0;
+		int32 Crankshaft = 0;
+		int32 Journal = 0;
+		int32 MasterRod = INDEX_NONE; // Cylinder whose rod this one rides on, radials only
+		TArray<double> RodJournalAngles;
+
+		int32 Intake = 0;
+		int32 ExhaustSystem = 0;
+		double SoundAttenuation = 1.0;
+		double HeaderPrimaryLength = 0.0;
+	};
+
+	struct FCamshaft
+	{
+		int32 Crankshaft = 0;
+		int32 LobeProfile = INDEX_NONE;
+		double Advance = 0.0;
+		double BaseRadius = 0.0;
+		TArray<double> LobeCenterlines;
+	};
+
+	// One per cylinder bank, with a standard valvetrain
+	struct FCylinderHead
+	{
+		int32 IntakeCamshaft = 0;
+		int32 ExhaustCamshaft = 0;
+		int32 IntakePortFlow = INDEX_NONE;
+		int32 ExhaustPortFlow = INDEX_NONE;
+		double CombustionChamberVolume = 0.0;
+		double IntakeRunnerVolume = 0.0;
+		double IntakeRunnerCrossSectionArea = 0.0;
+		double ExhaustRunnerVolume = 0.0;
+		double ExhaustRunnerCrossSectionArea = 0.0;
+		bool bFlipDisplay = false;
+	};
+
+	struct FIntake
+	{
+		double PlenumVolume = 0.0;
+		double PlenumCrossSectionArea = 0.0;
+		double IntakeFlowRate = 0.0;
+		double IdleFlowRate = 0.0;
+		double RunnerFlowRate = 0.0;
+		double MolecularAfr = 0.0;
+		double IdleThrottlePlatePosition = 0.0;
+		double ThrottleGamma = 0.0;
+		double RunnerLength = 0.0;
+		double VelocityDecay = 0.0;
+	};
+
+	struct FExhaustSystem
+	{
+		double Length = 0.0;
+		double CollectorCrossSectionArea = 0.0;
+		double OutletFlowRate = 0.0;
+		double PrimaryTubeLength = 0.0;
+		double PrimaryFlowRate = 0.0;
+		double AudioVolume = 0.0;
+		double VelocityDecay = 0.0;
+		FString ImpulseResponse;
+		double ImpulseResponseVolume = 0.0;
+	};
+
+	struct FFuel
+	{
+		FString Name;
+		double MolecularMass = 0.0;
+		double EnergyDensity = 0.0;
+		double Density = 0.0;
+		double MolecularAfr = 0.0;
+		int32 TurbulenceToFlameSpeedRatio = INDEX_NONE;
+		double MaxBurningEfficiency = 0.0;
+		double BurningEfficiencyRandomness = 0.0;
+		double LowEfficiencyAttenuation = 0.0;
+		double MaxTurbulenceEffect = 0.0;
+		double MaxDilutionEffect = 0.0;
+	};
+
+	struct FIgnitionModule
+	{
+		int32 Crankshaft = 0;
+		int32 TimingCurve = INDEX_NONE;
+		double RevLimit = 0.0;
+		double LimiterDuration = 0.0;
+		TArray<double> FiringAngles; // Per cylinder
+	};
+
+	struct FCombustionChamber
+	{
+		int32 MeanPistonSpeedToTurbulence = INDEX_NONE;
+		double StartingPressure = 0.0;
+		double StartingTemperature = 0.0;
+		double CrankcasePressure = 0.0;
+	};
+
+	struct FVehicle
+	{
+		double Mass = 0.0;
+		double DiffRatio = 0.0;
+		double TireRadius = 0.0;
+		double DragCoefficient = 0.0;
+		double CrossSectionArea = 0.0;
+		double RollingResistance = 0.0;
+	};
+
+	struct FTransmission
+	{
+		TArray<double> GearRatios;
+		double MaxClutchTorque = 0.0;
+	};
+
+	// False when the compiled graph has parts this can't describe, e.g. a VTEC valvetrain. Those engines keep compiling.
+	bool bValid = false;
+
+	FString Name;
+	double StarterTorque = 0.0;
+	double StarterSpeed = 0.0;
+	double Redline = 0.0;
+	double DynoMinSpeed = 0.0;
+	double DynoMaxSpeed = 0.0;
+	double DynoHoldStep = 0.0;
+	double SimulationFrequency = 0.0;
+	double HighFrequencyGain = 0.0;
+	double Noise = 0.0;
+	double Jitter = 0.0;
+
+	FThrottle Throttle;
+	FFuel Fuel;
+	TArray<FFunction> Functions;
+	TArray<FCrankshaft> Crankshafts;
+	TArray<FCylinderBank> Banks;
+	TArray<FCylinder> Cylinders;
+	TArray<FCamshaft> Camshafts;
+	TArray<FCylinderHead> Heads;
+	TArray<FIntake> Intakes;
+	TArray<FExhaustSystem> ExhaustSystems;
+	FIgnitionModule Ignition;
+	FCombustionChamber Chamber;
+
+	bool bHasVehicle = false;
+	FVehicle Vehicle;
+	bool bHasTransmission = false;
+	FTransmission Transmission;
+
+	// Reads the parameters back out of a graph straight from the compiler. Leaves bValid false if it can't.
+	void Capture(const FEngineGraph& Graph);
+
+	// Builds a new graph the compiler would have produced. Only valid descriptions build.
+	bool Build(FEngineGraph& OutGraph) const;
+
+	friend FArchive& operator<<(FArchive& Ar, FEngineGraphDescription& Description);
+};
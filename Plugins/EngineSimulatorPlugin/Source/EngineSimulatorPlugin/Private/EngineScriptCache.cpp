@@ -0,0 +1,227 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EngineScriptCache.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+// Bump this whenever FEngineScriptDescription changes so stale files get ignored
+static const int32 EngineScriptCacheVersion = 2;
+
+FArchive& operator<<(FArchive& Ar, FEngineScriptDescription::FImpulseResponse& ImpulseResponse)
+{
+	Ar << ImpulseResponse.Filename;
+	Ar << ImpulseResponse.Volume;
+	return Ar;
+}
+
+FArchive& operator<<(FArchive& Ar, FEngineScriptDescription& Description)
+{
+	Ar << Description.bCompiled;
+	Ar << Description.EngineName;
+	Ar << Description.Redline;
+	Ar << Description.SimulationFrequency;
+	Ar << Description.GearRatios;
+	Ar << Description.MaxClutchTorque;
+	Ar << Description.ImpulseResponses;
+	Ar << Description.Graph;
+	Ar << Description.Closure;
+	return Ar;
+}
+
+FEngineScriptCache& FEngineScriptCache::Get()
+{
+	static FEngineScriptCache Cache;
+	return Cache;
+}
+
+FString FEngineScriptCache::GetCacheDirectory()
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("EngineSimulator"), TEXT("ScriptCache"));
+}
+
+bool FEngineScriptCache::HashFile(const FString& Path, FSHAHash& OutHash)
+{
+	const FDateTime TimeStamp = IFileManager::Get().GetTimeStamp(*Path);
+	if (TimeStamp == FDateTime::MinValue())
+	{
+		return false;
+	}
+
+	if (const FFileHash* Existing = FileHashes.Find(Path))
+	{
+		if (Existing->TimeStamp == TimeStamp)
+		{
+			OutHash = Existing->Hash;
+			return true;
+		}
+	}
+
+	FString Source;
+	if (!FFileHelper::LoadFileToString(Source, *Path))
+	{
+		return false;
+	}
+
+	FFileHash& Entry = FileHashes.FindOrAdd(Path);
+	Entry.TimeStamp = TimeStamp;
+	Entry.Imports.Reset();
+
+	const FTCHARToUTF8 SourceUTF8(*Source);
+	FSHA1::HashBuffer(SourceUTF8.Get(), SourceUTF8.Length(), Entry.Hash.Hash);
+
+	// Piranha imports look like: [public|private] import "path/to/file.mr"
+	TArray<FString> Lines;
+	Source.ParseIntoArrayLines(Lines);
+	for (const FString& Line : Lines)
+	{
+		FString Trimmed = Line.TrimStart();
+		Trimmed.RemoveFromStart(TEXT("public "));
+		Trimmed.RemoveFromStart(TEXT("private "));
+		if (!Trimmed.StartsWith(TEXT("import ")))
+		{
+			continue;
+		}
+
+		int32 Start, End;
+		if (Trimmed.FindChar(TEXT('"'), Start) && Trimmed.FindLastChar(TEXT('"'), End) && End > Start)
+		{
+			Entry.Imports.Add(Trimmed.Mid(Start + 1, End - Start - 1));
+		}
+	}
+
+	OutHash = Entry.Hash;
+	return true;
+}
+
+FString FEngineScriptCache::ComputeKey(const FString& ScriptPath, const TArray<FString>& SearchPaths, TArray<FString>* OutClosure)
+{
+	FScopeLock Lock(&Mutex);
+
+	TArray<FString> Closure;
+	TArray<FString> Pending;
+	Pending.Add(FPaths::ConvertRelativePathToFull(ScriptPath));
+
+	while (Pending.Num() > 0)
+	{
+		FString Path = Pending.Pop(false);
+		FPaths::CollapseRelativeDirectories(Path);
+		if (Closure.Contains(Path))
+		{
+			continue;
+		}
+
+		FSHAHash Hash;
+		if (!HashFile(Path, Hash))
+		{
+			if (Closure.Num() == 0)
+			{
+				return FString();
+			}
+
+			// Let the compiler report the missing import, it just can't be part of the key
+			continue;
+		}
+		Closure.Add(Path);
+
+		for (const FString& Import : FileHashes[Path].Imports)
+		{
+			FString Resolved = FPaths::Combine(FPaths::GetPath(Path), Import);
+			for (int32 i = 0; i < SearchPaths.Num() && !FPaths::FileExists(Resolved); ++i)
+			{
+				Resolved = FPaths::Combine(SearchPaths[i], Import);
+			}
+			Pending.Add(Resolved);
+		}
+	}
+
+	// The main script stays first, the rest is sorted so the key doesn't depend on import order
+	const FString MainScript = Closure[0];
+	Closure.RemoveAt(0);
+	Closure.Sort();
+	Closure.Insert(MainScript, 0);
+
+	FSHA1 Sha;
+	Sha.Update(reinterpret_cast<const uint8*>(&EngineScriptCacheVersion), sizeof(EngineScriptCacheVersion));
+	for (const FString& Path : Closure)
+	{
+		const FSHAHash& Hash = FileHashes[Path].Hash;
+		Sha.Update(Hash.Hash, sizeof(Hash.Hash));
+	}
+	Sha.Final();
+
+	FSHAHash Key;
+	Sha.GetHash(Key.Hash);
+
+	if (OutClosure)
+	{
+		*OutClosure = MoveTemp(Closure);
+	}
+
+	return Key.ToString();
+}
+
+bool FEngineScriptCache::Find(const FString& Key, FEngineScriptDescription& OutDescription)
+{
+	if (Key.IsEmpty())
+	{
+		return false;
+	}
+
+	FScopeLock Lock(&Mutex);
+
+	if (const FEngineScriptDescription* Description = Entries.Find(Key))
+	{
+		OutDescription = *Description;
+		return true;
+	}
+
+	TArray<uint8> Bytes;
+	if (!FFileHelper::LoadFileToArray(Bytes, *FPaths::Combine(GetCacheDirectory(), Key + TEXT(".bin")), FILEREAD_Silent))
+	{
+		return false;
+	}
+
+	FMemoryReader Reader(Bytes);
+	int32 Version = 0;
+	Reader << Version;
+	if (Version != EngineScriptCacheVersion)
+	{
+		return false;
+	}
+
+	FEngineScriptDescription Description;
+	Reader << Description;
+	if (Reader.IsError())
+	{
+		return false;
+	}
+
+	OutDescription = Entries.Add(Key, MoveTemp(Description));
+	return true;
+}
+
+void FEngineScriptCache::Store(const FString& Key, const FEngineScriptDescription& Description)
+{
+	if (Key.IsEmpty())
+	{
+		return;
+	}
+
+	FScopeLock Lock(&Mutex);
+
+	FEngineScriptDescription& Entry = Entries.Add(Key, Description);
+
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes);
+	int32 Version = EngineScriptCacheVersion;
+	Writer << Version;
+	Writer << Entry;
+
+	if (!FFileHelper::SaveArrayToFile(Bytes, *FPaths::Combine(GetCacheDirectory(), Key + TEXT(".bin"))))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Failed to write engine script cache entry %s"), *Key);
+	}
+}
@@ -0,0 +1,70 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/SecureHash.h"
+#include "EngineGraphDescription.h"
+
+/**
+ * Compact description of what an engine script produced when it was compiled.
+ * Everything in here can be read back without touching Piranha.
+ */
+struct FEngineScriptDescription
+{
+	struct FImpulseResponse
+	{
+		FString Filename;
+		float Volume = 0.f;
+	};
+
+	bool bCompiled = false;
+
+	FString EngineName;
+	float Redline = 0.f; // RPM
+	float SimulationFrequency = 0.f;
+
+	TArray<double> GearRatios;
+	double MaxClutchTorque = 0.0;
+
+	TArray<FImpulseResponse> ImpulseResponses;
+
+	// Enough to build the engine, vehicle and transmission again without the compiler
+	FEngineGraphDescription Graph;
+
+	// Every script file in the import closure, used to work out which definitions a changed file affects
+	TArray<FString> Closure;
+
+	friend FArchive& operator<<(FArchive& Ar, FEngineScriptDescription& Description);
+};
+
+/**
+ * Content-hashed cache of engine script compile results, keyed on the full import closure of the script.
+ * Entries are kept in memory and persisted under Saved/EngineSimulator/ScriptCache so they survive restarts.
+ */
+class FEngineScriptCache
+{
+public:
+	static FEngineScriptCache& Get();
+
+	// Hashes ScriptPath and everything it imports. Returns an empty string if the script doesn't exist.
+	FString ComputeKey(const FString& ScriptPath, const TArray<FString>& SearchPaths, TArray<FString>* OutClosure = nullptr);
+
+	bool Find(const FString& Key, FEngineScriptDescription& OutDescription);
+	void Store(const FString& Key, const FEngineScriptDescription& Description);
+
+private:
+	bool HashFile(const FString& Path, FSHAHash& OutHash);
+	static FString GetCacheDirectory();
+
+	FCriticalSection Mutex;
+	TMap<FString, FEngineScriptDescription> Entries;
+
+	struct FFileHash
+	{
+		FDateTime TimeStamp;
+		FSHAHash Hash;
+		TArray<FString> Imports;
+	};
+	TMap<FString, FFileHash> FileHashes;
+};
@@ -0,0 +1,119 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EngineScriptHotReload.h"
+#include "EngineDefinitionRegistry.h"
+#include "EngineSimulatorPlugin.h"
+#include "EngineSimulatorWheeledVehicleSimulation.h"
+#include "Tasks/Task.h"
+
+#if WITH_EDITOR
+#include "DirectoryWatcherModule.h"
+#include "IDirectoryWatcher.h"
+#endif
+
+FEngineScriptHotReload& FEngineScriptHotReload::Get()
+{
+	static FEngineScriptHotReload HotReload;
+	return HotReload;
+}
+
+void FEngineScriptHotReload::Start()
+{
+#if WITH_EDITOR
+	if (IsRunningCommandlet())
+	{
+		return;
+	}
+
+	FDirectoryWatcherModule& DirectoryWatcherModule = FModuleManager::LoadModuleChecked<FDirectoryWatcherModule>(TEXT("DirectoryWatcher"));
+	IDirectoryWatcher* DirectoryWatcher = DirectoryWatcherModule.Get();
+	if (!DirectoryWatcher)
+	{
+		return;
+	}
+
+	const FString AssetDirectory = FPaths::ConvertRelativePathToFull(FEngineSimulatorPluginModule::GetAssetDirectory());
+	const FString esDirectory = FPaths::ConvertRelativePathToFull(FPaths::Combine(AssetDirectory, TEXT("../es/")));
+
+	for (const FString& Directory : { AssetDirectory, esDirectory })
+	{
+		FDelegateHandle Handle;
+		DirectoryWatcher->RegisterDirectoryChangedCallback_Handle(Directory, IDirectoryWatcher::FDirectoryChanged::CreateRaw(this, &FEngineScriptHotReload::OnDirectoryChanged), Handle);
+		WatchHandles.Emplace(Directory, Handle);
+	}
+#endif
+}
+
+void FEngineScriptHotReload::Stop()
+{
+#if WITH_EDITOR
+	if (FDirectoryWatcherModule* DirectoryWatcherModule = FModuleManager::GetModulePtr<FDirectoryWatcherModule>(TEXT("DirectoryWatcher")))
+	{
+		if (IDirectoryWatcher* DirectoryWatcher = DirectoryWatcherModule->Get())
+		{
+			for (const TPair<FString, FDelegateHandle>& Watch : WatchHandles)
+			{
+				DirectoryWatcher->UnregisterDirectoryChangedCallback_Handle(Watch.Key, Watch.Value);
+			}
+		}
+	}
+#endif
+	WatchHandles.Reset();
+}
+
+void FEngineScriptHotReload::Register(FEngineSimulatorInstance& Instance)
+{
+	FScopeLock Lock(&Mutex);
+	Instances.Add(&Instance);
+}
+
+void FEngineScriptHotReload::Unregister(FEngineSimulatorInstance& Instance)
+{
+	FScopeLock Lock(&Mutex);
+	Instances.RemoveSingleSwap(&Instance);
+}
+
+void FEngineScriptHotReload::ReloadChangedFiles(const TArray<FString>& ChangedFiles)
+{
+	const TArray<FString> Affected = FEngineDefinitionRegistry::Get().FindImporting(ChangedFiles);
+	for (const FString& ScriptPath : Affected)
+	{
+		UE_LOG(LogTemp, Log, TEXT("Reloading engine script %s"), ScriptPath.IsEmpty() ? TEXT("main.mr") : *ScriptPath);
+
+		UE::Tasks::Launch(UE_SOURCE_LOCATION, [this, ScriptPath]()
+		{
+			// Compiled once here rather than by the first vehicle that reloads, the rest would wait on it anyway
+			FEngineDefinitionRegistry::Get().FindOrAdd(ScriptPath);
+
+			FScopeLock Lock(&Mutex);
+			for (FEngineSimulatorInstance* Instance : Instances)
+			{
+				if (Instance->GetScriptPath() == ScriptPath)
+				{
+					Instance->RequestReload();
+				}
+			}
+		});
+	}
+}
+
+#if WITH_EDITOR
+void FEngineScriptHotReload::OnDirectoryChanged(const TArray<FFileChangeData>& Changes)
+{
+	TArray<FString> ChangedFiles;
+	for (const FFileChangeData& Change : Changes)
+	{
+		if (FPaths::GetExtension(Change.Filename) == TEXT("mr"))
+		{
+			FString Path = FPaths::ConvertRelativePathToFull(Change.Filename);
+			FPaths::CollapseRelativeDirectories(Path);
+			ChangedFiles.AddUnique(Path);
+		}
+	}
+
+	if (ChangedFiles.Num() > 0)
+	{
+		ReloadChangedFiles(ChangedFiles);
+	}
+}
+#endif
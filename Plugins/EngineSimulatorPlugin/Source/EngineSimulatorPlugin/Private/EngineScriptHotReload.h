@@ -0,0 +1,39 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class FEngineSimulatorInstance;
+struct FFileChangeData;
+
+/**
+ * Watches the engine script directories in the editor and reloads running engines when a script they import changes.
+ * Only definitions whose import closure contains a changed file are rebuilt, and the script cache only rehashes files
+ * whose timestamp moved. Vehicles swap to the new engine on a later step, keeping RPM, gear and the controls.
+ */
+class FEngineScriptHotReload
+{
+public:
+	static FEngineScriptHotReload& Get();
+
+	void Start();
+	void Stop();
+
+	// Running engines that get told when their script is rebuilt
+	void Register(FEngineSimulatorInstance& Instance);
+	void Unregister(FEngineSimulatorInstance& Instance);
+
+	// Rebuilds every registered definition importing one of the files, then reloads the engines using them
+	void ReloadChangedFiles(const TArray<FString>& ChangedFiles);
+
+private:
+#if WITH_EDITOR
+	void OnDirectoryChanged(const TArray<FFileChangeData>& Changes);
+#endif
+
+	FCriticalSection Mutex;
+	TArray<FEngineSimulatorInstance*> Instances;
+
+	TArray<TPair<FString, FDelegateHandle>> WatchHandles;
+};
@@ -2,14 +2,30 @@
 
 #include "EngineSimulator.h"
 #include "EngineSimulatorPlugin.h"
+#include "EngineAudioRingBuffer.h"
+#include "EngineSimulatorState.h"
+#include "EngineSimulatorStats.h"
+#include "EngineTelemetry.h"
+#include "EngineSimulatorScope.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "EngineDefinitionRegistry.h"
+#include "ImpulseResponseCache.h"
+#include "PartitionedConvolver.h"
+#include "EngineAudioResampler.h"
 #include "Sound/SoundWave.h"
 #include "Sound/SoundWaveProcedural.h"
 
 #include "EngineSimulatorInternals/HeaderFixesStart.h"
 
 #include "simulator.h"
-#include "compiler.h"
 #include "engine.h"
+#include "crankshaft.h"
+#include "piston.h"
+#include "connecting_rod.h"
+#include "combustion_chamber.h"
+#include "exhaust_system.h"
+#include "ignition_module.h"
 #include "transmission.h"
 
 #include "delta.h"
@@ -20,13 +36,35 @@
 
 typedef unsigned int SampleOffset;
 
+DECLARE_CYCLE_STAT(TEXT("EngineSimulator:LoadScript"), STAT_EngineSimulatorPlugin_LoadScript, STATGROUP_EngineSimulatorPlugin);
+DECLARE_CYCLE_STAT(TEXT("EngineSimulator:StartFrame"), STAT_EngineSimulatorPlugin_StartFrame, STATGROUP_EngineSimulatorPlugin);
+DECLARE_CYCLE_STAT(TEXT("EngineSimulator:SimulateSteps"), STAT_EngineSimulatorPlugin_SimulateSteps, STATGROUP_EngineSimulatorPlugin);
+DECLARE_CYCLE_STAT(TEXT("EngineSimulator:EndFrame"), STAT_EngineSimulatorPlugin_EndFrame, STATGROUP_EngineSimulatorPlugin);
+DECLARE_CYCLE_STAT(TEXT("EngineSimulator:RenderAudio"), STAT_EngineSimulatorPlugin_RenderAudio, STATGROUP_EngineSimulatorPlugin);
+DECLARE_CYCLE_STAT(TEXT("EngineSimulator:ReadAudio"), STAT_EngineSimulatorPlugin_ReadAudio, STATGROUP_EngineSimulatorPlugin);
+
+// Frames well inside the budget before fluid steps are restored after a degrade
+static const int32 BudgetRecoveryFrames = 60;
+
+// Samples buffered between the simulation and the audio callback, about 185ms at 44.1kHz
+static const uint32 AudioRingCapacity = 8192;
+
+// What engine-sim's synthesizer outputs at whatever the simulation frequency, anything else is resampled on the way out
+static const int32 SynthesizerSampleRate = 44100;
+
+// Without a pull from the wave for this long the engine is taken as not playing, and its synthesis is thrown away
+static const double AudioPullTimeout = 0.25;
+
+// Most synthesizer output thrown away per frame while nothing plays it
+static const uint32 DiscardCapacity = 4096;
+
 /**
  *
  */
 class FEngineSimulator : public IEngineSimulatorInterface
 {
 public:
-    FEngineSimulator(const FEngineSimulatorParameters& InParameters);
+    FEngineSimulator(const FEngineSimulatorParameters& InParameters, FEngineDefinitionPtr InDefinition);
     virtual ~FEngineSimulator();
 
     // IEngineSimulatorInterface
@@ -163,31 +201,133 @@ public:
         }
         return "";
     }
+
+    virtual FEngineSimulatorAudioStats GetAudioStats()
+    {
+        FEngineSimulatorAudioStats Stats;
+        Stats.QueuedSamples = AudioRing.Num();
+        Stats.CapacitySamples = AudioRing.GetCapacity();
+        Stats.Underruns = Underruns.load(std::memory_order_relaxed);
+        Stats.UnderrunSamples = UnderrunSamples.load(std::memory_order_relaxed);
+        return Stats;
+    }
+
+    virtual FEngineSimulatorPerformanceStats GetPerformanceStats()
+    {
+        FEngineSimulatorPerformanceStats Stats = PerformanceStats;
+        Stats.SamplesProduced = SamplesProduced.load(std::memory_order_relaxed);
+        Stats.SamplesConsumed = SamplesConsumed.load(std::memory_order_relaxed);
+        return Stats;
+    }
+
+    virtual void SetLOD(EEngineSimulatorLOD LOD);
+    virtual EEngineSimulatorLOD GetLOD() { return m_lod; }
+    virtual void SetTelemetryRecorder(FEngineTelemetryRecorder* Recorder);
+    virtual FEngineSimulatorHandoffState GetHandoffState();
+    virtual void ApplyHandoffState(const FEngineSimulatorHandoffState& State);
+    virtual void SaveState(TArray<uint8>& OutState);
+    virtual bool LoadState(const TArray<uint8>& State);
+    virtual void FillAudio(USoundWaveProcedural* Wave, int32 SamplesNeeded);
     // End IEngineSimulatorInterface
 
 protected:
     void loadScript();
     void loadEngine(Engine* engine, Vehicle* vehicle, Transmission* transmission);
     void process(float frame_dt);
+    bool pumpAudio();
+    bool pumpResampledAudio();
+    bool discardAudio(float frame_dt);
+    void renderAudio(float frame_dt);
+
+    void releaseEngine();
+
+    void getLODParameters(int& frequency, int& fluidSteps, bool& synthesis) const;
+
+    // Fills a telemetry record from the state after the step just taken
+    void recordTelemetry(double stepSeconds, double timestep);
+
+    // Feeds the scopes that have listeners from the state after the step just taken
+    void sampleScopes();
+
+    // Everything after the snapshot header, in either direction. Sets an error on Ar instead of loading a snapshot of
+    // an engine shaped differently.
+    void serializeState(FArchive& Ar);
 
 protected:
     Simulator m_simulator;
     Vehicle* m_vehicle;
     Transmission* m_transmission;
     Engine* m_iceEngine;
+    TSharedPtr<FEngineGraphObjects, ESPMode::ThreadSafe> m_graphObjects;
+
+    FEngineDefinitionPtr Definition;
 
     bool m_dynoEnabled;
     float m_dynoSpeed;
+    EEngineSimulatorLOD m_lod;
+
+    // Step budget state, see FEngineSimulatorParameters::StepBudgetMs
+    double m_stepCost; // Seconds per simulateStep(), smoothed
+    bool m_fluidStepsReduced;
+    int32 m_framesUnderBudget;
+    void setFluidStepsReduced(bool reduced);
+    bool m_hasEngineSound;
     FEngineSimulatorParameters Parameters;
 
+    // Only set while recording, owned by the vehicle's instance
+    FEngineTelemetryRecorder* m_telemetry;
+    double m_telemetryTime;
+
+    // Samples handed to the audio scope, its time axis
+    uint64 m_scopeAudioSamples;
+
+    // Rate the sound wave plays at. Unless it's the synthesizer's, output goes through the resampler and its buffers.
+    int32 m_outputSampleRate;
+    TUniquePtr<FEngineAudioResampler> Resampler;
+    TArray<int16> ResampleInput;
+    TArray<float> ResampleScratch;
+    TArray<float> ResampleOutput;
+
     AudioBuffer m_audioBuffer;
+    TUniquePtr<FPartitionedConvolver> Convolver;
+    TArray<float> ConvolutionBuffer;
+
+    // Synthesis runs on the thread stepping the engine, right after each frame, and the result is buffered here until
+    // the procedural wave asks for it. The audio callback only copies out of the ring.
+    std::atomic<bool> bSynthesisEnabled;
+    bool m_renderPending; // A frame of synthesizer input hasn't been rendered yet
+    std::atomic<uint64> LastPullCycles; // When the wave last asked for audio
+    FEngineAudioRingBuffer AudioRing;
+
+    // Stands in for the wave while nothing plays this engine, see discardAudio()
+    double m_discardBudget;
+    TArray<int16> DiscardBuffer;
+
+    std::atomic<uint64> Underruns;
+    std::atomic<uint64> UnderrunSamples;
+    std::atomic<uint64> SamplesProduced;
+    std::atomic<uint64> SamplesConsumed;
+
+    FEngineSimulatorPerformanceStats PerformanceStats;
+
+    // Tags this simulator's frames in Insights and in its own stat, so two vehicles running the same engine show up separately
+    FEngineSimulatorStatSlot StatSlot;
+
     uint32 PlayCursor;
     std::vector<uint8> Buffer;
-
-    void FillAudio(USoundWaveProcedural* Wave, const int32 SamplesNeeded);
 };
 
-FEngineSimulator::FEngineSimulator(const FEngineSimulatorParameters& InParameters)
+FEngineSimulator::FEngineSimulator(const FEngineSimulatorParameters& InParameters, FEngineDefinitionPtr InDefinition)
+    : Definition(InDefinition)
+    , bSynthesisEnabled(false)
+    , m_renderPending(false)
+    , LastPullCycles(0)
+    , AudioRing(AudioRingCapacity)
+    , m_discardBudget(0.0)
+    , Underruns(0)
+    , UnderrunSamples(0)
+    , SamplesProduced(0)
+    , SamplesConsumed(0)
 {
     m_vehicle = nullptr;
     m_transmission = nullptr;
@@ -196,121 +336,83 @@ FEngineSimulator::FEngineSimulator(const FEngineSimulatorParameters& InParameter
     m_dynoEnabled = true;
     m_dynoSpeed = 0;
 
+    m_lod = EEngineSimulatorLOD::Full;
+    m_telemetry = nullptr;
+    m_telemetryTime = 0.0;
+    m_scopeAudioSamples = 0;
+    m_stepCost = 0.0;
+    m_fluidStepsReduced = false;
+    m_framesUnderBudget = 0;
+    m_hasEngineSound = false;
+
     Parameters = InParameters;
 
     PlayCursor = 0;
 
-	loadScript();
-
-    m_audioBuffer.initialize(44100, 44100);
-    m_audioBuffer.m_writePointer = (int)(44100 * 0.1);
+    m_outputSampleRate = Parameters.OutputSampleRate > 0 ? Parameters.OutputSampleRate : SynthesizerSampleRate;
+    if (m_outputSampleRate != SynthesizerSampleRate) {
+        Resampler = MakeUnique<FEngineAudioResampler>(SynthesizerSampleRate, m_outputSampleRate);
 
-    check(Parameters.SoundWaveOutput);
-    if (Parameters.SoundWaveOutput)
-    {
-        Parameters.SoundWaveOutput->OnSoundWaveProceduralUnderflow.BindRaw(this, &FEngineSimulator::FillAudio);
+        // Sized for filling the whole ring in one pump, so nothing allocates on the audio thread
+        const uint32 maxInput = Resampler->GetInputNeeded(AudioRing.GetCapacity());
+        ResampleInput.SetNumUninitialized(maxInput);
+        ResampleScratch.SetNumUninitialized(maxInput);
+        ResampleOutput.SetNumUninitialized(AudioRing.GetCapacity());
     }
+
+	loadScript();
+
+    m_audioBuffer.initialize(SynthesizerSampleRate, SynthesizerSampleRate);
+    m_audioBuffer.m_writePointer = (int)(SynthesizerSampleRate * 0.1);
 }
 
 FEngineSimulator::~FEngineSimulator()
 {
-    if (Parameters.SoundWaveOutput)
-    {
-        Parameters.SoundWaveOutput->OnSoundWaveProceduralUnderflow.Unbind();
-    }
-    m_simulator.endAudioRenderingThread();
+    releaseEngine();
 }
 
 void FEngineSimulator::loadScript()
 {
     UE_LOG(LogTemp, Warning, TEXT("void UEngineSimulator::loadScript()"));
+    ENGINESIMULATOR_SCOPE_CYCLE_COUNTER(STAT_EngineSimulatorPlugin_LoadScript);
 
-    Engine* engine = nullptr;
-    Vehicle* vehicle = nullptr;
-    Transmission* transmission = nullptr;
-
-#ifdef ATG_ENGINE_SIM_PIRANHA_ENABLED
-    es_script::Compiler compiler;
-    const FString esPath = FPaths::ConvertRelativePathToFull(FPaths::Combine(FEngineSimulatorPluginModule::GetAssetDirectory(), "../es/"));
-    compiler.initialize();
-    compiler.addSearchPath(TCHAR_TO_UTF8(*esPath));
-    const FString EnginePath = FPaths::ConvertRelativePathToFull(FPaths::Combine(FEngineSimulatorPluginModule::GetAssetDirectory(), "main.mr"));
-
-    if (FPaths::FileExists(TEXT("error_log.log")))
-    {
-        IFileManager& FileManager = IFileManager::Get();
-        FileManager.Delete(TEXT("error_log.log"));
-    }
-
-    const bool compiled = compiler.compile(TCHAR_TO_UTF8(*EnginePath));
-    if (compiled) {
-        const es_script::Compiler::Output output = compiler.execute();
+    const FEngineGraph Graph = Definition->AcquireGraph();
+    loadEngine(Graph.engine, Graph.vehicle, Graph.transmission);
+    m_graphObjects = Graph.Objects;
+    //refreshUserInterface();
+}
 
-        engine = output.engine;
-        vehicle = output.vehicle;
-        transmission = output.transmission;
-    }
-    else {
-        engine = nullptr;
-        vehicle = nullptr;
-        transmission = nullptr;
-    }
+void FEngineSimulator::releaseEngine()
+{
+    m_simulator.releaseSimulation();
 
-    compiler.destroy();
-#endif /* ATG_ENGINE_SIM_PIRANHA_ENABLED */
+    FEngineGraph Graph;
+    Graph.engine = m_iceEngine;
+    Graph.vehicle = m_vehicle;
+    Graph.transmission = m_transmission;
+    Graph.Objects = MoveTemp(m_graphObjects);
 
-    if (vehicle == nullptr) {
-        Vehicle::Parameters vehParams;
-        vehParams.mass = units::mass(1597, units::kg);
-        vehParams.diffRatio = 3.42;
-        vehParams.tireRadius = units::distance(10, units::inch);
-        vehParams.dragCoefficient = 0.25;
-        vehParams.crossSectionArea = units::distance(6.0, units::foot) * units::distance(6.0, units::foot);
-        vehParams.rollingResistance = 2000.0;
-        vehicle = new Vehicle;
-        vehicle->initialize(vehParams);
-    }
+    m_iceEngine = nullptr;
+    m_vehicle = nullptr;
+    m_transmission = nullptr;
 
-    if (transmission == nullptr) {
-        const double gearRatios[] = { 2.97, 2.07, 1.43, 1.00, 0.84, 0.56 };
-        Transmission::Parameters tParams;
-        tParams.GearCount = 6;
-        tParams.GearRatios = gearRatios;
-        tParams.MaxClutchTorque = units::torque(1000.0, units::ft_lb);
-        transmission = new Transmission;
-        transmission->initialize(tParams);
+    if (Graph.vehicle != nullptr || Graph.transmission != nullptr || Graph.engine != nullptr)
+    {
+        Definition->ReleaseGraph(Graph);
     }
-
-    loadEngine(engine, vehicle, transmission);
-    //refreshUserInterface();
 }
 
 void FEngineSimulator::loadEngine(Engine* engine, Vehicle* vehicle, Transmission* transmission)
 {
     UE_LOG(LogTemp, Warning, TEXT("void UEngineSimulator::loadEngine()"));
 
-    if (m_vehicle != nullptr) {
-        delete m_vehicle;
-        m_vehicle = nullptr;
-    }
-
-    if (m_transmission != nullptr) {
-        delete m_transmission;
-        m_transmission = nullptr;
-    }
-
-    if (m_iceEngine != nullptr) {
-        m_iceEngine->destroy();
-        delete m_iceEngine;
-    }
+    //destroyObjects();
+    releaseEngine();
 
     m_iceEngine = engine;
     m_vehicle = vehicle;
     m_transmission = transmission;
 
-    //destroyObjects();
-    m_simulator.releaseSimulation();
-
     if (engine == nullptr || vehicle == nullptr || transmission == nullptr) {
         m_iceEngine = nullptr;
         //m_viewParameters.Layer1 = 0;
@@ -323,8 +425,12 @@ void FEngineSimulator::loadEngine(Engine* engine, Vehicle* vehicle, Transmission
     //m_viewParameters.Layer1 = engine->getMaxDepth();
     engine->calculateDisplacement();
 
-    m_simulator.setFluidSimulationSteps(8);
-    m_simulator.setSimulationFrequency(engine->getSimulationFrequency());
+    int frequency, fluidSteps;
+    bool synthesis;
+    getLODParameters(frequency, fluidSteps, synthesis);
+
+    m_simulator.setFluidSimulationSteps(fluidSteps);
+    m_simulator.setSimulationFrequency(frequency);
 
     Simulator::Parameters simulatorParams;
     simulatorParams.SystemType = Simulator::SystemType::NsvOptimized;
@@ -339,43 +445,353 @@ void FEngineSimulator::loadEngine(Engine* engine, Vehicle* vehicle, Transmission
 
     m_simulator.m_dyno.m_maxTorque = m_transmission->getMaxClutchTorque();
 
+    // Most engines run every exhaust through the same impulse response. Convolution is linear, so in that case the
+    // synthesizer gets a unit impulse and the mixed output is convolved once, with FFT partitions, on the way out.
+    // That's after the synthesizer's leveler, int16 clamp and antialiasing filter rather than before them. The leveler
+    // sets its gain from what it's fed, so the unit impulse carries the response's RMS gain and the partitioned response
+    // is normalized by it: the leveler then sees the same level as with direct convolution, exactly so for a spectrally
+    // flat exhaust signal. -run=EngineSimulatorConvolutionBenchmark -Script= checks the two stay within 1 dB.
+    FImpulseResponseSamplesPtr SharedImpulseResponse;
+    float SharedVolume = 1.f;
+    if (Parameters.bPartitionedConvolution && engine->getExhaustSystemCount() > 0) {
+        ImpulseResponse* first = engine->getExhaustSystem(0)->getImpulseResponse();
+        bool bShared = true;
+        for (int i = 1; i < engine->getExhaustSystemCount(); ++i) {
+            ImpulseResponse* response = engine->getExhaustSystem(i)->getImpulseResponse();
+            bShared &= response->getFilename() == first->getFilename() && response->getVolume() == first->getVolume();
+        }
+
+        if (bShared) {
+            SharedImpulseResponse = FImpulseResponseCache::Get().FindOrLoad(UTF8_TO_TCHAR(first->getFilename().c_str()));
+            SharedVolume = static_cast<float>(first->getVolume());
+        }
+        else {
+            UE_LOG(LogTemp, Warning, TEXT("%s has different impulse responses per exhaust, using direct convolution"), UTF8_TO_TCHAR(engine->getName().c_str()));
+        }
+    }
+
+    Convolver.Reset();
+    float unitImpulseVolume = 1.0f;
+    if (SharedImpulseResponse.IsValid()) {
+        TArray<float> Response;
+        SharedImpulseResponse->ToFloat(SharedVolume, Response);
+
+        double energy = 0.0;
+        for (const float sample : Response) {
+            energy += static_cast<double>(sample) * sample;
+        }
+        if (energy > 0.0) {
+            unitImpulseVolume = static_cast<float>(FMath::Sqrt(energy));
+            for (float& sample : Response) {
+                sample /= unitImpulseVolume;
+            }
+        }
+
+        Convolver = MakeUnique<FPartitionedConvolver>();
+        if (!Convolver->Initialize(Response.GetData(), Response.Num())) {
+            Convolver.Reset();
+        }
+        else {
+            // A pump never moves more than the ring holds, so this never grows afterwards
+            ConvolutionBuffer.SetNumUninitialized(AudioRing.GetCapacity());
+        }
+    }
+
     bool bLoadedEngineSound = false;
     for (int i = 0; i < engine->getExhaustSystemCount(); ++i) {
         ImpulseResponse* response = engine->getExhaustSystem(i)->getImpulseResponse();
 
-        ysWindowsAudioWaveFile waveFile;
-        waveFile.OpenFile(response->getFilename().c_str());
-        FString AudioFilePath = UTF8_TO_TCHAR(response->getFilename().c_str());
-        checkf(FPaths::FileExists(AudioFilePath), *AudioFilePath);
-        UE_LOG(LogTemp, Warning, TEXT("Loading audio file: %s"), *AudioFilePath)
-        waveFile.InitializeInternalBuffer(waveFile.GetSampleCount());
-        waveFile.FillBuffer(0);
-        waveFile.CloseFile();
+        if (Convolver.IsValid()) {
+            static const int16_t UnitImpulse = INT16_MAX;
+            m_simulator.getSynthesizer()->initializeImpulseResponse(&UnitImpulse, 1, unitImpulseVolume, i);
+            bLoadedEngineSound = true;
+            continue;
+        }
+
+        const FImpulseResponseSamplesPtr Samples = FImpulseResponseCache::Get().FindOrLoad(UTF8_TO_TCHAR(response->getFilename().c_str()));
+        if (!Samples.IsValid())
+        {
+            continue;
+        }
 
         m_simulator.getSynthesizer()->initializeImpulseResponse(
-            reinterpret_cast<const int16_t*>(waveFile.GetBuffer()),
-            waveFile.GetSampleCount(),
+            Samples->Samples.GetData(),
+            Samples->Samples.Num(),
             response->getVolume(),
             i
         );
 
-        waveFile.DestroyInternalBuffer();
-
         bLoadedEngineSound = true;
     }
 
-    if (bLoadedEngineSound)
-    {
-        m_simulator.startAudioRenderingThread();
+    StatSlot.Acquire(UTF8_TO_TCHAR(engine->getName().c_str()));
+
+    // No rendering thread, synthesis is rendered after each frame by whichever thread stepped it
+    m_hasEngineSound = bLoadedEngineSound;
+    bSynthesisEnabled = m_hasEngineSound && synthesis;
+}
+
+void FEngineSimulator::getLODParameters(int& frequency, int& fluidSteps, bool& synthesis) const
+{
+    int divider = 1;
+    fluidSteps = 8;
+    synthesis = true;
+
+    switch (m_lod) {
+    case EEngineSimulatorLOD::Reduced:
+        divider = 2;
+        fluidSteps = 4;
+        break;
+    case EEngineSimulatorLOD::Silent:
+        divider = 2;
+        fluidSteps = 4;
+        synthesis = false;
+        break;
+    case EEngineSimulatorLOD::Minimal:
+        divider = 4;
+        fluidSteps = 2;
+        synthesis = false;
+        break;
+    default:
+        break;
+    }
+
+    if (m_fluidStepsReduced) {
+        fluidSteps = FMath::Max(1, fluidSteps / 2);
+    }
+
+    frequency = m_iceEngine != nullptr ? static_cast<int>(m_iceEngine->getSimulationFrequency()) / divider : 0;
+}
+
+void FEngineSimulator::setFluidStepsReduced(bool reduced)
+{
+    m_fluidStepsReduced = reduced;
+    m_framesUnderBudget = 0;
+
+    int frequency, fluidSteps;
+    bool synthesis;
+    getLODParameters(frequency, fluidSteps, synthesis);
+    m_simulator.setFluidSimulationSteps(fluidSteps);
+}
+
+void FEngineSimulator::SetLOD(EEngineSimulatorLOD LOD)
+{
+    m_lod = LOD;
+    if (m_iceEngine == nullptr) {
+        return;
+    }
+
+    // Everything here can change between frames, the engine state carries over untouched
+    int frequency, fluidSteps;
+    bool synthesis;
+    getLODParameters(frequency, fluidSteps, synthesis);
+
+    m_simulator.setFluidSimulationSteps(fluidSteps);
+    if (frequency != m_simulator.getSimulationFrequency()) {
+        m_simulator.setSimulationFrequency(frequency);
+
+        // The synthesizer resamples from the simulation rate, keep it in step so the pitch doesn't shift
+        m_simulator.getSynthesizer()->setInputSampleRate(frequency);
+    }
+
+    bSynthesisEnabled = m_hasEngineSound && synthesis;
+}
+
+FEngineSimulatorHandoffState FEngineSimulator::GetHandoffState()
+{
+    FEngineSimulatorHandoffState State;
+    State.RPM = GetRPM();
+    State.Gear = GetGear();
+    State.ClutchPressure = static_cast<float>(m_simulator.m_dyno.m_clutchPressure);
+    State.bStarterEnabled = m_simulator.m_starterMotor.m_enabled;
+    State.bDynoEnabled = m_dynoEnabled;
+
+    if (m_iceEngine) {
+        State.SpeedControl = static_cast<float>(m_iceEngine->getSpeedControl());
+        if (IgnitionModule* ignition = m_iceEngine->getIgnitionModule()) {
+            State.bIgnitionEnabled = ignition->m_enabled;
+        }
+    }
+
+    return State;
+}
+
+void FEngineSimulator::ApplyHandoffState(const FEngineSimulatorHandoffState& State)
+{
+    SetGear(State.Gear);
+    SetClutchPressure(State.ClutchPressure);
+    SetSpeedControl(State.SpeedControl);
+    SetStarterEnabled(State.bStarterEnabled);
+    SetIgnitionEnabled(State.bIgnitionEnabled);
+    SetDynoEnabled(State.bDynoEnabled);
+
+    if (m_iceEngine == nullptr) {
+        return;
+    }
+
+    // Spin the crankshafts up to the surrogate's speed, in whichever direction this engine turns
+    const double direction = m_iceEngine->getSpeed() > 0 ? 1.0 : -1.0;
+    for (int i = 0; i < m_iceEngine->getCrankshaftCount(); ++i) {
+        m_iceEngine->getCrankshaft(i)->m_body.v_theta = direction * units::rpm(State.RPM);
+    }
+}
+
+void FEngineSimulator::serializeState(FArchive& Ar)
+{
+    // The graph checks the shape first, so a snapshot that doesn't fit is rejected before anything is overwritten
+    FEngineGraph graph;
+    graph.engine = m_iceEngine;
+    graph.vehicle = m_vehicle;
+    graph.transmission = m_transmission;
+    graph.SerializeState(Ar);
+    if (Ar.IsError()) {
+        return;
+    }
+
+    // Controls the handoff state doesn't carry
+    Ar << m_dynoSpeed << m_dynoEnabled;
+    Ar << m_simulator.m_dyno.m_rotationSpeed << m_simulator.m_dyno.m_enabled << m_simulator.m_dyno.m_hold;
+
+    // What the clutch drives, the transmission and vehicle side of the drivetrain
+    FEngineGraph::SerializeBody(Ar, m_simulator.m_vehicleMass);
+
+    // The synthesizer's filters are only a few milliseconds of audio, its mix isn't
+    Synthesizer::AudioParameters audioParams = m_simulator.getSynthesizer()->getAudioParameters();
+    Ar << audioParams.Volume << audioParams.Convolution << audioParams.dF_F_mix;
+    Ar << audioParams.InputSampleNoise << audioParams.AirNoise;
+    if (Ar.IsLoading() && !Ar.IsError()) {
+        m_simulator.getSynthesizer()->setAudioParameters(audioParams);
+    }
+
+    // The partitioned convolver holds up to a second of impulse response tail, unlike the synthesizer's filters.
+    // Whether it runs is a component setting rather than part of the definition, so either side may lack one.
+    bool hasConvolver = Convolver.IsValid();
+    Ar << hasConvolver;
+    if (hasConvolver) {
+        FPartitionedConvolver discard;
+        (Convolver.IsValid() ? *Convolver : discard).SerializeState(Ar);
+    }
+}
+
+void FEngineSimulator::SaveState(TArray<uint8>& OutState)
+{
+    OutState.Reset();
+    FMemoryWriter Ar(OutState);
+
+    FEngineSimulatorStateHeader Header(FEngineSimulatorStateHeader::EKind::Simulator, Definition->GetKey(), GetHandoffState());
+    Ar << Header;
+
+    // An engine that didn't compile has nothing past the handoff state
+    if (m_iceEngine) {
+        serializeState(Ar);
+    }
+}
+
+bool FEngineSimulator::LoadState(const TArray<uint8>& State)
+{
+    FMemoryReader Ar(State);
+
+    FEngineSimulatorStateHeader Header;
+    Ar << Header;
+    if (Ar.IsError()) {
+        return false;
+    }
+
+    ApplyHandoffState(Header.Handoff);
+
+    const FEngineSimulatorStateHeader Expected(FEngineSimulatorStateHeader::EKind::Simulator, Definition->GetKey(), Header.Handoff);
+    if (!Header.Matches(Expected) || m_iceEngine == nullptr) {
+        return false;
+    }
+
+    serializeState(Ar);
+    return !Ar.IsError();
+}
+
+void FEngineSimulator::SetTelemetryRecorder(FEngineTelemetryRecorder* Recorder)
+{
+    if (Recorder == m_telemetry) {
+        return;
+    }
+
+    m_telemetry = Recorder;
+    m_telemetryTime = 0.0;
+    if (m_telemetry != nullptr) {
+        m_telemetry->Describe(GetName(), m_iceEngine != nullptr ? m_iceEngine->getCylinderCount() : 0);
+    }
+}
+
+void FEngineSimulator::recordTelemetry(double stepSeconds, double timestep)
+{
+    m_telemetryTime += timestep;
+
+    FEngineTelemetryRecorder::FRecord* record = m_telemetry->BeginWrite();
+    if (record == nullptr) {
+        return;
+    }
+
+    FEngineTelemetrySample& sample = record->Sample;
+    sample.Time = m_telemetryTime;
+    sample.CrankAngle = static_cast<float>(FMath::RadiansToDegrees(m_iceEngine->getOutputCrankshaft()->getCycleAngle()));
+    sample.RPM = static_cast<float>(m_iceEngine->getRpm());
+    sample.DynoTorque = static_cast<float>(m_simulator.getFilteredDynoTorque());
+    sample.Throttle = static_cast<float>(m_iceEngine->getThrottle());
+    sample.ClutchPressure = static_cast<float>(m_simulator.m_dyno.m_clutchPressure);
+    sample.StepMicroseconds = static_cast<float>(stepSeconds * 1e6);
+    sample.Gear = m_transmission->getGear();
+
+    record->NumCylinders = FMath::Min(m_iceEngine->getCylinderCount(), FEngineTelemetryRecorder::MaxCylinders);
+    for (int i = 0; i < record->NumCylinders; ++i) {
+        CombustionChamber* chamber = m_iceEngine->getChamber(i);
+        FEngineTelemetryCylinder& cylinder = record->Cylinders[i];
+        cylinder.Pressure = static_cast<float>(chamber->m_system.pressure());
+        cylinder.Temperature = static_cast<float>(chamber->m_system.temperature());
+        cylinder.IntakeFlow = static_cast<float>(chamber->getLastTimestepIntakeFlow());
+        cylinder.ExhaustFlow = static_cast<float>(chamber->getLastTimestepExhaustFlow());
+    }
+
+    m_telemetry->CommitWrite();
+}
+
+void FEngineSimulator::sampleScopes()
+{
+    if (m_iceEngine->getCylinderCount() == 0) {
+        return;
+    }
+
+    FEngineSimulatorScopes& scopes = *Parameters.Scopes;
+    const float angle = static_cast<float>(FMath::RadiansToDegrees(m_iceEngine->getOutputCrankshaft()->getCycleAngle()));
+    CombustionChamber* chamber = m_iceEngine->getChamber(0);
+
+    if (scopes.IsListening(EEngineSimulatorSignal::CylinderPressure)) {
+        scopes.Push(EEngineSimulatorSignal::CylinderPressure, angle, static_cast<float>(chamber->m_system.pressure()));
+    }
+    if (scopes.IsListening(EEngineSimulatorSignal::IntakeFlow)) {
+        scopes.Push(EEngineSimulatorSignal::IntakeFlow, angle, static_cast<float>(chamber->getLastTimestepIntakeFlow()));
+    }
+    if (scopes.IsListening(EEngineSimulatorSignal::ExhaustFlow)) {
+        scopes.Push(EEngineSimulatorSignal::ExhaustFlow, angle, static_cast<float>(chamber->getLastTimestepExhaustFlow()));
     }
 }
 
 void FEngineSimulator::process(float frame_dt)
 {
-    frame_dt = static_cast<float>(clamp(frame_dt, 1 / 200.0f, 1 / 30.0f));
+    // Physics substeps can be well below 1/200s, so inline steps are taken as given rather than clamped
+    if (frame_dt <= 0.f) {
+        return;
+    }
+    if (!Parameters.bInlineStepping) {
+        frame_dt = static_cast<float>(clamp(frame_dt, 1 / 200.0f, 1 / 30.0f));
+    }
 
     if (m_transmission && m_iceEngine && m_vehicle)
     {
+#if STATS
+        FScopeCycleCounter EngineCycleCounter(StatSlot.GetStatId());
+#else
+        TRACE_CPUPROFILER_EVENT_SCOPE_TEXT_ON_CHANNEL(*StatSlot.GetName(), EngineSimulatorChannel);
+#endif
+
         m_simulator.setSimulationSpeed(1.0f);
 
         m_simulator.m_dyno.m_enabled = (m_simulator.getTransmission()->getGear() != -1) && m_dynoEnabled;
@@ -399,22 +815,93 @@ void FEngineSimulator::process(float frame_dt)
         //m_simulator.m_dyno.m_rotationSpeed = m_dynoSpeed + units::rpm(1000);
         m_simulator.m_dyno.m_rotationSpeed = FMath::Max(m_dynoSpeed, 0.f);
         //m_simulator.getEngine()->getIgnitionModule()->m_enabled = m_dynoSpeed > units::rpm(-100.f); // Only run ignition in forward
-        m_simulator.startFrame(frame_dt);
+        // After a hitch the whole frame would take far longer than usual to step, which only puts the next frame
+        // further behind. Drop to fewer fluid steps first, then simulate less time than actually passed.
+        const double budget = Parameters.StepBudgetMs * 1e-3;
+        const double frequency = m_simulator.getSimulationFrequency();
+        bool degraded = false;
+        if (budget > 0.0 && m_stepCost > 0.0) {
+            const double predicted = frame_dt * frequency * m_stepCost;
+            if (predicted > budget) {
+                degraded = true;
+                if (!m_fluidStepsReduced) {
+                    setFluidStepsReduced(true);
+                }
+
+                const float budget_dt = static_cast<float>(FMath::Max(budget / (m_stepCost * frequency), 1.0 / frequency));
+                if (budget_dt < frame_dt) {
+                    PerformanceStats.DroppedSeconds += frame_dt - budget_dt;
+                    frame_dt = budget_dt;
+                }
+                m_framesUnderBudget = 0;
+            }
+            else if (m_fluidStepsReduced && predicted < budget * 0.25 && ++m_framesUnderBudget >= BudgetRecoveryFrames) {
+                setFluidStepsReduced(false);
+            }
+        }
+
+        {
+            ENGINESIMULATOR_SCOPE_CYCLE_COUNTER(STAT_EngineSimulatorPlugin_StartFrame);
+            m_simulator.startFrame(frame_dt);
+        }
 
-        auto proc_t0 = std::chrono::steady_clock::now();
-        const int iterationCount = m_simulator.getFrameIterationCount();
-        while (m_simulator.simulateStep()) {
-            //m_oscCluster->sample();
+        const double proc_t0 = FPlatformTime::Seconds();
+        const int plannedIterations = m_simulator.getFrameIterationCount();
+        int iterationCount = 0;
+        {
+            ENGINESIMULATOR_SCOPE_CYCLE_COUNTER(STAT_EngineSimulatorPlugin_SimulateSteps);
+            uint64 stepStart = m_telemetry ? FPlatformTime::Cycles64() : 0;
+            while (m_simulator.simulateStep()) {
+                if (Parameters.Scopes != nullptr && Parameters.Scopes->IsListeningToAny()) {
+                    sampleScopes();
+                }
+
+                if (m_telemetry) {
+                    recordTelemetry(FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - stepStart), 1.0 / frequency);
+                    stepStart = FPlatformTime::Cycles64();
+                }
+
+                // The estimate can be off (first frames, a busy machine), so stop outright well past the budget
+                if ((++iterationCount & 31) == 0 && budget > 0.0 && FPlatformTime::Seconds() - proc_t0 > 2.0 * budget) {
+                    PerformanceStats.DroppedSeconds += (plannedIterations - iterationCount) / frequency;
+                    degraded = true;
+                    break;
+                }
+            }
         }
 
-        auto proc_t1 = std::chrono::steady_clock::now();
+        const double proc_t1 = FPlatformTime::Seconds();
 
-        m_simulator.endFrame();
+        {
+            ENGINESIMULATOR_SCOPE_CYCLE_COUNTER(STAT_EngineSimulatorPlugin_EndFrame);
+            m_simulator.endFrame();
+        }
+
+        if (iterationCount > 0) {
+            m_renderPending = true;
+        }
+        renderAudio(frame_dt);
 
-        auto duration = proc_t1 - proc_t0;
         if (iterationCount > 0) {
-            //m_performanceCluster->addTimePerTimestepSample(
-            //    (duration.count() / 1E9) / iterationCount);
+            const uint32 steps = static_cast<uint32>(iterationCount);
+            PerformanceStats.MinFrameSteps = PerformanceStats.Frames == 0 ? steps : FMath::Min(PerformanceStats.MinFrameSteps, steps);
+            PerformanceStats.MaxFrameSteps = FMath::Max(PerformanceStats.MaxFrameSteps, steps);
+            PerformanceStats.LastFrameSteps = steps;
+            PerformanceStats.Steps += steps;
+            PerformanceStats.StepSeconds += proc_t1 - proc_t0;
+            ++PerformanceStats.Frames;
+
+            const double cost = (proc_t1 - proc_t0) / steps;
+            m_stepCost = m_stepCost > 0.0 ? FMath::Lerp(m_stepCost, cost, 0.1) : cost;
+
+            INC_DWORD_STAT(STAT_EngineSimulatorPlugin_Frames);
+            INC_DWORD_STAT_BY(STAT_EngineSimulatorPlugin_Steps, steps);
+            StatSlot.SetStepCounters(steps, (proc_t1 - proc_t0) * 1e6 / steps);
+        }
+
+        if (degraded) {
+            ++PerformanceStats.DegradedFrames;
+            INC_DWORD_STAT(STAT_EngineSimulatorPlugin_DegradedFrames);
         }
 
         //const SampleOffset safeWritePosition = m_audioSource->GetCurrentWritePosition();
@@ -474,9 +961,142 @@ void FEngineSimulator::process(float frame_dt)
     }
 }
 
-const static int32 SampleRate = 44100;
+void FEngineSimulator::renderAudio(float frame_dt)
+{
+    if (!m_hasEngineSound) {
+        return;
+    }
+
+    // LODs without synthesis are heard as little as a wave that isn't playing
+    const bool audible = bSynthesisEnabled && FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - LastPullCycles.load(std::memory_order_relaxed)) < AudioPullTimeout;
+    const bool drained = audible ? pumpAudio() : discardAudio(frame_dt);
+
+    // Synthesizer::renderAudio() waits for its output to drop under 2000 samples and for input it hasn't processed yet,
+    // so it's only called once per frame and once everything it rendered last time has been taken. Otherwise the frame
+    // is rendered after a later one, once the wave has caught up.
+    if (drained && m_renderPending && m_simulator.getSynthesizerInputLatency() > 0) {
+        {
+            ENGINESIMULATOR_SCOPE_CYCLE_COUNTER(STAT_EngineSimulatorPlugin_RenderAudio);
+            m_simulator.getSynthesizer()->renderAudio();
+        }
+        m_renderPending = false;
+
+        if (audible) {
+            pumpAudio();
+        }
+    }
+}
+
+bool FEngineSimulator::discardAudio(float frame_dt)
+{
+    // startFrame() steps more or fewer times depending on how far the synthesizer's input has been read, so it still has
+    // to be consumed while nothing is listening (silent LODs, a wave that isn't playing). Reading it at the rate the wave
+    // would keeps the engine in real time.
+    if (DiscardBuffer.Num() == 0) {
+        DiscardBuffer.SetNumUninitialized(DiscardCapacity);
+    }
+
+    m_discardBudget = FMath::Min(m_discardBudget + frame_dt * SynthesizerSampleRate, static_cast<double>(DiscardCapacity));
+    const uint32 wanted = static_cast<uint32>(m_discardBudget);
+    const uint32 read = wanted > 0 ? m_simulator.readAudioOutput(wanted, DiscardBuffer.GetData()) : 0;
+    m_discardBudget -= read;
+    return read < wanted;
+}
+
+bool FEngineSimulator::pumpAudio()
+{
+    if (Resampler.IsValid()) {
+        return pumpResampledAudio();
+    }
+
+    ENGINESIMULATOR_SCOPE_CYCLE_COUNTER(STAT_EngineSimulatorPlugin_ReadAudio);
+
+    // Pull whatever the synthesizer has straight into the free part of the ring
+    const FEngineAudioRingBuffer::FRegions Regions = AudioRing.GetWriteRegions(AudioRing.GetCapacity());
+
+    uint32 written = 0;
+    if (Regions.FirstCount > 0) {
+        written = m_simulator.readAudioOutput(Regions.FirstCount, Regions.First);
+    }
+    if (written == Regions.FirstCount && Regions.SecondCount > 0) {
+        written += m_simulator.readAudioOutput(Regions.SecondCount, Regions.Second);
+    }
+
+    // Running out of room before the synthesizer ran dry means it may still hold samples
+    const bool bDrained = written < Regions.Num();
+
+    if (written == 0) {
+        return bDrained;
+    }
+
+    if (Convolver.IsValid()) {
+        float* const scratch = ConvolutionBuffer.GetData();
+        for (uint32 i = 0; i < written; ++i) {
+            scratch[i] = i < Regions.FirstCount ? Regions.First[i] : Regions.Second[i - Regions.FirstCount];
+        }
+
+        Convolver->Process(scratch, scratch, written);
+
+        for (uint32 i = 0; i < written; ++i) {
+            const int16_t sample = static_cast<int16_t>(FMath::Clamp(scratch[i], -32768.f, 32767.f));
+            if (i < Regions.FirstCount) {
+                Regions.First[i] = sample;
+            }
+            else {
+                Regions.Second[i - Regions.FirstCount] = sample;
+            }
+        }
+    }
+
+    AudioRing.CommitWrite(written);
+    SamplesProduced.fetch_add(written, std::memory_order_relaxed);
+    INC_DWORD_STAT_BY(STAT_EngineSimulatorPlugin_AudioSamples, written);
+    return bDrained;
+}
+
+bool FEngineSimulator::pumpResampledAudio()
+{
+    ENGINESIMULATOR_SCOPE_CYCLE_COUNTER(STAT_EngineSimulatorPlugin_ReadAudio);
+
+    // Only take as much from the synthesizer as it takes to fill the free part of the ring at the output rate
+    const FEngineAudioRingBuffer::FRegions Regions = AudioRing.GetWriteRegions(AudioRing.GetCapacity());
+    const uint32 wanted = FMath::Min<uint32>(Resampler->GetInputNeeded(Regions.Num()), ResampleInput.Num());
+    const uint32 read = wanted > 0 ? m_simulator.readAudioOutput(wanted, ResampleInput.GetData()) : 0;
+    const bool bDrained = read < wanted;
+
+    float* const scratch = ResampleScratch.GetData();
+    for (uint32 i = 0; i < read; ++i) {
+        scratch[i] = ResampleInput[i];
+    }
+
+    // Convolving before resampling keeps the impulse response at the rate it was recorded at
+    if (Convolver.IsValid() && read > 0) {
+        Convolver->Process(scratch, scratch, read);
+    }
+
+    // Also drains what earlier pumps buffered but the ring had no room for
+    const uint32 written = Resampler->Process(scratch, read, ResampleOutput.GetData(), Regions.Num());
+    if (written == 0) {
+        return bDrained;
+    }
+
+    for (uint32 i = 0; i < written; ++i) {
+        const int16_t sample = static_cast<int16_t>(FMath::Clamp(ResampleOutput[i], -32768.f, 32767.f));
+        if (i < Regions.FirstCount) {
+            Regions.First[i] = sample;
+        }
+        else {
+            Regions.Second[i - Regions.FirstCount] = sample;
+        }
+    }
+
+    AudioRing.CommitWrite(written);
+    SamplesProduced.fetch_add(written, std::memory_order_relaxed);
+    INC_DWORD_STAT_BY(STAT_EngineSimulatorPlugin_AudioSamples, written);
+    return bDrained;
+}
 
-void FEngineSimulator::FillAudio(USoundWaveProcedural* Wave, const int32 SamplesNeeded)
+void FEngineSimulator::FillAudio(USoundWaveProcedural* Wave, int32 SamplesNeeded)
 {
     // Unreal engine uses a fixed sample size.
     static const uint32 SAMPLE_SIZE = sizeof(uint16);
@@ -487,11 +1107,38 @@ void FEngineSimulator::FillAudio(USoundWaveProcedural* Wave, const int32 Samples
     //    bPlayingSound = true;
     //}
 
+    LastPullCycles.store(FPlatformTime::Cycles64(), std::memory_order_relaxed);
+
     // We're using only one channel.
-    
-    const uint32 SampleCount = SamplesNeeded;// FMath::Min<uint32>(OptimalSampleCount, SamplesNeeded);
-    int16_t* samples = new int16_t[SamplesNeeded];
-    const int readSamples = m_simulator.readAudioOutput(SamplesNeeded, samples);
+    // QueueAudio copies, so hand it the ring memory directly and release it afterwards.
+    const FEngineAudioRingBuffer::FRegions Regions = AudioRing.GetReadRegions(SamplesNeeded);
+    if (Regions.FirstCount > 0)
+    {
+        Wave->QueueAudio((const uint8*)Regions.First, Regions.FirstCount * SAMPLE_SIZE);
+    }
+    if (Regions.SecondCount > 0)
+    {
+        Wave->QueueAudio((const uint8*)Regions.Second, Regions.SecondCount * SAMPLE_SIZE);
+    }
+    if (Parameters.Scopes != nullptr && Parameters.Scopes->IsListening(EEngineSimulatorSignal::Audio)) {
+        const int16* regions[] = { Regions.First, Regions.Second };
+        const uint32 counts[] = { Regions.FirstCount, Regions.SecondCount };
+        for (int r = 0; r < 2; ++r) {
+            for (uint32 i = 0; i < counts[r]; ++i, ++m_scopeAudioSamples) {
+                Parameters.Scopes->Push(EEngineSimulatorSignal::Audio, m_scopeAudioSamples / static_cast<double>(m_outputSampleRate), regions[r][i] / 32768.f);
+            }
+        }
+    }
+
+    AudioRing.CommitRead(Regions.Num());
+    SamplesConsumed.fetch_add(Regions.Num(), std::memory_order_relaxed);
+
+    // The procedural wave pads whatever is missing with silence
+    if (Regions.Num() < (uint32)SamplesNeeded)
+    {
+        Underruns.fetch_add(1, std::memory_order_relaxed);
+        UnderrunSamples.fetch_add(SamplesNeeded - Regions.Num(), std::memory_order_relaxed);
+    }
 
     // If we're not playing, fill the buffer with zeros for silence.
     //if (!bPlayingSound)
@@ -505,7 +1152,7 @@ void FEngineSimulator::FillAudio(USoundWaveProcedural* Wave, const int32 Samples
 
     //uint32 Fraction = 1; // Fraction of a second to play.
     //float Frequency = 1046.5;
-    //uint32 TotalSampleCount = SampleRate / Fraction;
+    //uint32 TotalSampleCount = SynthesizerSampleRate / Fraction;
 
     //Buffer.resize(SampleCount * SAMPLE_SIZE);
     //int16* data = (int16*)&Buffer[0];
@@ -518,11 +1165,10 @@ void FEngineSimulator::FillAudio(USoundWaveProcedural* Wave, const int32 Samples
     //    bPlayingSound = false;
     //}
 
-    Wave->QueueAudio((const uint8*)samples, SampleCount * SAMPLE_SIZE);
 }
 
 
 TUniquePtr<IEngineSimulatorInterface> CreateEngine(const FEngineSimulatorParameters& Parameters)
 {
-    return MakeUnique<FEngineSimulator>(Parameters);
+    return MakeUnique<FEngineSimulator>(Parameters, FEngineDefinitionRegistry::Get().FindOrAdd(Parameters.ScriptPath));
 }
\ No newline at end of file
@@ -4,6 +4,10 @@
 #include "Core.h"
 #include "Modules/ModuleManager.h"
 #include "Interfaces/IPluginManager.h"
+#include "EngineDefinitionRegistry.h"
+#include "EngineSimulatorScheduler.h"
+#include "EngineScriptHotReload.h"
+#include "ChaosVehicleManagerAsyncCallback.h"
 
 #if WITH_GAMEPLAY_DEBUGGER
 #include "GameplayDebugger.h"
@@ -14,6 +18,15 @@
 
 void FEngineSimulatorPluginModule::StartupModule()
 {
+	// Engine steps launched last physics tick have to be done before vehicles read their output this tick
+	PreSimulateVehiclesHandle = FChaosVehicleManagerAsyncCallback::OnPreSimulateVehicles.AddRaw(&FEngineSimulatorScheduler::Get(), &FEngineSimulatorScheduler::Join);
+
+	// Every vehicle has submitted its step by then, launch them, one task each
+	PostSimulateVehiclesHandle = FChaosVehicleManagerAsyncCallback::OnPostSimulateVehicles.AddRaw(&FEngineSimulatorScheduler::Get(), &FEngineSimulatorScheduler::Flush);
+
+	// Editing an engine script reloads the vehicles running it
+	FEngineScriptHotReload::Get().Start();
+
 #if WITH_GAMEPLAY_DEBUGGER
 	IGameplayDebugger& GameplayDebuggerModule = IGameplayDebugger::Get();
 	GameplayDebuggerModule.RegisterCategory("Engine Simulator", IGameplayDebugger::FOnGetCategory::CreateStatic(&FGameplayDebuggerCategory_EngineSimulator::MakeInstance), EGameplayDebuggerCategoryState::EnabledInGameAndSimulate, 5);
@@ -23,6 +36,13 @@ void FEngineSimulatorPluginModule::StartupModule()
 
 void FEngineSimulatorPluginModule::ShutdownModule()
 {
+	FChaosVehicleManagerAsyncCallback::OnPreSimulateVehicles.Remove(PreSimulateVehiclesHandle);
+	FChaosVehicleManagerAsyncCallback::OnPostSimulateVehicles.Remove(PostSimulateVehiclesHandle);
+	FEngineSimulatorScheduler::Get().Join();
+	FEngineScriptHotReload::Get().Stop();
+
+	FEngineDefinitionRegistry::Get().Reset();
+
 #if WITH_GAMEPLAY_DEBUGGER
 	if (IGameplayDebugger::IsAvailable())
 	{
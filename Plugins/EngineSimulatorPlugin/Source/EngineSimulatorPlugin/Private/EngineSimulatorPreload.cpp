@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EngineSimulator.h"
+#include "EngineDefinitionRegistry.h"
+#include "EngineTorqueMap.h"
+#include "EngineWarmStartCache.h"
+
+FEngineSimulatorCreateTask CreateEngineAsync(const FEngineSimulatorParameters& Parameters, TArray<uint8> InitialState)
+{
+	return UE::Tasks::Launch(UE_SOURCE_LOCATION, [Parameters, InitialState = MoveTemp(InitialState)]()
+	{
+		TUniquePtr<IEngineSimulatorInterface> EngineSimulator = Parameters.bSurrogate ? CreateSurrogateEngine(Parameters) : CreateEngine(Parameters);
+		if (InitialState.Num() > 0)
+		{
+			if (!EngineSimulator->LoadState(InitialState))
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Engine state doesn't match %s, only RPM and gear were restored"), *Parameters.ScriptPath);
+			}
+		}
+		else if (Parameters.bWarmStart)
+		{
+			const FEngineDefinitionPtr Definition = FEngineDefinitionRegistry::Get().FindOrAdd(Parameters.ScriptPath);
+			if (const FEngineWarmStartStatePtr WarmState = FEngineWarmStartCache::Get().FindOrRoll(*Definition))
+			{
+				// A surrogate only takes the idle RPM and controls from it, which is all it has anyway
+				EngineSimulator->LoadState(*WarmState);
+			}
+		}
+		return EngineSimulator;
+	});
+}
+
+UE::Tasks::FTask PreloadEngine(const FEngineSimulatorParameters& Parameters, int32 NumEngines)
+{
+	return UE::Tasks::Launch(UE_SOURCE_LOCATION, [Parameters, NumEngines]()
+	{
+		// The registry keeps the definition, and with it the impulse responses, until it's reset. Warm start states and
+		// torque maps are only held while something uses them, but they're written under Saved so loading them again is cheap.
+		const FEngineDefinitionPtr Definition = FEngineDefinitionRegistry::Get().FindOrAdd(Parameters.ScriptPath);
+		if (Parameters.bWarmStart)
+		{
+			FEngineWarmStartCache::Get().FindOrRoll(*Definition);
+		}
+		if (Parameters.bSurrogate)
+		{
+			FEngineTorqueMapCache::Get().FindOrBake(*Definition);
+		}
+
+		// Every engine needs its own graph, the registry only starts with one
+		Definition->ReserveGraphs(NumEngines);
+	});
+}
@@ -0,0 +1,63 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EngineSimulatorScheduler.h"
+#include "EngineSimulatorWheeledVehicleSimulation.h"
+
+FEngineSimulatorScheduler& FEngineSimulatorScheduler::Get()
+{
+	static FEngineSimulatorScheduler Scheduler;
+	return Scheduler;
+}
+
+void FEngineSimulatorScheduler::Submit(FEngineSimulatorInstance& Instance)
+{
+	// Engine creation can take a while when the script has to be compiled, don't make the join wait for it
+	if (!Instance.CreateTask.IsCompleted() || !Instance.StepTask.IsCompleted())
+	{
+		return;
+	}
+
+	FScopeLock Lock(&Mutex);
+	Pending.AddUnique(&Instance);
+}
+
+void FEngineSimulatorScheduler::Retract(FEngineSimulatorInstance& Instance)
+{
+	FScopeLock Lock(&Mutex);
+	Pending.Remove(&Instance);
+}
+
+void FEngineSimulatorScheduler::Flush()
+{
+	FScopeLock Lock(&Mutex);
+	if (Pending.Num() == 0)
+	{
+		return;
+	}
+
+	for (FEngineSimulatorInstance* Instance : Pending)
+	{
+		Instance->StepTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [Instance]()
+		{
+			Instance->Step();
+		});
+		InFlight.Add(Instance->StepTask);
+	}
+
+	Pending.Reset();
+}
+
+void FEngineSimulatorScheduler::Join()
+{
+	// Anything submitted outside the vehicle manager's tick still has to run
+	Flush();
+
+	TArray<UE::Tasks::FTask> Tasks;
+	{
+		FScopeLock Lock(&Mutex);
+		Tasks = MoveTemp(InFlight);
+	}
+
+	// Waiting retracts steps that haven't started yet and runs them on this thread
+	UE::Tasks::Wait(Tasks);
+}
@@ -0,0 +1,42 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tasks/Task.h"
+
+class FEngineSimulatorInstance;
+
+/**
+ * Runs the engine simulation of every vehicle as tasks on the shared task system workers instead of a thread per vehicle.
+ * Steps submitted during a physics tick are launched once every vehicle has been simulated and joined at the start of the
+ * next tick, so the simulation overlaps the rest of the tick the same way the dedicated threads did.
+ *
+ * Every vehicle gets a task of its own. A step is far longer than launching a task, and each engine's state is its own,
+ * so stepping several in one task only takes workers away from the frame. Vehicles sharing an engine definition aren't
+ * stepped together either: engine-sim's Simulator advances each engine's constraint solver and gas systems itself, so
+ * there's nothing to lay out across instances without changing engine-sim.
+ */
+class FEngineSimulatorScheduler
+{
+public:
+	static FEngineSimulatorScheduler& Get();
+
+	// Queues one step with the instance's latest input. At most one step per instance is in flight,
+	// if the previous one hasn't finished yet the next submit picks up the newer input instead.
+	void Submit(FEngineSimulatorInstance& Instance);
+
+	// Drops a queued step that hasn't been launched yet, for instances that are being destroyed
+	void Retract(FEngineSimulatorInstance& Instance);
+
+	// Launches every queued step
+	void Flush();
+
+	// Waits for every step submitted so far
+	void Join();
+
+private:
+	FCriticalSection Mutex;
+	TArray<FEngineSimulatorInstance*> Pending;
+	TArray<UE::Tasks::FTask> InFlight;
+};
@@ -0,0 +1,93 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EngineSimulatorScope.h"
+
+FEngineSimulatorScopes::FEngineSimulatorScopes()
+	: ListeningMask(0)
+{
+	for (uint32 i = 0; i < static_cast<uint32>(EEngineSimulatorSignal::Num); ++i)
+	{
+		Rings[i].store(nullptr, std::memory_order_relaxed);
+		Listeners[i] = 0;
+	}
+}
+
+FEngineSimulatorScopes::~FEngineSimulatorScopes()
+{
+	for (std::atomic<FRing*>& Ring : Rings)
+	{
+		delete Ring.load(std::memory_order_relaxed);
+	}
+}
+
+void FEngineSimulatorScopes::Listen(EEngineSimulatorSignal Signal, int32 Decimation)
+{
+	const uint32 Index = static_cast<uint32>(Signal);
+	if (Index >= static_cast<uint32>(EEngineSimulatorSignal::Num))
+	{
+		return;
+	}
+
+	FScopeLock Lock(&ListenMutex);
+
+	FRing* Ring = Rings[Index].load(std::memory_order_relaxed);
+	if (Ring == nullptr)
+	{
+		Ring = new FRing();
+		Rings[Index].store(Ring, std::memory_order_release);
+	}
+	Ring->Decimation.store(FMath::Max(Decimation, 1), std::memory_order_relaxed);
+
+	if (Listeners[Index]++ == 0)
+	{
+		ListeningMask.fetch_or(1u << Index, std::memory_order_relaxed);
+	}
+}
+
+void FEngineSimulatorScopes::StopListening(EEngineSimulatorSignal Signal)
+{
+	const uint32 Index = static_cast<uint32>(Signal);
+	if (Index >= static_cast<uint32>(EEngineSimulatorSignal::Num))
+	{
+		return;
+	}
+
+	FScopeLock Lock(&ListenMutex);
+	if (Listeners[Index] > 0 && --Listeners[Index] == 0)
+	{
+		ListeningMask.fetch_and(~(1u << Index), std::memory_order_relaxed);
+	}
+}
+
+int32 FEngineSimulatorScopes::Read(EEngineSimulatorSignal Signal, TArray<FVector2D>& OutPoints, int32 MaxPoints) const
+{
+	OutPoints.Reset();
+
+	const uint32 Index = static_cast<uint32>(Signal);
+	const FRing* Ring = Index < static_cast<uint32>(EEngineSimulatorSignal::Num) ? Rings[Index].load(std::memory_order_acquire) : nullptr;
+	if (Ring == nullptr || MaxPoints <= 0)
+	{
+		return 0;
+	}
+
+	const uint32 End = Ring->WriteIndex.load(std::memory_order_acquire);
+	const uint32 Count = FMath::Min3(End, Capacity, static_cast<uint32>(MaxPoints));
+	const uint32 Start = End - Count;
+
+	OutPoints.SetNumUninitialized(Count);
+	for (uint32 i = 0; i < Count; ++i)
+	{
+		const uint32 Slot = (Start + i) % Capacity;
+		OutPoints[i] = FVector2D(Ring->X[Slot], Ring->Y[Slot]);
+	}
+
+	// The writer may have come round again while we copied, anything it could have touched is dropped
+	const uint32 After = Ring->WriteIndex.load(std::memory_order_acquire);
+	const uint32 Lapped = After + 1 > Start + Capacity ? After + 1 - (Start + Capacity) : 0;
+	if (Lapped > 0)
+	{
+		OutPoints.RemoveAt(0, FMath::Min(Lapped, Count), false);
+	}
+
+	return OutPoints.Num();
+}
@@ -0,0 +1,49 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EngineSimulatorState.h"
+
+static const uint32 EngineSimulatorStateMagic = 0x45534d53; // "ESMS"
+
+// Bump this whenever the header or either implementation's snapshot layout changes
+static const uint16 EngineSimulatorStateVersion = 4;
+
+FEngineSimulatorStateHeader::FEngineSimulatorStateHeader(EKind InKind, const FString& DefinitionKey, const FEngineSimulatorHandoffState& InHandoff)
+	: Magic(EngineSimulatorStateMagic)
+	, Version(EngineSimulatorStateVersion)
+	, Kind(InKind)
+	, DefinitionHash(GetTypeHash(DefinitionKey))
+	, Handoff(InHandoff)
+{
+}
+
+bool FEngineSimulatorStateHeader::Matches(const FEngineSimulatorStateHeader& Expected) const
+{
+	return IsValid() && Kind == Expected.Kind && DefinitionHash == Expected.DefinitionHash;
+}
+
+bool FEngineSimulatorStateHeader::IsValid() const
+{
+	return Magic == EngineSimulatorStateMagic && Version == EngineSimulatorStateVersion;
+}
+
+FArchive& operator<<(FArchive& Ar, FEngineSimulatorStateHeader& Header)
+{
+	Ar << Header.Magic;
+	Ar << Header.Version;
+	if (Header.Magic != EngineSimulatorStateMagic || Header.Version != EngineSimulatorStateVersion)
+	{
+		Ar.SetError();
+		return Ar;
+	}
+
+	Ar << Header.Kind;
+	Ar << Header.DefinitionHash;
+	Ar << Header.Handoff.RPM;
+	Ar << Header.Handoff.Gear;
+	Ar << Header.Handoff.SpeedControl;
+	Ar << Header.Handoff.ClutchPressure;
+	Ar << Header.Handoff.bStarterEnabled;
+	Ar << Header.Handoff.bIgnitionEnabled;
+	Ar << Header.Handoff.bDynoEnabled;
+	return Ar;
+}
@@ -0,0 +1,36 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EngineSimulator.h"
+
+/**
+ * Leads every engine state snapshot. The handoff state is always there, so a snapshot taken from a different engine
+ * or the other implementation can still carry RPM, gear and controls over. The rest is only restored into the same
+ * kind of engine built from the same definition.
+ */
+struct FEngineSimulatorStateHeader
+{
+	enum class EKind : uint8
+	{
+		Simulator,
+		Surrogate
+	};
+
+	uint32 Magic = 0;
+	uint16 Version = 0;
+	EKind Kind = EKind::Simulator;
+	uint32 DefinitionHash = 0;
+	FEngineSimulatorHandoffState Handoff;
+
+	FEngineSimulatorStateHeader() = default;
+	FEngineSimulatorStateHeader(EKind InKind, const FString& DefinitionKey, const FEngineSimulatorHandoffState& InHandoff);
+
+	// Whether the data after the header can be restored by an engine that would write Expected
+	bool Matches(const FEngineSimulatorStateHeader& Expected) const;
+
+	bool IsValid() const;
+
+	friend FArchive& operator<<(FArchive& Ar, FEngineSimulatorStateHeader& Header);
+};
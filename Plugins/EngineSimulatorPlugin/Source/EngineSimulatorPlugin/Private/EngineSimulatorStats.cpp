@@ -0,0 +1,94 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EngineSimulatorStats.h"
+
+UE_TRACE_CHANNEL_DEFINE(EngineSimulatorChannel);
+
+DEFINE_STAT(STAT_EngineSimulatorPlugin_LODFull);
+DEFINE_STAT(STAT_EngineSimulatorPlugin_LODReduced);
+DEFINE_STAT(STAT_EngineSimulatorPlugin_LODSilent);
+DEFINE_STAT(STAT_EngineSimulatorPlugin_LODMinimal);
+
+DEFINE_STAT(STAT_EngineSimulatorPlugin_Frames);
+DEFINE_STAT(STAT_EngineSimulatorPlugin_Steps);
+DEFINE_STAT(STAT_EngineSimulatorPlugin_DegradedFrames);
+DEFINE_STAT(STAT_EngineSimulatorPlugin_AudioSamples);
+
+struct FEngineSimulatorStatSlot::FEntry
+{
+	FString Name;
+	bool bInUse = false;
+#if STATS
+	TStatId StatId;
+#endif
+#if COUNTERSTRACE_ENABLED
+	uint16 StepsCounter = 0;
+	uint16 MicrosecondsPerStepCounter = 0;
+#endif
+};
+
+FCriticalSection FEngineSimulatorStatSlot::SlotsMutex;
+TMap<FString, TArray<TUniquePtr<FEngineSimulatorStatSlot::FEntry>>> FEngineSimulatorStatSlot::Slots;
+
+void FEngineSimulatorStatSlot::Acquire(const FString& EngineName)
+{
+	Release();
+
+	FScopeLock Lock(&SlotsMutex);
+	TArray<TUniquePtr<FEntry>>& Named = Slots.FindOrAdd(EngineName);
+	for (const TUniquePtr<FEntry>& Slot : Named)
+	{
+		if (!Slot->bInUse)
+		{
+			Entry = Slot.Get();
+			Entry->bInUse = true;
+			return;
+		}
+	}
+
+	Entry = Named.Add_GetRef(MakeUnique<FEntry>()).Get();
+	Entry->Name = FString::Printf(TEXT("%s #%d"), *EngineName, Named.Num() - 1);
+	Entry->bInUse = true;
+#if STATS
+	Entry->StatId = FDynamicStats::CreateStatId<FStatGroup_STATGROUP_EngineSimulatorPlugin>(Entry->Name);
+#endif
+#if COUNTERSTRACE_ENABLED
+	const FString Prefix = FString::Printf(TEXT("EngineSimulator/%s/"), *Entry->Name);
+	Entry->StepsCounter = FCountersTrace::OutputInitCounter(*(Prefix + TEXT("IterationsPerFrame")), TraceCounterType_Int, TraceCounterDisplayHint_None);
+	Entry->MicrosecondsPerStepCounter = FCountersTrace::OutputInitCounter(*(Prefix + TEXT("MicrosecondsPerStep")), TraceCounterType_Float, TraceCounterDisplayHint_None);
+#endif
+}
+
+void FEngineSimulatorStatSlot::Release()
+{
+	if (Entry != nullptr)
+	{
+		FScopeLock Lock(&SlotsMutex);
+		Entry->bInUse = false;
+		Entry = nullptr;
+	}
+}
+
+const FString& FEngineSimulatorStatSlot::GetName() const
+{
+	check(Entry != nullptr);
+	return Entry->Name;
+}
+
+#if STATS
+TStatId FEngineSimulatorStatSlot::GetStatId() const
+{
+	return Entry != nullptr ? Entry->StatId : TStatId();
+}
+#endif
+
+void FEngineSimulatorStatSlot::SetStepCounters(int32 Steps, double MicrosecondsPerStep) const
+{
+#if COUNTERSTRACE_ENABLED
+	if (Entry != nullptr)
+	{
+		FCountersTrace::OutputSetValue(Entry->StepsCounter, static_cast<int64>(Steps));
+		FCountersTrace::OutputSetValue(Entry->MicrosecondsPerStepCounter, MicrosecondsPerStep);
+	}
+#endif
+}
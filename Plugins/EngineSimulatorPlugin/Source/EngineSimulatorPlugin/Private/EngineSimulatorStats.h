@@ -0,0 +1,66 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "Trace/Trace.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "ProfilingDebugging/CountersTrace.h"
+
+DECLARE_STATS_GROUP(TEXT("EngineSimulatorPlugin"), STATGROUP_EngineSimulatorPlugin, STATGROUP_Advanced);
+
+// Enable with -trace=cpu,EngineSimulator to get the scopes below in Insights from builds without stats
+UE_TRACE_CHANNEL_EXTERN(EngineSimulatorChannel);
+
+// Cycle stat for `stat EngineSimulatorPlugin`, which Insights shows as a scope when tracing cpu. Builds without stats get
+// the scope on the EngineSimulator channel instead, never both.
+#if STATS
+#define ENGINESIMULATOR_SCOPE_CYCLE_COUNTER(Stat) SCOPE_CYCLE_COUNTER(Stat)
+#else
+#define ENGINESIMULATOR_SCOPE_CYCLE_COUNTER(Stat) TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL(Stat, EngineSimulatorChannel)
+#endif
+
+// Engines in each LOD tier, counted every frame
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Engines at Full LOD"), STAT_EngineSimulatorPlugin_LODFull, STATGROUP_EngineSimulatorPlugin, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Engines at Reduced LOD"), STAT_EngineSimulatorPlugin_LODReduced, STATGROUP_EngineSimulatorPlugin, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Engines at Silent LOD"), STAT_EngineSimulatorPlugin_LODSilent, STATGROUP_EngineSimulatorPlugin, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Engines at Minimal LOD"), STAT_EngineSimulatorPlugin_LODMinimal, STATGROUP_EngineSimulatorPlugin, );
+
+// Work done by the simulators this frame, across every engine
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Engine frames simulated"), STAT_EngineSimulatorPlugin_Frames, STATGROUP_EngineSimulatorPlugin, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Simulation steps"), STAT_EngineSimulatorPlugin_Steps, STATGROUP_EngineSimulatorPlugin, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Engines over step budget"), STAT_EngineSimulatorPlugin_DegradedFrames, STATGROUP_EngineSimulatorPlugin, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Audio samples produced"), STAT_EngineSimulatorPlugin_AudioSamples, STATGROUP_EngineSimulatorPlugin, );
+
+/**
+ * One engine's name, stat and trace counters, "<engine name> #<n>". An engine takes the lowest n no running engine of
+ * the same name has, and the stat and counters behind each name are made once and reused by whoever takes it next, so
+ * respawning vehicles doesn't keep adding entries.
+ */
+class FEngineSimulatorStatSlot : public FNoncopyable
+{
+public:
+	FEngineSimulatorStatSlot() = default;
+	~FEngineSimulatorStatSlot() { Release(); }
+
+	// Gives up the slot held, if any, and takes one for EngineName
+	void Acquire(const FString& EngineName);
+	void Release();
+
+	const FString& GetName() const;
+#if STATS
+	TStatId GetStatId() const;
+#endif
+
+	// Steps taken in the frame just simulated and what they cost, as this engine's counters in Insights
+	void SetStepCounters(int32 Steps, double MicrosecondsPerStep) const;
+
+private:
+	struct FEntry;
+	FEntry* Entry = nullptr;
+
+	// Every slot ever taken, by engine name. Entries are never freed, there are only as many as engines ever ran at once.
+	static FCriticalSection SlotsMutex;
+	static TMap<FString, TArray<TUniquePtr<FEntry>>> Slots;
+};
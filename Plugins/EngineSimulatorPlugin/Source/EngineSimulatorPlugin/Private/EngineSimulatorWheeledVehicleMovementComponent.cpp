@@ -7,6 +7,16 @@
 #include "Sound/SoundWaveProcedural.h"
 #include "ChaosVehicleManager.h"
 #include "EngineSimulator.h"
+#include "EngineSimulatorStats.h"
+#include "EngineDefinitionRegistry.h"
+#include "EngineTorqueMap.h"
+#include "EngineTelemetry.h"
+#include "Camera/PlayerCameraManager.h"
+#include "Components/AudioComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "Sound/SoundAttenuation.h"
+#include "AudioDevice.h"
+#include "Misc/App.h"
 
 #if WITH_GAMEPLAY_DEBUGGER
 #include "GameplayDebuggerCategory.h"
@@ -18,7 +28,7 @@ UEngineSimulatorWheeledVehicleMovementComponent::UEngineSimulatorWheeledVehicleM
 	PrimaryComponentTick.bCanEverTick = true;
 
 	OutputEngineSound = CreateDefaultSubobject<USoundWaveProcedural>(FName("Engine Sound Output"));
-	OutputEngineSound->SetSampleRate(44000);
+	OutputEngineSound->SetSampleRate(EngineSoundSampleRate);
 	OutputEngineSound->NumChannels = 1;
 	OutputEngineSound->Duration = INDEFINITELY_LOOPING_DURATION;
 	OutputEngineSound->SoundGroup = SOUNDGROUP_Default;
@@ -31,10 +41,151 @@ void UEngineSimulatorWheeledVehicleMovementComponent::TickComponent(float DeltaT
 	if (VehicleSimulationPT.Get())
 	{
 		UEngineSimulatorWheeledVehicleSimulation* VS = ((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get());
-		LastEngineSimulatorOutput = VS->GetLastOutput();
+		VS->GetLastOutput(LastEngineSimulatorOutput);
+
+		UpdateLOD();
 	}
 }
 
+void UEngineSimulatorWheeledVehicleMovementComponent::PostLoad()
+{
+	Super::PostLoad();
+
+	// Blueprint templates count too, that's where spawned vehicles get their script from
+	if (FApp::IsGame() && !IsRunningCommandlet() && !HasAnyFlags(RF_ClassDefaultObject))
+	{
+		PreloadEngine(MakeEngineSimulatorParameters());
+	}
+}
+
+void UEngineSimulatorWheeledVehicleMovementComponent::UpdateLOD()
+{
+	const EEngineSimulatorLOD NewLOD = bEnableLOD ? ComputeLOD() : EEngineSimulatorLOD::Full;
+	if (NewLOD != CurrentLOD)
+	{
+		CurrentLOD = NewLOD;
+		((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->AsyncUpdateSimulation(FEngineSimulatorCommand::SetLOD(NewLOD));
+	}
+
+	switch (CurrentLOD)
+	{
+	case EEngineSimulatorLOD::Full:
+		INC_DWORD_STAT(STAT_EngineSimulatorPlugin_LODFull);
+		break;
+	case EEngineSimulatorLOD::Reduced:
+		INC_DWORD_STAT(STAT_EngineSimulatorPlugin_LODReduced);
+		break;
+	case EEngineSimulatorLOD::Silent:
+		INC_DWORD_STAT(STAT_EngineSimulatorPlugin_LODSilent);
+		break;
+	case EEngineSimulatorLOD::Minimal:
+		INC_DWORD_STAT(STAT_EngineSimulatorPlugin_LODMinimal);
+		break;
+	default:
+		break;
+	}
+}
+
+EEngineSimulatorLOD UEngineSimulatorWheeledVehicleMovementComponent::ComputeLOD() const
+{
+	const UWorld* World = GetWorld();
+	const AActor* Owner = GetOwner();
+	if (World == nullptr || Owner == nullptr)
+	{
+		return CurrentLOD;
+	}
+
+	FVector Origin;
+	FVector Extent;
+	Owner->GetActorBounds(true, Origin, Extent);
+
+	float Distance = TNumericLimits<float>::Max();
+	float ScreenSize = 0.f;
+	for (FConstPlayerControllerIterator It = World->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		if (PlayerController == nullptr || !PlayerController->IsLocalController() || PlayerController->PlayerCameraManager == nullptr)
+		{
+			continue;
+		}
+
+		const APlayerCameraManager* CameraManager = PlayerController->PlayerCameraManager;
+		const float CameraDistance = FMath::Max(FVector::Dist(CameraManager->GetCameraLocation(), Origin), 1.f);
+		const float HalfFOV = FMath::DegreesToRadians(CameraManager->GetFOVAngle() * 0.5f);
+
+		Distance = FMath::Min(Distance, CameraDistance);
+		ScreenSize = FMath::Max(ScreenSize, Extent.Size() / (CameraDistance * FMath::Tan(HalfFOV)));
+	}
+
+	// Nobody is looking (e.g. a dedicated server), leave it where it is
+	if (Distance == TNumericLimits<float>::Max())
+	{
+		return CurrentLOD;
+	}
+
+	// A threshold the engine is already past has to be undershot by the hysteresis band before it moves back
+	auto IsPast = [this](float Value, float Threshold, EEngineSimulatorLOD Tier)
+	{
+		return Value > Threshold * (CurrentLOD >= Tier ? 1.f - LODHysteresis : 1.f);
+	};
+
+	EEngineSimulatorLOD LOD = EEngineSimulatorLOD::Full;
+	if (IsPast(Distance, ReducedLODDistance, EEngineSimulatorLOD::Reduced))
+	{
+		LOD = EEngineSimulatorLOD::Reduced;
+	}
+	if (IsPast(Distance, SilentLODDistance, EEngineSimulatorLOD::Silent))
+	{
+		LOD = EEngineSimulatorLOD::Silent;
+	}
+	if (IsPast(Distance, MinimalLODDistance, EEngineSimulatorLOD::Minimal))
+	{
+		LOD = EEngineSimulatorLOD::Minimal;
+	}
+
+	const bool bAudible = !IsPast(Distance, GetAudibleDistance(), EEngineSimulatorLOD::Silent);
+	if (!bAudible)
+	{
+		LOD = FMath::Max(LOD, EEngineSimulatorLOD::Silent);
+	}
+
+	const float ScreenSizeThreshold = FullLODScreenSize * (CurrentLOD == EEngineSimulatorLOD::Full ? 1.f - LODHysteresis : 1.f);
+	if (ScreenSize >= ScreenSizeThreshold)
+	{
+		LOD = FMath::Min(LOD, bAudible ? EEngineSimulatorLOD::Full : EEngineSimulatorLOD::Silent);
+	}
+
+	return LOD;
+}
+
+float UEngineSimulatorWheeledVehicleMovementComponent::GetAudibleDistance() const
+{
+	// The engine sound is played by whichever audio component on the owner uses OutputEngineSound
+	TInlineComponentArray<UAudioComponent*> AudioComponents(GetOwner());
+	for (const UAudioComponent* AudioComponent : AudioComponents)
+	{
+		if (AudioComponent->Sound != OutputEngineSound)
+		{
+			continue;
+		}
+
+		if (!AudioComponent->IsPlaying())
+		{
+			return 0.f;
+		}
+
+		const FSoundAttenuationSettings* Attenuation = AudioComponent->GetAttenuationSettingsToApply();
+		if (Attenuation != nullptr && Attenuation->bAttenuate)
+		{
+			return Attenuation->GetMaxDimension();
+		}
+		break;
+	}
+
+	// Played from somewhere else or without attenuation, assume it can always be heard
+	return TNumericLimits<float>::Max();
+}
+
 void UEngineSimulatorWheeledVehicleMovementComponent::SetEngineSimChangeGearUp(bool bNewGearUp)
 {
 	if (VehicleSimulationPT && bNewGearUp)
@@ -42,10 +193,7 @@ void UEngineSimulatorWheeledVehicleMovementComponent::SetEngineSimChangeGearUp(b
 		if (CurrentGear != FMath::Clamp(CurrentGear + 1, -1, LastEngineSimulatorOutput.NumGears - 1))
 		{
 			CurrentGear = FMath::Clamp(CurrentGear + 1, -1, LastEngineSimulatorOutput.NumGears - 1);
-			((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->AsyncUpdateSimulation([=](IEngineSimulatorInterface* EngineInterface)
-			{
-				EngineInterface->SetGear(CurrentGear);
-			});
+			((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->AsyncUpdateSimulation(FEngineSimulatorCommand::SetGear(CurrentGear));
 		}
 	}
 }
@@ -55,42 +203,63 @@ void UEngineSimulatorWheeledVehicleMovementComponent::SetEngineSimChangeGearDown
 	if (VehicleSimulationPT && bNewGearDown)
 	{
 		CurrentGear = FMath::Clamp(CurrentGear - 1, -1, LastEngineSimulatorOutput.NumGears - 1);
-		((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->AsyncUpdateSimulation([=](IEngineSimulatorInterface* EngineInterface)
-		{
-			EngineInterface->SetGear(CurrentGear);
-		});
+		((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->AsyncUpdateSimulation(FEngineSimulatorCommand::SetGear(CurrentGear));
 	}
 }
 
-void UEngineSimulatorWheeledVehicleMovementComponent::RespawnEngine()
+void UEngineSimulatorWheeledVehicleMovementComponent::RespawnEngine(bool bKeepRunning)
 {
-	FEngineSimulatorParameters EngineParameters;
-	EngineParameters.bShowGUI = false;
-	EngineParameters.SoundWaveOutput = OutputEngineSound;
+	FEngineSimulatorParameters EngineParameters = MakeEngineSimulatorParameters();
 
 	// Make the Vehicle Simulation class that will be updated from the physics thread async callback
-	((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->Reset(EngineParameters);
+	((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->Reset(EngineParameters, bKeepRunning);
 
-	((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->AsyncUpdateSimulation([=](IEngineSimulatorInterface* EngineInterface)
+	// AudioSampleRate or the audio device may have changed since the engine was created
+	SetEngineSoundSampleRate(EngineParameters.OutputSampleRate);
+
+	if (bKeepRunning)
 	{
-		EngineInterface->SetIgnitionEnabled(true);
-		EngineInterface->SetStarterEnabled(bStarterAutomaticallyEnabled);
-	});
+		// Gear, starter and ignition come back with the state
+		((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->AsyncUpdateSimulation(FEngineSimulatorCommand::SetLOD(CurrentLOD));
+		return;
+	}
 
-	bStarterEnabled = bStarterAutomaticallyEnabled;
+	// A warm started engine is already idling, the starter would only drag on it. The instance still puts it on the
+	// starter if no warm state could be applied, see bStarterIfStalled.
+	const bool bStarter = bStarterAutomaticallyEnabled && !bWarmStart;
+
+	((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->AsyncUpdateSimulation(FEngineSimulatorCommand::SetLOD(CurrentLOD));
+	((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->AsyncUpdateSimulation(FEngineSimulatorCommand::SetIgnition(true));
+	((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->AsyncUpdateSimulation(FEngineSimulatorCommand::SetStarter(bStarter));
+
+	bStarterEnabled = bStarter;
 	CurrentGear = -1;
 }
 
+bool UEngineSimulatorWheeledVehicleMovementComponent::SaveEngineState(TArray<uint8>& OutState)
+{
+	return VehicleSimulationPT && ((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->SaveEngineState(OutState);
+}
+
+bool UEngineSimulatorWheeledVehicleMovementComponent::RestoreEngineState(const TArray<uint8>& State)
+{
+	if (!VehicleSimulationPT)
+	{
+		return false;
+	}
+
+	int32 Gear = CurrentGear;
+	const bool bRestored = ((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->LoadEngineState(State, Gear);
+	CurrentGear = Gear;
+	return bRestored;
+}
+
 void UEngineSimulatorWheeledVehicleMovementComponent::SetClutchPressure(float Pressure)
 {
 	ClutchPressure = Pressure;
 	if (VehicleSimulationPT)
 	{
-		((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->AsyncUpdateSimulation([=](IEngineSimulatorInterface* EngineInterface)
-			{
-				EngineInterface->SetClutchPressure(Pressure);
-			}
-		);
+		((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->AsyncUpdateSimulation(FEngineSimulatorCommand::SetClutchPressure(Pressure));
 	}
 }
 
@@ -99,30 +268,179 @@ void UEngineSimulatorWheeledVehicleMovementComponent::SetStarterEnabled(bool bEn
 	bStarterEnabled = bEnabled;
 	if (VehicleSimulationPT)
 	{
-		((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->AsyncUpdateSimulation([=](IEngineSimulatorInterface* EngineInterface)
-			{
-				EngineInterface->SetStarterEnabled(bStarterEnabled);
-			}
-		);
+		((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->AsyncUpdateSimulation(FEngineSimulatorCommand::SetStarter(bStarterEnabled));
 	}
 }
 
-TUniquePtr<Chaos::FSimpleWheeledVehicle> UEngineSimulatorWheeledVehicleMovementComponent::CreatePhysicsVehicle() 
+void UEngineSimulatorWheeledVehicleMovementComponent::SetUseSurrogate(bool bInUseSurrogate)
+{
+	bUseSurrogate = bInUseSurrogate;
+	if (VehicleSimulationPT)
+	{
+		((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->SetUseSurrogate(bUseSurrogate);
+	}
+}
+
+void UEngineSimulatorWheeledVehicleMovementComponent::ApplyBakedTorqueCurve()
+{
+	const FEngineDefinitionPtr Definition = FEngineDefinitionRegistry::Get().FindOrAdd(EngineScript);
+	const FEngineTorqueMapPtr Map = Definition.IsValid() ? FEngineTorqueMapCache::Get().FindOrBake(*Definition) : nullptr;
+	if (!Map.IsValid())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("No torque map for %s"), *EngineScript);
+		return;
+	}
+
+	Modify();
+	Map->ToEngineConfig(EngineSetup);
+}
+
+FString UEngineSimulatorWheeledVehicleMovementComponent::StartEngineTelemetry(const FString& FileName)
+{
+	if (!VehicleSimulationPT)
+	{
+		return FString();
+	}
+
+	const FString Name = FileName.IsEmpty() ? FString::Printf(TEXT("%s_%s"), *GetNameSafe(GetOwner()), *FDateTime::Now().ToString()) : FileName;
+	const FString Path = FPaths::ConvertRelativePathToFull(FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("EngineSimulator"), TEXT("Telemetry"), Name + TEXT(".estl")));
+
+	const FEngineTelemetryRecorderPtr Recorder = FEngineTelemetryRecorder::Create(Path);
+	if (!Recorder.IsValid())
+	{
+		return FString();
+	}
+
+	((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->SetTelemetryRecorder(Recorder);
+	return Path;
+}
+
+void UEngineSimulatorWheeledVehicleMovementComponent::StopEngineTelemetry()
+{
+	if (VehicleSimulationPT)
+	{
+		((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->SetTelemetryRecorder(nullptr);
+	}
+}
+
+void UEngineSimulatorWheeledVehicleMovementComponent::ListenToEngineSignal(EEngineSimulatorSignal Signal, int32 Decimation)
+{
+	if (VehicleSimulationPT)
+	{
+		((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->GetScopes().Listen(Signal, Decimation);
+	}
+}
+
+void UEngineSimulatorWheeledVehicleMovementComponent::StopListeningToEngineSignal(EEngineSimulatorSignal Signal)
+{
+	if (VehicleSimulationPT)
+	{
+		((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->GetScopes().StopListening(Signal);
+	}
+}
+
+int32 UEngineSimulatorWheeledVehicleMovementComponent::ReadEngineSignal(EEngineSimulatorSignal Signal, TArray<FVector2D>& OutPoints, int32 MaxPoints) const
+{
+	if (!VehicleSimulationPT)
+	{
+		OutPoints.Reset();
+		return 0;
+	}
+	return ((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->GetScopes().Read(Signal, OutPoints, MaxPoints);
+}
+
+void UEngineSimulatorWheeledVehicleMovementComponent::PreloadEngineScripts(const TArray<FString>& EngineScripts, bool bPreloadWarmStart, bool bPreloadSurrogate, int32 NumVehicles)
+{
+	for (const FString& Script : EngineScripts)
+	{
+		FEngineSimulatorParameters EngineParameters;
+		EngineParameters.ScriptPath = Script;
+		EngineParameters.bWarmStart = bPreloadWarmStart;
+		EngineParameters.bSurrogate = bPreloadSurrogate;
+		PreloadEngine(EngineParameters, NumVehicles);
+	}
+}
+
+FEngineSimulatorParameters UEngineSimulatorWheeledVehicleMovementComponent::MakeEngineSimulatorParameters() const
 {
 	FEngineSimulatorParameters EngineParameters;
 	EngineParameters.bShowGUI = false;
 	EngineParameters.SoundWaveOutput = OutputEngineSound;
+	EngineParameters.ScriptPath = EngineScript;
+	EngineParameters.bPartitionedConvolution = bPartitionedConvolution;
+	EngineParameters.OutputSampleRate = GetEngineSoundSampleRate();
+	EngineParameters.bSurrogate = bUseSurrogate;
+	EngineParameters.bInlineStepping = bInlineStepping;
+	EngineParameters.StepBudgetMs = SimulationBudgetMs;
+	EngineParameters.bWarmStart = bWarmStart;
+	EngineParameters.bStarterIfStalled = bStarterAutomaticallyEnabled;
+	return EngineParameters;
+}
+
+int32 UEngineSimulatorWheeledVehicleMovementComponent::GetEngineSoundSampleRate() const
+{
+	if (AudioSampleRate > 0)
+	{
+		return AudioSampleRate;
+	}
+
+	const UWorld* World = GetWorld();
+	if (World != nullptr)
+	{
+		const FAudioDeviceHandle AudioDevice = World->GetAudioDevice();
+		if (AudioDevice.IsValid() && AudioDevice->GetSampleRate() > 0.f)
+		{
+			return FMath::RoundToInt(AudioDevice->GetSampleRate());
+		}
+	}
+
+	return 44100;
+}
+
+void UEngineSimulatorWheeledVehicleMovementComponent::SetEngineSoundSampleRate(int32 SampleRate)
+{
+	if (SampleRate == EngineSoundSampleRate)
+	{
+		return;
+	}
+
+	EngineSoundSampleRate = SampleRate;
+	OutputEngineSound->SetSampleRate(SampleRate);
+
+	// Sources only read the wave's rate when they start
+	if (AActor* Owner = GetOwner())
+	{
+		TInlineComponentArray<UAudioComponent*> AudioComponents(Owner);
+		for (UAudioComponent* AudioComponent : AudioComponents)
+		{
+			if (AudioComponent->Sound == OutputEngineSound && AudioComponent->IsPlaying())
+			{
+				AudioComponent->Stop();
+				AudioComponent->Play();
+			}
+		}
+	}
+}
+
+TUniquePtr<Chaos::FSimpleWheeledVehicle> UEngineSimulatorWheeledVehicleMovementComponent::CreatePhysicsVehicle() 
+{
+	FEngineSimulatorParameters EngineParameters = MakeEngineSimulatorParameters();
+
+	// The wave has to play at whatever rate the engine produces, or the engine sound is off pitch
+	SetEngineSoundSampleRate(EngineParameters.OutputSampleRate);
 
 	// Make the Vehicle Simulation class that will be updated from the physics thread async callback
 	VehicleSimulationPT = MakeUnique<UEngineSimulatorWheeledVehicleSimulation>(Wheels, EngineParameters);
 
-	((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->AsyncUpdateSimulation([=](IEngineSimulatorInterface* EngineInterface)
-	{
-		EngineInterface->SetIgnitionEnabled(true);
-		EngineInterface->SetStarterEnabled(bStarterAutomaticallyEnabled);
-	});
+	// A warm started engine is already idling, the starter would only drag on it. The instance still puts it on the
+	// starter if no warm state could be applied, see bStarterIfStalled.
+	const bool bStarter = bStarterAutomaticallyEnabled && !bWarmStart;
+
+	((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->AsyncUpdateSimulation(FEngineSimulatorCommand::SetLOD(CurrentLOD));
+	((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->AsyncUpdateSimulation(FEngineSimulatorCommand::SetIgnition(true));
+	((UEngineSimulatorWheeledVehicleSimulation*)VehicleSimulationPT.Get())->AsyncUpdateSimulation(FEngineSimulatorCommand::SetStarter(bStarter));
 
-	bStarterEnabled = bStarterAutomaticallyEnabled;
+	bStarterEnabled = bStarter;
 	CurrentGear = -1;
 
 	return UChaosVehicleMovementComponent::CreatePhysicsVehicle();
@@ -4,6 +4,11 @@
 #include "EngineSimulatorWheeledVehicleMovementComponent.h"
 #include "ChaosVehicleMovementComponent.h"
 #include "EngineSimulator.h"
+#include "EngineSimulatorScheduler.h"
+#include "EngineScriptHotReload.h"
+#include "EngineTelemetry.h"
+#include "EngineWarmStartCache.h"
+#include "EngineSimulatorStats.h"
 #include "VehicleUtility.h"
 #include "Sound/SoundWaveProcedural.h"
 #include "ChaosVehicleManager.h"
@@ -12,168 +17,333 @@
 #include "GameplayDebuggerCategory.h"
 #endif // WITH_GAMEPLAY_DEBUGGER
 
-DECLARE_STATS_GROUP(TEXT("EngineSimulatorPlugin"), STATGROUP_EngineSimulatorPlugin, STATGROUP_Advanced);
-DECLARE_CYCLE_STAT(TEXT("EngineThread:UpdateSimulation"), STAT_EngineSimulatorPlugin_UpdateSimulation, STATGROUP_EngineSimulatorPlugin);
+DECLARE_CYCLE_STAT(TEXT("EngineSimulator:UpdateSimulation"), STAT_EngineSimulatorPlugin_UpdateSimulation, STATGROUP_EngineSimulatorPlugin);
+DECLARE_CYCLE_STAT(TEXT("EngineSimulator:DrainCommands"), STAT_EngineSimulatorPlugin_DrainCommands, STATGROUP_EngineSimulatorPlugin);
+// How long after spawning a warm started engine is watched for having come up stopped or stalling
+static const float WarmStartWatchSeconds = 3.f;
 
-FEngineSimulatorThread::FEngineSimulatorThread(const FEngineSimulatorParameters& InParameters)
-	: bStopRequested(false)
-	, Semaphore(FGenericPlatformProcess::GetSynchEventFromPool(false))
-	, Parameters(InParameters)
-	, Thread(FRunnableThread::Create(this, TEXT("Engine Simulator Thread"))) // TODO: change this later
+DECLARE_CYCLE_STAT(TEXT("EngineSimulator:PublishOutput"), STAT_EngineSimulatorPlugin_PublishOutput, STATGROUP_EngineSimulatorPlugin);
+
+FEngineSimulatorInstance::FEngineSimulatorInstance(const FEngineSimulatorParameters& InParameters, TArray<uint8> InitialState)
+	: Parameters(InParameters)
+	, bWantSurrogate(InParameters.bSurrogate)
+	, bSurrogateActive(InParameters.bSurrogate)
 {
-	
+	// A snapshot to carry on from replaces the warm start
+	if (Parameters.bWarmStart && Parameters.bStarterIfStalled && InitialState.Num() == 0)
+	{
+		WarmStartWatchTime = WarmStartWatchSeconds;
+	}
+
+	CreateTask = CreateEngineAsync(Parameters, MoveTemp(InitialState));
+	FEngineScriptHotReload::Get().Register(*this);
 }
 
-FEngineSimulatorThread::~FEngineSimulatorThread()
+FEngineSimulatorInstance::~FEngineSimulatorInstance()
 {
-	if (Thread)
+	FEngineScriptHotReload::Get().Unregister(*this);
+	FEngineSimulatorScheduler::Get().Retract(*this);
+	CreateTask.Wait();
+	StepTask.Wait();
+	SwitchTask.Wait();
+	ReloadTask.Wait();
+
 	{
-		Thread->Kill(true);
-		delete Thread;
-		Thread = nullptr;
+		FScopeLock Lock(&AudioMutex);
+		AudioEngine = nullptr;
 	}
 
-	FGenericPlatformProcess::ReturnSynchEventToPool(Semaphore);
-	Semaphore = nullptr;
+	EngineSimulator.Reset();
+	InactiveSimulator.Reset();
 }
 
-bool FEngineSimulatorThread::Init()
+void FEngineSimulatorInstance::UpdateEngineSwitch()
 {
-	return true;
+	const bool bSurrogate = bWantSurrogate;
+	if (bSurrogate == bSurrogateActive)
+	{
+		return;
+	}
+
+	// Creating either side can take a while (compiling the script or baking the torque map), so it's done off to the
+	// side and the switch happens on the first step after it's ready
+	if (!InactiveSimulator.IsValid() && !SwitchTask.IsValid())
+	{
+		FEngineSimulatorParameters SwitchParameters = Parameters;
+		SwitchParameters.bSurrogate = bSurrogate;
+		// The handoff state replaces whatever it would start from
+		SwitchParameters.bWarmStart = false;
+		SwitchTask = CreateEngineAsync(SwitchParameters);
+	}
+
+	if (SwitchTask.IsValid() && SwitchTask.IsCompleted())
+	{
+		InactiveSimulator = MoveTemp(SwitchTask.GetResult());
+		SwitchTask = FEngineSimulatorCreateTask();
+	}
+
+	if (InactiveSimulator.IsValid())
+	{
+		InactiveSimulator->ApplyHandoffState(EngineSimulator->GetHandoffState());
+		Swap(EngineSimulator, InactiveSimulator);
+		UpdateAudioEngine();
+		InactiveSimulator->SetTelemetryRecorder(nullptr);
+		bSurrogateActive = bSurrogate;
+	}
 }
 
-uint32 FEngineSimulatorThread::Run()
+void FEngineSimulatorInstance::UpdateReload()
 {
-	EngineSimulator = CreateEngine(Parameters);
+	// Another save while the last reload is still compiling waits for it, then reloads again
+	if (!ReloadTask.IsValid() && !SwitchTask.IsValid() && bReloadRequested.exchange(false))
+	{
+		FEngineSimulatorParameters ReloadParameters = Parameters;
+		ReloadParameters.bSurrogate = bSurrogateActive;
+		ReloadParameters.bWarmStart = false;
+		ReloadTask = CreateEngineAsync(ReloadParameters);
+	}
 
-	while (!bStopRequested)
+	if (!ReloadTask.IsValid() || !ReloadTask.IsCompleted())
 	{
-		Semaphore->Wait();
-		if (bStopRequested)
-		{
-			break;
-		}
-		else
-		{
-			FEngineSimulatorInput ThisInput;
-			{
-				FScopeLock Lock(&InputMutex);
-				ThisInput = Input;
-			}
+		return;
+	}
 
-			{
-				SCOPE_CYCLE_COUNTER(STAT_EngineSimulatorPlugin_UpdateSimulation);
-				float DynoSpeed = ThisInput.EngineRPM * (EngineSimulator->GetGearRatio() == 0.f ? 1000000.f : EngineSimulator->GetGearRatio());
-				EngineSimulator->SetDynoSpeed(DynoSpeed);
-				EngineSimulator->SetDynoEnabled(ThisInput.InContactWithGround);
+	TUniquePtr<IEngineSimulatorInterface> Reloaded = MoveTemp(ReloadTask.GetResult());
+	ReloadTask = FEngineSimulatorCreateTask();
 
-				TFunction<void(IEngineSimulatorInterface*)> SimulationUpdate;
-				while (UpdateQueue.Dequeue(SimulationUpdate))
-				{
-					SimulationUpdate(EngineSimulator.Get());
-				}
+	if (!Reloaded->HasEngine())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%s didn't compile, keeping the running engine"), *Parameters.ScriptPath);
+		return;
+	}
 
-				EngineSimulator->Simulate(ThisInput.DeltaTime);
+	// The new script may have fewer gears, or none at all
+	FEngineSimulatorHandoffState Handoff = EngineSimulator->GetHandoffState();
+	Handoff.Gear = FMath::Min(Handoff.Gear, Reloaded->GetGearCount() - 1);
+	Reloaded->ApplyHandoffState(Handoff);
+	Reloaded->SetLOD(EngineSimulator->GetLOD());
 
-				float TransmissionTorque = EngineSimulator->GetFilteredDynoTorque() * EngineSimulator->GetGearRatio();
+	// The old engine is only destroyed once the audio callback has moved on to the new one
+	Swap(EngineSimulator, Reloaded);
+	UpdateAudioEngine();
+	Reloaded.Reset();
 
-#if WITH_GAMEPLAY_DEBUGGER
-				GameplayDebuggerPrint = [
-						bHasEngine = EngineSimulator->HasEngine(),
-						EngineName = EngineSimulator->GetName(),
-						T = TransmissionTorque,
-						RPM = EngineSimulator->GetRPM(),
-						Speed = EngineSimulator->GetSpeed(),
-						DynoSpeed = DynoSpeed,
-						Grounded = ThisInput.InContactWithGround
-					](FGameplayDebuggerCategory* GameplayDebugger)
-				{
-					if (bHasEngine)
-					{
-						GameplayDebugger->AddTextLine(
-							FString::Printf(TEXT("{yellow}Engine: {white}%s"), *EngineName)
-						);
-						GameplayDebugger->AddTextLine(
-							FString::Printf(TEXT("\t{yellow}Torque at the wheel: {white}%f"), T)
-						);
-						GameplayDebugger->AddTextLine(
-							FString::Printf(TEXT("\t{yellow}RPM: {white}%f"), RPM)
-						);
-						GameplayDebugger->AddTextLine(
-							FString::Printf(TEXT("\t{yellow}Dyno RPM: {white}%f"), DynoSpeed)
-						);
-						if (!Grounded)
-						{
-							GameplayDebugger->AddTextLine("\t{green}Engine in air, dyno disabled");
-						}
-					}
-					else
-					{
-						GameplayDebugger->AddTextLine("{red}FAILED TO LOAD ENGINE");
-					}
-				};
-#endif
+	// Built from the old script
+	InactiveSimulator.Reset();
+}
 
-				{
-					FScopeLock Lock(&OutputMutex);
-					Output.Torque = TransmissionTorque;
-					Output.RPM = EngineSimulator->GetRPM();
-					Output.Redline = EngineSimulator->GetRedLine();
-					Output.Horsepower = EngineSimulator->GetDynoPower();
-					Output.Name = EngineSimulator->GetName();
-					Output.NumGears = EngineSimulator->GetGearCount();
-					Output.FrameCounter = ThisInput.FrameCounter + 1;
-				}
-			}
-		}
+void FEngineSimulatorInstance::AcquireEngine()
+{
+	if (!EngineSimulator.IsValid())
+	{
+		EngineSimulator = MoveTemp(CreateTask.GetResult());
+		UpdateAudioEngine();
 	}
+}
 
-	EngineSimulator.Reset();
+void FEngineSimulatorInstance::UpdateAudioEngine()
+{
+	FScopeLock Lock(&AudioMutex);
+	AudioEngine = EngineSimulator.Get();
+}
 
-	return 0;
+void FEngineSimulatorInstance::FillAudio(USoundWaveProcedural* Wave, int32 SamplesNeeded)
+{
+	// Until the engine exists the wave pads with silence
+	FScopeLock Lock(&AudioMutex);
+	if (AudioEngine != nullptr)
+	{
+		AudioEngine->FillAudio(Wave, SamplesNeeded);
+	}
 }
 
-void FEngineSimulatorThread::Stop()
+void FEngineSimulatorInstance::UpdateEngineName()
 {
-	bStopRequested = true;
-	Semaphore->Trigger();
-	Thread->WaitForCompletion();
+	if (EngineSimulator.Get() == NamedEngine)
+	{
+		return;
+	}
+
+	// Serials are unique across instances, so a respawned engine is never mistaken for the one it replaced
+	static std::atomic<uint32> NextNameSerial = 0;
+
+	FScopeLock Lock(&NameMutex);
+	EngineName = EngineSimulator->GetName();
+	NameSerial = ++NextNameSerial;
+	NamedEngine = EngineSimulator.Get();
 }
 
-void FEngineSimulatorThread::Exit()
+FString FEngineSimulatorInstance::GetEngineName() const
 {
-	//Stop();
+	FScopeLock Lock(&NameMutex);
+	return EngineName;
 }
 
-void FEngineSimulatorThread::Trigger()
+void FEngineSimulatorInstance::SetTelemetryRecorder(TSharedPtr<FEngineTelemetryRecorder, ESPMode::ThreadSafe> Recorder)
 {
-	Semaphore->Trigger();
+	FScopeLock Lock(&StateMutex);
+	if (EngineSimulator.IsValid())
+	{
+		EngineSimulator->SetTelemetryRecorder(Recorder.Get());
+	}
+	TelemetryRecorder = MoveTemp(Recorder);
 }
 
-UEngineSimulatorWheeledVehicleSimulation::UEngineSimulatorWheeledVehicleSimulation(TArray<class UChaosVehicleWheel*>& WheelsIn, 
-	const FEngineSimulatorParameters& InParameters)
-	: UChaosWheeledVehicleSimulation(WheelsIn)
-	, Parameters(InParameters)
+void FEngineSimulatorInstance::Step()
 {
-	EngineSimulatorThread = MakeUnique<FEngineSimulatorThread>(InParameters);
+	InputBuffer.SwapReadBuffers();
+	Simulate(InputBuffer.Read());
 }
 
-void UEngineSimulatorWheeledVehicleSimulation::ProcessMechanicalSimulation(float DeltaTime)
+bool FEngineSimulatorInstance::SaveState(TArray<uint8>& OutState)
 {
-	if (EngineSimulatorThread)
+	if (!IsReady())
 	{
-		// Retrieve output from the last frame
-		FEngineSimulatorOutput SimulationOutput;
+		return false;
+	}
+
+	// Between steps the engine can be read directly
+	if (StateMutex.TryLock())
+	{
+		AcquireEngine();
+		EngineSimulator->SaveState(OutState);
+		StateMutex.Unlock();
+		return true;
+	}
+
+	// Otherwise the running step snapshots itself when it ends, for the next call. A snapshot published since the last
+	// call is at most a step old, without one this waits for the step.
+	bSnapshotRequested = true;
+	if (Snapshots.IsDirty())
+	{
+		Snapshots.SwapReadBuffers();
+		OutState = Snapshots.Read();
+		return true;
+	}
+
+	FScopeLock Lock(&StateMutex);
+	AcquireEngine();
+	EngineSimulator->SaveState(OutState);
+	return true;
+}
+
+bool FEngineSimulatorInstance::LoadState(const TArray<uint8>& State)
+{
+	if (!IsReady())
+	{
+		return false;
+	}
+
+	FScopeLock Lock(&StateMutex);
+	AcquireEngine();
+	return EngineSimulator->LoadState(State);
+}
+
+void FEngineSimulatorInstance::Simulate(const FEngineSimulatorInput& ThisInput)
+{
+	FScopeLock StateLock(&StateMutex);
+
+	AcquireEngine();
+	UpdateEngineSwitch();
+	UpdateReload();
+	UpdateEngineName();
+
+	{
+		ENGINESIMULATOR_SCOPE_CYCLE_COUNTER(STAT_EngineSimulatorPlugin_UpdateSimulation);
+		float DynoSpeed = ThisInput.EngineRPM * (EngineSimulator->GetGearRatio() == 0.f ? 1000000.f : EngineSimulator->GetGearRatio());
+		EngineSimulator->SetDynoSpeed(DynoSpeed);
+		EngineSimulator->SetDynoEnabled(ThisInput.InContactWithGround);
+
 		{
-			FScopeLock Lock(&EngineSimulatorThread->OutputMutex);
-			SimulationOutput = EngineSimulatorThread->Output;
+			ENGINESIMULATOR_SCOPE_CYCLE_COUNTER(STAT_EngineSimulatorPlugin_DrainCommands);
+			Commands.Apply(*EngineSimulator);
 		}
 
+		if (WarmStartWatchTime > 0.f)
 		{
-			FScopeLock Lock(&LastOutputMutex);
-			LastOutput = SimulationOutput;
+			// No warm state was applied, or it didn't keep running, so it gets cranked like a cold engine
+			WarmStartWatchTime -= ThisInput.DeltaTime;
+			if (FMath::Abs(EngineSimulator->GetRPM()) < FEngineWarmStartCache::MinIdleRPM)
+			{
+				EngineSimulator->SetStarterEnabled(true);
+				WarmStartWatchTime = 0.f;
+			}
 		}
 
+		// Follows the engine through surrogate switches and reloads
+		EngineSimulator->SetTelemetryRecorder(TelemetryRecorder.Get());
+		EngineSimulator->Simulate(ThisInput.DeltaTime);
+
+		float TransmissionTorque = EngineSimulator->GetFilteredDynoTorque() * EngineSimulator->GetGearRatio();
+
+		{
+			ENGINESIMULATOR_SCOPE_CYCLE_COUNTER(STAT_EngineSimulatorPlugin_PublishOutput);
+			FEngineSimulatorOutputBlock& Output = OutputBuffer.GetWriteBuffer();
+			Output.Torque = TransmissionTorque;
+			Output.RPM = EngineSimulator->GetRPM();
+			Output.Redline = EngineSimulator->GetRedLine();
+			Output.Horsepower = EngineSimulator->GetDynoPower();
+			Output.NumGears = EngineSimulator->GetGearCount();
+			Output.CurrentGear = EngineSimulator->GetGear();
+			Output.NameSerial = NameSerial;
+			Output.FrameCounter = ThisInput.FrameCounter + 1;
+			Output.DynoRPM = DynoSpeed;
+			Output.bHasEngine = EngineSimulator->HasEngine();
+			Output.bGrounded = ThisInput.InContactWithGround;
+			OutputBuffer.SwapWriteBuffers();
+		}
+
+		if (bSnapshotRequested.exchange(false))
+		{
+			EngineSimulator->SaveState(Snapshots.GetWriteBuffer());
+			Snapshots.SwapWriteBuffers();
+		}
+	}
+}
+
+UEngineSimulatorWheeledVehicleSimulation::UEngineSimulatorWheeledVehicleSimulation(TArray<class UChaosVehicleWheel*>& WheelsIn, 
+	const FEngineSimulatorParameters& InParameters)
+	: UChaosWheeledVehicleSimulation(WheelsIn)
+	, Parameters(InParameters)
+{
+	Parameters.Scopes = &Scopes;
+	EngineSimulatorInstance = MakeUnique<FEngineSimulatorInstance>(Parameters);
+
+	// Engines simulated headless (warm start rolls, baking) have nowhere to play
+	if (Parameters.SoundWaveOutput)
+	{
+		Parameters.SoundWaveOutput->OnSoundWaveProceduralUnderflow.BindRaw(this, &UEngineSimulatorWheeledVehicleSimulation::FillAudio);
+	}
+}
+
+UEngineSimulatorWheeledVehicleSimulation::~UEngineSimulatorWheeledVehicleSimulation()
+{
+	if (Parameters.SoundWaveOutput && Parameters.SoundWaveOutput->OnSoundWaveProceduralUnderflow.IsBoundToObject(this))
+	{
+		Parameters.SoundWaveOutput->OnSoundWaveProceduralUnderflow.Unbind();
+	}
+
+	// Waits out a callback that's still filling from it
+	TUniquePtr<FEngineSimulatorInstance> Instance;
+	{
+		FScopeLock Lock(&AudioMutex);
+		Instance = MoveTemp(EngineSimulatorInstance);
+	}
+}
+
+void UEngineSimulatorWheeledVehicleSimulation::FillAudio(USoundWaveProcedural* Wave, int32 SamplesNeeded)
+{
+	FScopeLock Lock(&AudioMutex);
+	if (EngineSimulatorInstance)
+	{
+		EngineSimulatorInstance->FillAudio(Wave, SamplesNeeded);
+	}
+}
+
+void UEngineSimulatorWheeledVehicleSimulation::ProcessMechanicalSimulation(float DeltaTime)
+{
+	if (EngineSimulatorInstance)
+	{
 		auto& PTransmission = PVehicle->GetTransmission();
 
 		bool bWheelsInContact = false;
@@ -198,19 +368,30 @@ void UEngineSimulatorWheeledVehicleSimulation::ProcessMechanicalSimulation(float
 
 		float DynoSpeed = WheelRPM * PTransmission.Setup().FinalDriveRatio;
 
-		// Do input here...
+		FEngineSimulatorInput ThisInput;
+		ThisInput.DeltaTime = DeltaTime;
+		ThisInput.InContactWithGround = bWheelsInContact;
+		ThisInput.EngineRPM = DynoSpeed;
+		ThisInput.FrameCounter = GFrameCounter;
+
+		// Inline, this substep's torque comes from advancing the engine by exactly this substep. We're already on one
+		// of the physics parallel for workers, so engines of different vehicles still step side by side.
+		const bool bInline = EngineSimulatorInstance->IsInline();
+		if (bInline && EngineSimulatorInstance->IsReady())
 		{
-			EngineSimulatorThread->InputMutex.Lock();
-			EngineSimulatorThread->Input.DeltaTime = DeltaTime;
-			EngineSimulatorThread->Input.InContactWithGround = bWheelsInContact;
-			//if (bWheelRPMWasSet)
-			{
-				EngineSimulatorThread->Input.EngineRPM = DynoSpeed;
-			}
-			EngineSimulatorThread->Input.FrameCounter = GFrameCounter;
-			EngineSimulatorThread->InputMutex.Unlock();
+			EngineSimulatorInstance->Simulate(ThisInput);
+		}
+
+		// Otherwise this is the output of the step submitted last frame
+		EngineSimulatorInstance->OutputBuffer.SwapReadBuffers();
+		const FEngineSimulatorOutputBlock SimulationOutput = EngineSimulatorInstance->OutputBuffer.Read();
+		LastOutputBuffer.Write(SimulationOutput);
+
+		if (!bInline)
+		{
+			EngineSimulatorInstance->InputBuffer.Write(ThisInput);
+			FEngineSimulatorScheduler::Get().Submit(*EngineSimulatorInstance);
 		}
-		EngineSimulatorThread->Trigger();
 
 		// apply drive torque to wheels
 		for (int WheelIdx = 0; WheelIdx < Wheels.Num(); WheelIdx++)
@@ -245,38 +426,119 @@ void UEngineSimulatorWheeledVehicleSimulation::ApplyInput(const FControlInputs&
 	FControlInputs ModifiedInputs = ControlInputs;
 
 	//PEngine.SetThrottle(ModifiedInputs.ThrottleInput * ModifiedInputs.ThrottleInput);
-	AsyncUpdateSimulation([ThrottleInput = ModifiedInputs.ThrottleInput](IEngineSimulatorInterface* EngineInterface)
+	AsyncUpdateSimulation(FEngineSimulatorCommand::SetThrottle(ModifiedInputs.ThrottleInput * ModifiedInputs.ThrottleInput));
+}
+
+void UEngineSimulatorWheeledVehicleSimulation::SetUseSurrogate(bool bUseSurrogate)
+{
+	if (EngineSimulatorInstance)
 	{
-		//UE_LOG(LogTemp, Warning, TEXT("Setting engine speed: %f"), ThrottleInput * ThrottleInput);
-		EngineInterface->SetSpeedControl(ThrottleInput * ThrottleInput);
-	});
+		EngineSimulatorInstance->SetUseSurrogate(bUseSurrogate);
+	}
 }
 
-void UEngineSimulatorWheeledVehicleSimulation::AsyncUpdateSimulation(TFunction<void(IEngineSimulatorInterface*)> InCallable)
+void UEngineSimulatorWheeledVehicleSimulation::SetTelemetryRecorder(TSharedPtr<FEngineTelemetryRecorder, ESPMode::ThreadSafe> Recorder)
 {
-	if (EngineSimulatorThread)
+	if (EngineSimulatorInstance)
 	{
-		EngineSimulatorThread->UpdateQueue.Enqueue(InCallable);
+		EngineSimulatorInstance->SetTelemetryRecorder(MoveTemp(Recorder));
 	}
 }
 
-FEngineSimulatorOutput UEngineSimulatorWheeledVehicleSimulation::GetLastOutput()
+void UEngineSimulatorWheeledVehicleSimulation::AsyncUpdateSimulation(const FEngineSimulatorCommand& Command)
 {
-	FScopeLock Lock(&LastOutputMutex);
-	return LastOutput;
+	if (EngineSimulatorInstance && !EngineSimulatorInstance->Commands.Enqueue(Command))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Engine command queue is full, dropped a command"));
+	}
 }
 
-void UEngineSimulatorWheeledVehicleSimulation::Reset(const FEngineSimulatorParameters& InParameters)
+void UEngineSimulatorWheeledVehicleSimulation::GetLastOutput(FEngineSimulatorOutput& OutOutput)
 {
-	EngineSimulatorThread = MakeUnique<FEngineSimulatorThread>(InParameters);
+	LastOutputBuffer.SwapReadBuffers();
+	LastOutput = LastOutputBuffer.Read();
+
+	OutOutput.Torque = LastOutput.Torque;
+	OutOutput.RPM = LastOutput.RPM;
+	OutOutput.Redline = LastOutput.Redline;
+	OutOutput.Horsepower = LastOutput.Horsepower;
+	OutOutput.CurrentGear = LastOutput.CurrentGear;
+	OutOutput.NumGears = LastOutput.NumGears;
+	OutOutput.FrameCounter = LastOutput.FrameCounter;
+
+	if (LastOutput.NameSerial != LastNameSerial && EngineSimulatorInstance)
+	{
+		LastName = EngineSimulatorInstance->GetEngineName();
+		LastNameSerial = LastOutput.NameSerial;
+	}
+	if (OutOutput.Name != LastName)
+	{
+		OutOutput.Name = LastName;
+	}
+}
+
+void UEngineSimulatorWheeledVehicleSimulation::Reset(const FEngineSimulatorParameters& InParameters, bool bKeepState)
+{
+	TArray<uint8> State;
+	if (bKeepState && EngineSimulatorInstance)
+	{
+		EngineSimulatorInstance->SaveState(State);
+	}
+
+	Parameters = InParameters;
+	Parameters.Scopes = &Scopes;
+
+	// The old instance is destroyed outside the lock, once the audio callback can no longer reach it
+	TUniquePtr<FEngineSimulatorInstance> OldInstance;
+	{
+		FScopeLock Lock(&AudioMutex);
+		OldInstance = MoveTemp(EngineSimulatorInstance);
+		EngineSimulatorInstance = MakeUnique<FEngineSimulatorInstance>(Parameters, MoveTemp(State));
+	}
+}
+
+bool UEngineSimulatorWheeledVehicleSimulation::SaveEngineState(TArray<uint8>& OutState)
+{
+	return EngineSimulatorInstance && EngineSimulatorInstance->SaveState(OutState);
+}
+
+bool UEngineSimulatorWheeledVehicleSimulation::LoadEngineState(const TArray<uint8>& State, int32& OutGear)
+{
+	if (!EngineSimulatorInstance || !EngineSimulatorInstance->IsReady())
+	{
+		return false;
+	}
+
+	// Even a snapshot of another engine sets the gear
+	const bool bRestored = EngineSimulatorInstance->LoadState(State);
+
+	FScopeLock Lock(&EngineSimulatorInstance->StateMutex);
+	OutGear = EngineSimulatorInstance->EngineSimulator->GetGear();
+	return bRestored;
 }
 
 #if WITH_GAMEPLAY_DEBUGGER
 void UEngineSimulatorWheeledVehicleSimulation::PrintGameplayDebuggerInfo(FGameplayDebuggerCategory* GameplayDebugger)
 {
-	if (EngineSimulatorThread && EngineSimulatorThread->GameplayDebuggerPrint)
+	// Nothing has been published yet while the engine is still being created
+	if (LastOutput.NameSerial == 0)
+	{
+		return;
+	}
+
+	if (!LastOutput.bHasEngine)
+	{
+		GameplayDebugger->AddTextLine("{red}FAILED TO LOAD ENGINE");
+		return;
+	}
+
+	GameplayDebugger->AddTextLine(FString::Printf(TEXT("{yellow}Engine: {white}%s"), *LastName));
+	GameplayDebugger->AddTextLine(FString::Printf(TEXT("\t{yellow}Torque at the wheel: {white}%f"), LastOutput.Torque));
+	GameplayDebugger->AddTextLine(FString::Printf(TEXT("\t{yellow}RPM: {white}%f"), LastOutput.RPM));
+	GameplayDebugger->AddTextLine(FString::Printf(TEXT("\t{yellow}Dyno RPM: {white}%f"), LastOutput.DynoRPM));
+	if (!LastOutput.bGrounded)
 	{
-		EngineSimulatorThread->GameplayDebuggerPrint(GameplayDebugger);
+		GameplayDebugger->AddTextLine("\t{green}Engine in air, dyno disabled");
 	}
 }
 #endif
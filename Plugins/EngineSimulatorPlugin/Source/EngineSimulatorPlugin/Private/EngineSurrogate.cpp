@@ -0,0 +1,209 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EngineSimulator.h"
+#include "EngineDefinitionRegistry.h"
+#include "EngineTorqueMap.h"
+#include "EngineSimulatorState.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+// Combustion only produces torque above this fraction of the lowest baked RPM
+static const float SurrogateStallFraction = 0.5f;
+static const float SurrogateStarterRPM = 200.f;
+static const float SurrogateStarterTorque = 270.f; // N m
+static const float SurrogateTorqueFilterTime = 0.05f; // Seconds, roughly what the dyno filter in engine-sim does
+
+/**
+ * Stand-in for FEngineSimulator that integrates crank speed from a baked torque map.
+ * Mirrors the way the full simulation is driven: while in gear the dyno pulls the crank towards the wheel speed through
+ * the clutch, in neutral the engine revs freely against its own friction.
+ */
+class FEngineSurrogate : public IEngineSimulatorInterface
+{
+public:
+	FEngineSurrogate(FEngineDefinitionPtr InDefinition, FEngineTorqueMapPtr InMap, bool bInInlineStepping)
+		: Definition(InDefinition)
+		, Map(InMap)
+		, bInlineStepping(bInInlineStepping)
+	{
+	}
+
+	// IEngineSimulatorInterface
+	virtual void Simulate(float DeltaTime) override;
+
+	virtual void SetDynoEnabled(bool bEnabled) override { bDynoEnabled = bEnabled; }
+	virtual void SetStarterEnabled(bool bEnabled) override { bStarterEnabled = bEnabled; }
+	virtual void SetIgnitionEnabled(bool bEnabled) override { bIgnitionEnabled = bEnabled; }
+	virtual void SetSpeedControl(float Speed) override { SpeedControl = FMath::Clamp(Speed, 0.f, 1.f); }
+	virtual void SetDynoSpeed(float RPM) override { DynoRPM = RPM; }
+	virtual void SetGear(int32 InGear) override { Gear = FMath::Clamp(InGear, -1, GetGearCount() - 1); }
+	virtual void SetClutchPressure(float Pressure) override { ClutchPressure = FMath::Clamp(Pressure, 0.f, 1.f); }
+
+	virtual int32 GetGear() override { return Gear; }
+	virtual float GetSpeed() override { return RPM * PI / 30.f; }
+	virtual float GetRPM() override { return RPM; }
+	virtual float GetRedLine() override { return Map->Redline; }
+	virtual float GetFilteredDynoTorque() override { return FilteredDynoTorque; }
+	virtual float GetDynoPower() override { return FilteredDynoTorque * GetSpeed() / 745.7f; }
+	virtual float GetGearRatio() override { return Map->GearRatios.IsValidIndex(Gear) ? static_cast<float>(Map->GearRatios[Gear]) : 0.f; }
+	virtual int32 GetGearCount() override { return Map->GearRatios.Num(); }
+	virtual bool IsDynoEnabled() override { return Gear != -1 && bDynoEnabled; }
+	virtual bool HasEngine() override { return true; }
+	virtual FString GetName() override { return Map->EngineName; }
+
+	virtual FEngineSimulatorHandoffState GetHandoffState() override;
+	virtual void ApplyHandoffState(const FEngineSimulatorHandoffState& State) override;
+	virtual void SaveState(TArray<uint8>& OutState) override;
+	virtual bool LoadState(const TArray<uint8>& State) override;
+	// End IEngineSimulatorInterface
+
+private:
+	FEngineDefinitionPtr Definition;
+	FEngineTorqueMapPtr Map;
+	bool bInlineStepping = false;
+
+	float RPM = 0.f;
+	float DynoRPM = 0.f;
+	float FilteredDynoTorque = 0.f;
+	float SpeedControl = 0.f;
+	float ClutchPressure = 1.f;
+	int32 Gear = -1;
+	bool bDynoEnabled = true;
+	bool bStarterEnabled = false;
+	bool bIgnitionEnabled = false;
+};
+
+void FEngineSurrogate::Simulate(float DeltaTime)
+{
+	if (DeltaTime <= 0.f)
+	{
+		return;
+	}
+	if (!bInlineStepping)
+	{
+		// Same limits FEngineSimulator::process() puts on the frame time
+		DeltaTime = FMath::Clamp(DeltaTime, 1.f / 200.f, 1.f / 30.f);
+	}
+
+	const float RPMToRadians = PI / 30.f;
+	const float Inertia = Map->Inertia;
+
+	// The throttle-closed column is the engine's friction and pumping losses, combustion adds to it
+	float EngineTorque = Map->SampleTorque(RPM, 0.f);
+	if (bIgnitionEnabled && RPM >= Map->RPMs[0] * SurrogateStallFraction)
+	{
+		EngineTorque = Map->SampleTorque(RPM, SpeedControl);
+	}
+	else
+	{
+		EngineTorque = FMath::Min(EngineTorque, 0.f);
+	}
+
+	if (bStarterEnabled && RPM < SurrogateStarterRPM)
+	{
+		EngineTorque += SurrogateStarterTorque;
+	}
+
+	float DynoTorque = 0.f;
+	float Omega = RPM * RPMToRadians;
+	if (IsDynoEnabled())
+	{
+		// Torque needed to bring the crank to the dyno speed this frame, limited by what the clutch can hold
+		const float ClutchLimit = static_cast<float>(Map->MaxClutchTorque) * ClutchPressure;
+		const float Required = Inertia * (FMath::Max(DynoRPM, 0.f) * RPMToRadians - Omega) / DeltaTime - EngineTorque;
+		const float ClutchTorque = FMath::Clamp(Required, -ClutchLimit, ClutchLimit);
+
+		Omega += (EngineTorque + ClutchTorque) / Inertia * DeltaTime;
+		DynoTorque = -ClutchTorque;
+	}
+	else
+	{
+		Omega += EngineTorque / Inertia * DeltaTime;
+	}
+
+	RPM = FMath::Max(Omega, 0.f) / RPMToRadians;
+
+	const float Alpha = 1.f - FMath::Exp(-DeltaTime / SurrogateTorqueFilterTime);
+	FilteredDynoTorque += (DynoTorque - FilteredDynoTorque) * Alpha;
+}
+
+FEngineSimulatorHandoffState FEngineSurrogate::GetHandoffState()
+{
+	FEngineSimulatorHandoffState State;
+	State.RPM = RPM;
+	State.Gear = Gear;
+	State.SpeedControl = SpeedControl;
+	State.ClutchPressure = ClutchPressure;
+	State.bStarterEnabled = bStarterEnabled;
+	State.bIgnitionEnabled = bIgnitionEnabled;
+	State.bDynoEnabled = bDynoEnabled;
+	return State;
+}
+
+void FEngineSurrogate::ApplyHandoffState(const FEngineSimulatorHandoffState& State)
+{
+	RPM = State.RPM;
+	SetGear(State.Gear);
+	SetSpeedControl(State.SpeedControl);
+	SetClutchPressure(State.ClutchPressure);
+	bStarterEnabled = State.bStarterEnabled;
+	bIgnitionEnabled = State.bIgnitionEnabled;
+	bDynoEnabled = State.bDynoEnabled;
+}
+
+void FEngineSurrogate::SaveState(TArray<uint8>& OutState)
+{
+	OutState.Reset();
+	FMemoryWriter Ar(OutState);
+
+	FEngineSimulatorStateHeader Header(FEngineSimulatorStateHeader::EKind::Surrogate, Definition->GetKey(), GetHandoffState());
+	Ar << Header;
+	Ar << DynoRPM;
+	Ar << FilteredDynoTorque;
+}
+
+bool FEngineSurrogate::LoadState(const TArray<uint8>& State)
+{
+	FMemoryReader Ar(State);
+
+	FEngineSimulatorStateHeader Header;
+	Ar << Header;
+	if (Ar.IsError())
+	{
+		return false;
+	}
+
+	ApplyHandoffState(Header.Handoff);
+
+	const FEngineSimulatorStateHeader Expected(FEngineSimulatorStateHeader::EKind::Surrogate, Definition->GetKey(), Header.Handoff);
+	if (!Header.Matches(Expected))
+	{
+		return false;
+	}
+
+	float InDynoRPM = 0.f;
+	float InFilteredDynoTorque = 0.f;
+	Ar << InDynoRPM;
+	Ar << InFilteredDynoTorque;
+	if (Ar.IsError())
+	{
+		return false;
+	}
+
+	DynoRPM = InDynoRPM;
+	FilteredDynoTorque = InFilteredDynoTorque;
+	return true;
+}
+
+TUniquePtr<IEngineSimulatorInterface> CreateSurrogateEngine(const FEngineSimulatorParameters& Parameters)
+{
+	FEngineDefinitionPtr Definition = FEngineDefinitionRegistry::Get().FindOrAdd(Parameters.ScriptPath);
+	FEngineTorqueMapPtr Map = FEngineTorqueMapCache::Get().FindOrBake(*Definition);
+	if (!Map.IsValid())
+	{
+		// Nothing to drive a surrogate with, the full simulator reports the failure the usual way
+		return CreateEngine(Parameters);
+	}
+
+	return MakeUnique<FEngineSurrogate>(Definition, Map, Parameters.bInlineStepping);
+}
@@ -0,0 +1,221 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EngineTelemetry.h"
+#include "HAL/FileManager.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/FileHelper.h"
+
+// About a second of steps at engine-sim's usual 10kHz before anything is dropped
+static const int32 TelemetryRingCapacity = 8192;
+
+// How often the writer wakes up to drain the ring
+static const uint32 TelemetryWriterIntervalMs = 20;
+
+static FArchive& operator<<(FArchive& Ar, FEngineTelemetrySample& Sample)
+{
+	Ar << Sample.Time;
+	Ar << Sample.CrankAngle;
+	Ar << Sample.RPM;
+	Ar << Sample.DynoTorque;
+	Ar << Sample.Throttle;
+	Ar << Sample.ClutchPressure;
+	Ar << Sample.StepMicroseconds;
+	Ar << Sample.Gear;
+	return Ar;
+}
+
+static FArchive& operator<<(FArchive& Ar, FEngineTelemetryCylinder& Cylinder)
+{
+	Ar << Cylinder.Pressure;
+	Ar << Cylinder.Temperature;
+	Ar << Cylinder.IntakeFlow;
+	Ar << Cylinder.ExhaustFlow;
+	return Ar;
+}
+
+TSharedPtr<FEngineTelemetryRecorder, ESPMode::ThreadSafe> FEngineTelemetryRecorder::Create(const FString& Path)
+{
+	FArchive* Writer = IFileManager::Get().CreateFileWriter(*Path);
+	if (!Writer)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Can't open %s for engine telemetry"), *Path);
+		return nullptr;
+	}
+
+	return MakeShareable(new FEngineTelemetryRecorder(Path, Writer));
+}
+
+FEngineTelemetryRecorder::FEngineTelemetryRecorder(const FString& InPath, FArchive* InWriter)
+	: Path(InPath)
+	, Writer(InWriter)
+	, WriteIndex(0)
+	, ReadIndex(0)
+	, DroppedRecords(0)
+	, bStopping(false)
+{
+	Records.SetNum(TelemetryRingCapacity);
+	Mask = TelemetryRingCapacity - 1;
+
+	WakeEvent = FPlatformProcess::GetSynchEventFromPool();
+	Thread = FRunnableThread::Create(this, TEXT("EngineTelemetryWriter"), 0, TPri_BelowNormal);
+}
+
+FEngineTelemetryRecorder::~FEngineTelemetryRecorder()
+{
+	if (Thread)
+	{
+		Thread->Kill(true);
+		delete Thread;
+	}
+	FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+
+	Drain();
+	Writer->Close();
+
+	if (const uint64 Dropped = GetDroppedRecords())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Engine telemetry %s dropped %llu steps, the writer couldn't keep up"), *Path, Dropped);
+	}
+}
+
+void FEngineTelemetryRecorder::Describe(const FString& InEngineName, int32 InNumCylinders)
+{
+	FScopeLock Lock(&DescriptionMutex);
+	if (NumCylinders < 0)
+	{
+		EngineName = InEngineName;
+		NumCylinders = FMath::Min(InNumCylinders, MaxCylinders);
+	}
+}
+
+uint32 FEngineTelemetryRecorder::Run()
+{
+	while (!bStopping.load(std::memory_order_relaxed))
+	{
+		WakeEvent->Wait(TelemetryWriterIntervalMs);
+		Drain();
+	}
+	return 0;
+}
+
+void FEngineTelemetryRecorder::Stop()
+{
+	bStopping = true;
+	WakeEvent->Trigger();
+}
+
+void FEngineTelemetryRecorder::Drain()
+{
+	if (!bHeaderWritten)
+	{
+		FScopeLock Lock(&DescriptionMutex);
+		if (NumCylinders < 0)
+		{
+			// Nothing gets recorded before the engine describes itself
+			return;
+		}
+
+		uint32 FileMagic = Magic;
+		uint32 FileVersion = Version;
+		*Writer << FileMagic;
+		*Writer << FileVersion;
+		*Writer << EngineName;
+		*Writer << NumCylinders;
+		bHeaderWritten = true;
+	}
+
+	const uint32 Write = WriteIndex.load(std::memory_order_acquire);
+	uint32 Read = ReadIndex.load(std::memory_order_relaxed);
+	for (; Read != Write; ++Read)
+	{
+		FRecord& Record = Records[Read & Mask];
+		*Writer << Record.Sample;
+
+		// An engine swapped in by a reload may have a different cylinder count, the file keeps the first one's
+		for (int32 i = 0; i < NumCylinders; ++i)
+		{
+			FEngineTelemetryCylinder Cylinder = i < Record.NumCylinders ? Record.Cylinders[i] : FEngineTelemetryCylinder();
+			*Writer << Cylinder;
+		}
+	}
+	ReadIndex.store(Read, std::memory_order_release);
+}
+
+bool FEngineTelemetryRecorder::ConvertToCsv(const FString& CapturePath, const FString& CsvPath)
+{
+	TUniquePtr<FArchive> Reader(IFileManager::Get().CreateFileReader(*CapturePath));
+	if (!Reader)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Can't open %s"), *CapturePath);
+		return false;
+	}
+
+	uint32 FileMagic = 0;
+	uint32 FileVersion = 0;
+	FString FileEngineName;
+	int32 FileNumCylinders = 0;
+	*Reader << FileMagic;
+	*Reader << FileVersion;
+	if (Reader->IsError() || FileMagic != Magic || FileVersion != Version)
+	{
+		UE_LOG(LogTemp, Error, TEXT("%s isn't an engine telemetry capture, or is from another version"), *CapturePath);
+		return false;
+	}
+	*Reader << FileEngineName;
+	*Reader << FileNumCylinders;
+	if (Reader->IsError() || FileNumCylinders < 0 || FileNumCylinders > MaxCylinders)
+	{
+		UE_LOG(LogTemp, Error, TEXT("%s has a corrupt header"), *CapturePath);
+		return false;
+	}
+
+	TUniquePtr<FArchive> Writer(IFileManager::Get().CreateFileWriter(*CsvPath));
+	if (!Writer)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Can't open %s for writing"), *CsvPath);
+		return false;
+	}
+
+	auto WriteLine = [&Writer](const FString& Line)
+	{
+		const FTCHARToUTF8 Utf8(*Line);
+		Writer->Serialize(const_cast<ANSICHAR*>(Utf8.Get()), Utf8.Length());
+	};
+
+	FString Line = TEXT("Time,CrankAngle,RPM,DynoTorqueNm,Throttle,ClutchPressure,Gear,StepMicroseconds");
+	for (int32 i = 0; i < FileNumCylinders; ++i)
+	{
+		Line += FString::Printf(TEXT(",Cylinder%dPressurePa,Cylinder%dTemperatureK,Cylinder%dIntakeFlow,Cylinder%dExhaustFlow"), i, i, i, i);
+	}
+	WriteLine(Line + TEXT("\n"));
+
+	int64 NumRows = 0;
+	while (Reader->Tell() < Reader->TotalSize())
+	{
+		FEngineTelemetrySample Sample;
+		*Reader << Sample;
+
+		Line = FString::Printf(TEXT("%.6f,%.2f,%.1f,%.2f,%.4f,%.3f,%d,%.3f"),
+			Sample.Time, Sample.CrankAngle, Sample.RPM, Sample.DynoTorque, Sample.Throttle, Sample.ClutchPressure, Sample.Gear, Sample.StepMicroseconds);
+		for (int32 i = 0; i < FileNumCylinders; ++i)
+		{
+			FEngineTelemetryCylinder Cylinder;
+			*Reader << Cylinder;
+			Line += FString::Printf(TEXT(",%.0f,%.1f,%g,%g"), Cylinder.Pressure, Cylinder.Temperature, Cylinder.IntakeFlow, Cylinder.ExhaustFlow);
+		}
+
+		if (Reader->IsError())
+		{
+			// The last record of a capture cut short, everything before it is fine
+			UE_LOG(LogTemp, Warning, TEXT("%s ends in a partial record"), *CapturePath);
+			break;
+		}
+
+		Line += TEXT("\n");
+		WriteLine(Line);
+		++NumRows;
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("Wrote %lld steps of %s to %s"), NumRows, *FileEngineName, *CsvPath);
+	return true;
+}
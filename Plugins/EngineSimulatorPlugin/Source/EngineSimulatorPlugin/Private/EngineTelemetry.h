@@ -0,0 +1,116 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include <atomic>
+
+class FRunnableThread;
+
+// State of the engine after one simulation step
+struct FEngineTelemetrySample
+{
+	double Time = 0.0; // Simulated seconds since recording started
+	float CrankAngle = 0.f; // Degrees through the 720 degree cycle
+	float RPM = 0.f;
+	float DynoTorque = 0.f; // N m
+	float Throttle = 0.f; // 0 - 1, what the throttle body is at rather than what was asked for
+	float ClutchPressure = 0.f;
+	float StepMicroseconds = 0.f;
+	int32 Gear = -1;
+};
+
+struct FEngineTelemetryCylinder
+{
+	float Pressure = 0.f; // Pa
+	float Temperature = 0.f; // K
+	float IntakeFlow = 0.f; // Flow through the intake valve over the last step, in engine-sim's units
+	float ExhaustFlow = 0.f;
+};
+
+/**
+ * Streams per step engine state to a binary capture file. The simulation thread fills records in place in a lock-free
+ * ring and never waits, a writer thread drains the ring to disk. Steps that find the ring full are dropped and counted.
+ *
+ * File layout: uint32 magic, uint32 version, engine name, int32 cylinder count, then one record per step of
+ * FEngineTelemetrySample followed by a FEngineTelemetryCylinder per cylinder, all through FArchive.
+ */
+class FEngineTelemetryRecorder : public FRunnable
+{
+public:
+	static constexpr int32 MaxCylinders = 16;
+
+	struct FRecord
+	{
+		FEngineTelemetrySample Sample;
+		int32 NumCylinders = 0;
+		FEngineTelemetryCylinder Cylinders[MaxCylinders];
+	};
+
+	// Null if the file can't be opened
+	static TSharedPtr<FEngineTelemetryRecorder, ESPMode::ThreadSafe> Create(const FString& Path);
+
+	// Flushes whatever is still in the ring
+	virtual ~FEngineTelemetryRecorder();
+
+	// Simulation thread, once per engine attached. Only the first engine's description makes it into the header.
+	void Describe(const FString& EngineName, int32 NumCylinders);
+
+	// Simulation thread. A record to fill in, or null if the writer has fallen behind.
+	FRecord* BeginWrite()
+	{
+		const uint32 Write = WriteIndex.load(std::memory_order_relaxed);
+		if (Write - ReadIndex.load(std::memory_order_acquire) >= static_cast<uint32>(Records.Num()))
+		{
+			DroppedRecords.fetch_add(1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		return &Records[Write & Mask];
+	}
+
+	// Simulation thread. Publishes the record from BeginWrite().
+	void CommitWrite()
+	{
+		WriteIndex.store(WriteIndex.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	const FString& GetPath() const { return Path; }
+	uint64 GetDroppedRecords() const { return DroppedRecords.load(std::memory_order_relaxed); }
+
+	static const uint32 Magic = 0x4C545345; // 'ESTL'
+	static const uint32 Version = 1;
+
+	// Converts a capture to CSV, one row per step
+	static bool ConvertToCsv(const FString& CapturePath, const FString& CsvPath);
+
+private:
+	FEngineTelemetryRecorder(const FString& InPath, FArchive* InWriter);
+
+	// FRunnable
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+	// End FRunnable
+
+	void Drain();
+
+	FString Path;
+	TUniquePtr<FArchive> Writer;
+
+	TArray<FRecord> Records;
+	uint32 Mask = 0;
+	std::atomic<uint32> WriteIndex;
+	std::atomic<uint32> ReadIndex;
+	std::atomic<uint64> DroppedRecords;
+
+	FCriticalSection DescriptionMutex;
+	FString EngineName;
+	int32 NumCylinders = -1;
+	bool bHeaderWritten = false;
+
+	FEvent* WakeEvent = nullptr;
+	FRunnableThread* Thread = nullptr;
+	std::atomic<bool> bStopping;
+};
+
+using FEngineTelemetryRecorderPtr = TSharedPtr<FEngineTelemetryRecorder, ESPMode::ThreadSafe>;
@@ -0,0 +1,427 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EngineTorqueMap.h"
+#include "Algo/BinarySearch.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "ChaosWheeledVehicleMovementComponent.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+#include "EngineSimulatorInternals/HeaderFixesStart.h"
+
+#include "simulator.h"
+#include "engine.h"
+#include "transmission.h"
+
+#include "EngineSimulatorInternals/HeaderFixesEnd.h"
+
+// Bump this whenever FEngineTorqueMap or the way it's baked changes
+static const int32 EngineTorqueMapVersion = 2;
+
+namespace
+{
+	// One copy of the engine on a dyno, every bake worker runs its own
+	class FDynoSweep
+	{
+	public:
+		FDynoSweep(const FEngineDefinition& InDefinition, const FEngineTorqueMapBakeSettings& InSettings, FEngineGraph InGraph)
+			: Definition(InDefinition)
+			, Settings(InSettings)
+			, Graph(InGraph)
+		{
+			engine = Graph.engine;
+			if (engine == nullptr)
+			{
+				return;
+			}
+
+			engine->calculateDisplacement();
+			Graph.transmission->changeGear(-1);
+
+			simulator.setFluidSimulationSteps(8);
+			simulator.setSimulationFrequency(engine->getSimulationFrequency());
+
+			Simulator::Parameters simulatorParams;
+			simulatorParams.SystemType = Simulator::SystemType::NsvOptimized;
+			simulator.initialize(simulatorParams);
+			simulator.loadSimulation(engine, Graph.vehicle, Graph.transmission);
+			simulator.setSimulationSpeed(1.0f);
+
+			simulator.m_dyno.m_maxTorque = Graph.transmission->getMaxClutchTorque();
+			simulator.m_dyno.m_clutchPressure = 1.0;
+			simulator.m_dyno.m_enabled = true;
+			if (IgnitionModule* ignition = engine->getIgnitionModule())
+			{
+				ignition->m_enabled = true;
+			}
+		}
+
+		~FDynoSweep()
+		{
+			if (engine != nullptr)
+			{
+				simulator.releaseSimulation();
+			}
+			Definition.ReleaseGraph(Graph);
+		}
+
+		bool IsValid() const { return engine != nullptr; }
+
+		void Run(float Seconds)
+		{
+			const int32 Frames = FMath::Max(1, FMath::RoundToInt(Seconds / Settings.FrameTime));
+			for (int32 i = 0; i < Frames; ++i)
+			{
+				simulator.startFrame(Settings.FrameTime);
+				while (simulator.simulateStep()) {}
+				simulator.endFrame();
+			}
+		}
+
+		void Hold(float RPM, float Throttle)
+		{
+			engine->setSpeedControl(Throttle);
+			simulator.m_dyno.m_enabled = true;
+			simulator.m_dyno.m_rotationSpeed = units::rpm(RPM);
+		}
+
+		void Release()
+		{
+			simulator.m_dyno.m_enabled = false;
+		}
+
+		float MeasureTorque()
+		{
+			Run(Settings.SettleTime);
+
+			const int32 Frames = FMath::Max(1, FMath::RoundToInt(Settings.MeasureTime / Settings.FrameTime));
+			double Sum = 0.0;
+			for (int32 i = 0; i < Frames; ++i)
+			{
+				Run(Settings.FrameTime);
+				Sum += simulator.getFilteredDynoTorque();
+			}
+			return static_cast<float>(Sum / Frames);
+		}
+
+		float MeasureRPM()
+		{
+			const int32 Frames = FMath::Max(1, FMath::RoundToInt(Settings.MeasureTime / Settings.FrameTime));
+			double Sum = 0.0;
+			for (int32 i = 0; i < Frames; ++i)
+			{
+				Run(Settings.FrameTime);
+				Sum += engine->getRpm();
+			}
+			return static_cast<float>(Sum / Frames);
+		}
+
+		double GetSpeed() const { return FMath::Abs(engine->getSpeed()); }
+
+	private:
+		const FEngineDefinition& Definition;
+		const FEngineTorqueMapBakeSettings& Settings;
+		FEngineGraph Graph;
+		Engine* engine = nullptr;
+		Simulator simulator;
+	};
+}
+
+FArchive& operator<<(FArchive& Ar, FEngineTorqueMap& Map)
+{
+	Ar << Map.EngineName;
+	Ar << Map.Redline;
+	Ar << Map.Inertia;
+	Ar << Map.GearRatios;
+	Ar << Map.MaxClutchTorque;
+	Ar << Map.RPMs;
+	Ar << Map.Throttles;
+	Ar << Map.Torque;
+	Ar << Map.SteadyRPMs;
+	return Ar;
+}
+
+float FEngineTorqueMap::SampleTorque(float RPM, float Throttle) const
+{
+	if (!IsValid())
+	{
+		return 0.f;
+	}
+
+	auto FindCell = [](const TArray<float>& Axis, float Value, int32& OutIndex, float& OutAlpha)
+	{
+		Value = FMath::Clamp(Value, Axis[0], Axis.Last());
+		OutIndex = FMath::Clamp(Algo::UpperBound(Axis, Value) - 1, 0, Axis.Num() - 2);
+		OutAlpha = (Value - Axis[OutIndex]) / FMath::Max(Axis[OutIndex + 1] - Axis[OutIndex], KINDA_SMALL_NUMBER);
+	};
+
+	int32 Row, Column;
+	float RowAlpha, ColumnAlpha;
+	FindCell(RPMs, RPM, Row, RowAlpha);
+	FindCell(Throttles, Throttle, Column, ColumnAlpha);
+
+	const int32 NumThrottles = Throttles.Num();
+	const float* Low = &Torque[Row * NumThrottles + Column];
+	const float* High = Low + NumThrottles;
+
+	return FMath::Lerp(
+		FMath::Lerp(Low[0], Low[1], ColumnAlpha),
+		FMath::Lerp(High[0], High[1], ColumnAlpha),
+		RowAlpha);
+}
+
+bool FEngineTorqueMap::Save(const FString& Path) const
+{
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes);
+	int32 Version = EngineTorqueMapVersion;
+	Writer << Version;
+	FEngineTorqueMap Map = *this;
+	Writer << Map;
+
+	return FFileHelper::SaveArrayToFile(Bytes, *Path);
+}
+
+bool FEngineTorqueMap::Load(const FString& Path)
+{
+	TArray<uint8> Bytes;
+	if (!FFileHelper::LoadFileToArray(Bytes, *Path, FILEREAD_Silent))
+	{
+		return false;
+	}
+
+	FMemoryReader Reader(Bytes);
+	int32 Version = 0;
+	Reader << Version;
+	if (Version != EngineTorqueMapVersion)
+	{
+		return false;
+	}
+
+	Reader << *this;
+	return !Reader.IsError() && IsValid();
+}
+
+void FEngineTorqueMap::ToEngineConfig(FVehicleEngineConfig& OutConfig) const
+{
+	if (!IsValid())
+	{
+		return;
+	}
+
+	FRichCurve* Curve = OutConfig.TorqueCurve.GetRichCurve();
+	Curve->Reset();
+
+	float PeakTorque = 0.f;
+	for (const float RPM : RPMs)
+	{
+		const float FullThrottle = FMath::Max(SampleTorque(RPM, 1.f), 0.f);
+		Curve->AddKey(RPM, FullThrottle);
+		PeakTorque = FMath::Max(PeakTorque, FullThrottle);
+	}
+
+	OutConfig.MaxTorque = PeakTorque;
+	OutConfig.MaxRPM = Redline;
+	OutConfig.EngineRevUpMOI = Inertia;
+	if (SteadyRPMs.Num() > 0 && SteadyRPMs[0] > 0.f)
+	{
+		OutConfig.EngineIdleRPM = SteadyRPMs[0];
+	}
+
+	// Closed throttle losses halfway up the rev range, as the RPM per second they slow a free revving engine by
+	const float MidRPM = FMath::Lerp(RPMs[0], Redline, 0.5f);
+	const float Losses = -FMath::Min(SampleTorque(MidRPM, 0.f), 0.f);
+	if (Losses > 0.f)
+	{
+		OutConfig.EngineRevDownRate = Losses / Inertia * 30.f / PI;
+	}
+}
+
+bool FEngineTorqueMap::Bake(const FEngineDefinition& Definition, const FEngineTorqueMapBakeSettings& Settings, FEngineTorqueMap& OutMap)
+{
+	const FEngineScriptDescription& Description = Definition.GetDescription();
+	if (!Description.bCompiled || Settings.NumRPMs < 2 || Settings.Throttles.Num() < 2)
+	{
+		return false;
+	}
+
+	UE_LOG(LogTemp, Warning, TEXT("Baking torque map for %s"), *Definition.GetScriptPath());
+
+	OutMap = FEngineTorqueMap();
+	OutMap.EngineName = Description.EngineName;
+	OutMap.Redline = Description.Redline;
+	OutMap.GearRatios = Description.GearRatios;
+	OutMap.MaxClutchTorque = Description.MaxClutchTorque;
+	OutMap.Throttles = Settings.Throttles;
+
+	const float MaxRPM = FMath::Max(Description.Redline * Settings.MaxRPMOverRedline, Settings.MinRPM + 1.f);
+	for (int32 i = 0; i < Settings.NumRPMs; ++i)
+	{
+		OutMap.RPMs.Add(FMath::Lerp(Settings.MinRPM, MaxRPM, i / float(Settings.NumRPMs - 1)));
+	}
+
+	const int32 NumThrottles = OutMap.Throttles.Num();
+	OutMap.Torque.SetNumZeroed(OutMap.RPMs.Num() * NumThrottles);
+	OutMap.SteadyRPMs.SetNumZeroed(NumThrottles);
+
+	// Grid jobs sweep a run of RPMs at one throttle, stepping the dyno up in speed so each point starts close to
+	// settled. After those comes one free revving job per throttle for the steady RPMs, then the inertia run.
+	const int32 RowsPerJob = FMath::Max(1, Settings.RowsPerJob);
+	const int32 JobsPerThrottle = FMath::DivideAndRoundUp(OutMap.RPMs.Num(), RowsPerJob);
+	const int32 NumGridJobs = JobsPerThrottle * NumThrottles;
+	const int32 InertiaJob = NumGridJobs + NumThrottles;
+
+	const float InertiaRPM = FMath::Lerp(Settings.MinRPM, Description.Redline, 0.5f);
+	double InertiaStartSpeed = 0.0;
+	double InertiaSpeedGained = 0.0;
+	std::atomic<bool> bFailed(false);
+
+	// Engines that can't be described compile one at a time, so the graphs are acquired here rather than by each worker
+	// as it starts. Every worker then keeps its engine and takes jobs until they run out, the next job starts from
+	// wherever the last one left it.
+	const int32 NumJobs = InertiaJob + 1;
+	const int32 NumWorkers = FMath::Clamp(FTaskGraphInterface::Get().GetNumWorkerThreads() + 1, 1, NumJobs);
+	TArray<FEngineGraph> Graphs;
+	for (int32 i = 0; i < NumWorkers; ++i)
+	{
+		Graphs.Add(Definition.AcquireGraph());
+	}
+
+	std::atomic<int32> NextJob(0);
+	ParallelFor(NumWorkers, [&](int32 Worker)
+	{
+		FDynoSweep Sweep(Definition, Settings, Graphs[Worker]);
+		if (!Sweep.IsValid())
+		{
+			bFailed = true;
+			return;
+		}
+
+		for (int32 Job = NextJob++; Job < NumJobs && !bFailed; Job = NextJob++)
+		{
+			if (Job < NumGridJobs)
+			{
+				const int32 Column = Job / JobsPerThrottle;
+				const int32 FirstRow = (Job % JobsPerThrottle) * RowsPerJob;
+				const int32 LastRow = FMath::Min(FirstRow + RowsPerJob, OutMap.RPMs.Num());
+				for (int32 Row = FirstRow; Row < LastRow; ++Row)
+				{
+					Sweep.Hold(OutMap.RPMs[Row], OutMap.Throttles[Column]);
+					OutMap.Torque[Row * NumThrottles + Column] = Sweep.MeasureTorque();
+				}
+			}
+			else if (Job < InertiaJob)
+			{
+				// Get it running on the dyno first, then let it find its own speed
+				const int32 Column = Job - NumGridJobs;
+				Sweep.Hold(InertiaRPM, OutMap.Throttles[Column]);
+				Sweep.Run(Settings.SettleTime);
+				Sweep.Release();
+				Sweep.Run(Settings.SteadyStateTime);
+				OutMap.SteadyRPMs[Column] = Sweep.MeasureRPM();
+			}
+			else
+			{
+				// Let go at full throttle and see how quickly it spins up
+				Sweep.Hold(InertiaRPM, 1.f);
+				Sweep.Run(Settings.SettleTime);
+				Sweep.Release();
+				InertiaStartSpeed = Sweep.GetSpeed();
+				Sweep.Run(Settings.MeasureTime);
+				InertiaSpeedGained = Sweep.GetSpeed() - InertiaStartSpeed;
+			}
+		}
+	});
+
+	if (bFailed)
+	{
+		return false;
+	}
+
+	const float EndRPM = static_cast<float>(units::toRpm(InertiaStartSpeed + InertiaSpeedGained));
+	const float AverageTorque = 0.5f * (OutMap.SampleTorque(InertiaRPM, 1.f) + OutMap.SampleTorque(EndRPM, 1.f));
+	if (InertiaSpeedGained > KINDA_SMALL_NUMBER && AverageTorque > 0.f)
+	{
+		OutMap.Inertia = FMath::Clamp(static_cast<float>(AverageTorque * Settings.MeasureTime / InertiaSpeedGained), 0.02f, 5.f);
+	}
+
+	return OutMap.IsValid();
+}
+
+FEngineTorqueMapCache& FEngineTorqueMapCache::Get()
+{
+	static FEngineTorqueMapCache Cache;
+	return Cache;
+}
+
+FString FEngineTorqueMapCache::GetMapPath(const FEngineDefinition& Definition)
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("EngineSimulator"), TEXT("TorqueMaps"), Definition.GetKey() + TEXT(".bin"));
+}
+
+FEngineTorqueMapPtr FEngineTorqueMapCache::FindOrBake(const FEngineDefinition& Definition)
+{
+	const FString& Key = Definition.GetKey();
+	if (Key.IsEmpty())
+	{
+		return nullptr;
+	}
+
+	// Only this engine's lock is held while it bakes, so vehicles with other engines don't wait on it
+	TSharedPtr<FCriticalSection, ESPMode::ThreadSafe> KeyMutex;
+	{
+		FScopeLock Lock(&Mutex);
+		if (const TWeakPtr<const FEngineTorqueMap, ESPMode::ThreadSafe>* Entry = Maps.Find(Key))
+		{
+			if (FEngineTorqueMapPtr Map = Entry->Pin())
+			{
+				return Map;
+			}
+		}
+
+		TSharedPtr<FCriticalSection, ESPMode::ThreadSafe>& Found = KeyMutexes.FindOrAdd(Key);
+		if (!Found.IsValid())
+		{
+			Found = MakeShared<FCriticalSection, ESPMode::ThreadSafe>();
+		}
+		KeyMutex = Found;
+	}
+	FScopeLock KeyLock(KeyMutex.Get());
+
+	// Someone else may have baked it while this waited
+	{
+		FScopeLock Lock(&Mutex);
+		if (const TWeakPtr<const FEngineTorqueMap, ESPMode::ThreadSafe>* Entry = Maps.Find(Key))
+		{
+			if (FEngineTorqueMapPtr Map = Entry->Pin())
+			{
+				return Map;
+			}
+		}
+	}
+
+	TSharedPtr<FEngineTorqueMap, ESPMode::ThreadSafe> Map = MakeShared<FEngineTorqueMap, ESPMode::ThreadSafe>();
+	const FString Path = GetMapPath(Definition);
+	if (!Map->Load(Path))
+	{
+		if (!FEngineTorqueMap::Bake(Definition, FEngineTorqueMapBakeSettings(), *Map))
+		{
+			UE_LOG(LogTemp, Error, TEXT("Failed to bake torque map for %s"), *Definition.GetScriptPath());
+			return nullptr;
+		}
+
+		if (!Map->Save(Path))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Failed to write torque map %s"), *Path);
+		}
+	}
+
+	{
+		FScopeLock Lock(&Mutex);
+		Maps.Add(Key, Map);
+	}
+	return Map;
+}
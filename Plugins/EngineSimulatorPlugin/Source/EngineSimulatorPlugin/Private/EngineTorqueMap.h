@@ -0,0 +1,85 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EngineDefinitionRegistry.h"
+
+struct FVehicleEngineConfig;
+
+struct FEngineTorqueMapBakeSettings
+{
+	int32 NumRPMs = 16;
+	TArray<float> Throttles = { 0.f, 0.1f, 0.25f, 0.5f, 0.75f, 1.f };
+	float MinRPM = 600.f;
+	float MaxRPMOverRedline = 1.05f;
+
+	float FrameTime = 1.f / 60.f;
+	float SettleTime = 0.4f; // Seconds held at each point before measuring
+	float MeasureTime = 0.3f; // Seconds the dyno torque is averaged over
+	float SteadyStateTime = 1.5f; // Seconds the engine revs freely before its steady RPM is read
+
+	// RPM points swept per job. Smaller jobs spread better over the workers but settle from further away more often.
+	int32 RowsPerJob = 4;
+};
+
+/**
+ * Crank torque of an engine sampled on an RPM x throttle grid by holding the real simulation at speed on the dyno.
+ * Cheap enough to evaluate for hundreds of vehicles, see FEngineSurrogate.
+ */
+struct FEngineTorqueMap
+{
+	FString EngineName;
+	float Redline = 0.f; // RPM
+	float Inertia = 0.2f; // kg m^2, effective inertia of the rotating assembly
+	TArray<double> GearRatios;
+	double MaxClutchTorque = 0.0;
+
+	TArray<float> RPMs;
+	TArray<float> Throttles;
+	TArray<float> Torque; // N m at the crank, NumRPMs rows of NumThrottles
+	TArray<float> SteadyRPMs; // RPM the engine settles at in neutral, per throttle
+
+	// Bilinear lookup, clamped to the grid
+	float SampleTorque(float RPM, float Throttle) const;
+
+	// Watts
+	float SamplePower(float RPM, float Throttle) const { return SampleTorque(RPM, Throttle) * RPM * PI / 30.f; }
+
+	// Fills the Chaos engine setup from the full throttle curve, for vehicles simulated by Chaos' own engine model
+	void ToEngineConfig(FVehicleEngineConfig& OutConfig) const;
+
+	bool IsValid() const { return RPMs.Num() > 1 && Throttles.Num() > 1 && Torque.Num() == RPMs.Num() * Throttles.Num(); }
+
+	bool Save(const FString& Path) const;
+	bool Load(const FString& Path);
+
+	// Sweeps the engine on the dyno, spread over the task system workers
+	static bool Bake(const FEngineDefinition& Definition, const FEngineTorqueMapBakeSettings& Settings, FEngineTorqueMap& OutMap);
+
+	friend FArchive& operator<<(FArchive& Ar, FEngineTorqueMap& Map);
+};
+
+using FEngineTorqueMapPtr = TSharedPtr<const FEngineTorqueMap, ESPMode::ThreadSafe>;
+
+/**
+ * Torque maps shared between every surrogate running the same engine definition.
+ * Baked maps are kept under Saved/EngineSimulator/TorqueMaps, keyed like the script cache so they go stale with the scripts.
+ */
+class FEngineTorqueMapCache
+{
+public:
+	static FEngineTorqueMapCache& Get();
+
+	static FString GetMapPath(const FEngineDefinition& Definition);
+
+	// Loads the baked map for the definition, or bakes it if there isn't one yet. Returns null if the engine doesn't compile.
+	FEngineTorqueMapPtr FindOrBake(const FEngineDefinition& Definition);
+
+private:
+	FCriticalSection Mutex;
+	TMap<FString, TWeakPtr<const FEngineTorqueMap, ESPMode::ThreadSafe>> Maps;
+
+	// One per key, held while baking so two vehicles spawning with the same engine don't both sweep it
+	TMap<FString, TSharedPtr<FCriticalSection, ESPMode::ThreadSafe>> KeyMutexes;
+};
@@ -0,0 +1,138 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EngineWarmStartCache.h"
+#include "EngineSimulator.h"
+#include "EngineSimulatorState.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+
+static const float WarmStartFrameTime = 1.f / 60.f;
+static const float WarmStartCrankTime = 1.5f; // Seconds on the starter
+static const float WarmStartSettleTime = 3.f; // Seconds idling on its own before the snapshot
+
+const float FEngineWarmStartCache::MinIdleRPM = 300.f;
+
+FEngineWarmStartCache& FEngineWarmStartCache::Get()
+{
+	static FEngineWarmStartCache Cache;
+	return Cache;
+}
+
+FString FEngineWarmStartCache::GetStatePath(const FEngineDefinition& Definition)
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("EngineSimulator"), TEXT("WarmStart"), Definition.GetKey() + TEXT(".bin"));
+}
+
+FEngineWarmStartStatePtr FEngineWarmStartCache::FindOrRoll(const FEngineDefinition& Definition)
+{
+	const FString& Key = Definition.GetKey();
+	if (Key.IsEmpty() || !Definition.GetDescription().bCompiled)
+	{
+		return nullptr;
+	}
+
+	// Only this engine's lock is held while it rolls, so vehicles with other engines don't wait on it
+	TSharedPtr<FCriticalSection, ESPMode::ThreadSafe> KeyMutex;
+	{
+		FScopeLock Lock(&Mutex);
+		if (const TWeakPtr<const TArray<uint8>, ESPMode::ThreadSafe>* Entry = States.Find(Key))
+		{
+			if (FEngineWarmStartStatePtr State = Entry->Pin())
+			{
+				return State;
+			}
+		}
+
+		TSharedPtr<FCriticalSection, ESPMode::ThreadSafe>& Found = KeyMutexes.FindOrAdd(Key);
+		if (!Found.IsValid())
+		{
+			Found = MakeShared<FCriticalSection, ESPMode::ThreadSafe>();
+		}
+		KeyMutex = Found;
+	}
+	FScopeLock KeyLock(KeyMutex.Get());
+
+	// Someone else may have rolled it while this waited
+	{
+		FScopeLock Lock(&Mutex);
+		if (const TWeakPtr<const TArray<uint8>, ESPMode::ThreadSafe>* Entry = States.Find(Key))
+		{
+			if (FEngineWarmStartStatePtr State = Entry->Pin())
+			{
+				return State;
+			}
+		}
+	}
+
+	TSharedPtr<TArray<uint8>, ESPMode::ThreadSafe> State = MakeShared<TArray<uint8>, ESPMode::ThreadSafe>();
+	const FString Path = GetStatePath(Definition);
+
+	// Snapshots from an older layout are rolled again rather than half restored
+	bool bLoaded = FFileHelper::LoadFileToArray(*State, *Path, FILEREAD_Silent);
+	if (bLoaded)
+	{
+		FMemoryReader Reader(*State);
+		FEngineSimulatorStateHeader Header;
+		Reader << Header;
+		bLoaded = !Reader.IsError() && Header.IsValid();
+	}
+
+	if (!bLoaded)
+	{
+		if (!Roll(Definition, *State))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("%s doesn't idle on its own, it will start on the starter"), *Definition.GetScriptPath());
+			return nullptr;
+		}
+
+		if (!FFileHelper::SaveArrayToFile(*State, *Path))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Failed to write warm start state %s"), *Path);
+		}
+	}
+
+	{
+		FScopeLock Lock(&Mutex);
+		States.Add(Key, State);
+	}
+	return State;
+}
+
+bool FEngineWarmStartCache::Roll(const FEngineDefinition& Definition, TArray<uint8>& OutState)
+{
+	UE_LOG(LogTemp, Log, TEXT("Rolling warm start state for %s"), *Definition.GetScriptPath());
+
+	// Headless, nothing listens to this engine
+	FEngineSimulatorParameters Parameters;
+	Parameters.ScriptPath = Definition.GetScriptPath();
+	TUniquePtr<IEngineSimulatorInterface> Engine = CreateEngine(Parameters);
+	if (!Engine.IsValid() || !Engine->HasEngine())
+	{
+		return false;
+	}
+
+	Engine->SetGear(-1);
+	Engine->SetSpeedControl(0.f);
+	Engine->SetIgnitionEnabled(true);
+	Engine->SetStarterEnabled(true);
+
+	for (float Time = 0.f; Time < WarmStartCrankTime; Time += WarmStartFrameTime)
+	{
+		Engine->Simulate(WarmStartFrameTime);
+	}
+
+	Engine->SetStarterEnabled(false);
+	for (float Time = 0.f; Time < WarmStartSettleTime; Time += WarmStartFrameTime)
+	{
+		Engine->Simulate(WarmStartFrameTime);
+	}
+
+	if (Engine->GetRPM() < MinIdleRPM)
+	{
+		return false;
+	}
+
+	Engine->SaveState(OutState);
+	return true;
+}
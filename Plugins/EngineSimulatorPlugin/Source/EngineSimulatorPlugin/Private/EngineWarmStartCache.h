@@ -0,0 +1,37 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EngineDefinitionRegistry.h"
+
+using FEngineWarmStartStatePtr = TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe>;
+
+/**
+ * Snapshots of every engine definition already cranked and settled at idle, so new engines start running instead of
+ * spending their first seconds on the starter. Rolled once per definition and kept under Saved/EngineSimulator/WarmStart,
+ * keyed like the script cache.
+ */
+class FEngineWarmStartCache
+{
+public:
+	static FEngineWarmStartCache& Get();
+
+	// Below this an engine is taken as stalled
+	static const float MinIdleRPM;
+
+	static FString GetStatePath(const FEngineDefinition& Definition);
+
+	// Loads the idle snapshot for the definition, or simulates one if there isn't one yet. Returns null if the engine
+	// doesn't compile or doesn't keep running on its own.
+	FEngineWarmStartStatePtr FindOrRoll(const FEngineDefinition& Definition);
+
+private:
+	static bool Roll(const FEngineDefinition& Definition, TArray<uint8>& OutState);
+
+	FCriticalSection Mutex;
+	TMap<FString, TWeakPtr<const TArray<uint8>, ESPMode::ThreadSafe>> States;
+
+	// One per key, held while rolling so vehicles spawning together with the same engine don't all simulate it
+	TMap<FString, TSharedPtr<FCriticalSection, ESPMode::ThreadSafe>> KeyMutexes;
+};
@@ -0,0 +1,82 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ImpulseResponseCache.h"
+#include "EngineSimulatorStats.h"
+#include "Misc/Paths.h"
+
+#include "EngineSimulatorInternals/HeaderFixesStart.h"
+
+#include "delta.h"
+
+#include "EngineSimulatorInternals/HeaderFixesEnd.h"
+
+DECLARE_CYCLE_STAT(TEXT("EngineSimulator:LoadImpulseResponse"), STAT_EngineSimulatorPlugin_LoadImpulseResponse, STATGROUP_EngineSimulatorPlugin);
+
+// Longest impulse response the synthesizer convolves with, anything past it is dropped
+static const int32 MaxImpulseResponseSamples = 10000;
+
+void FImpulseResponseSamples::ToFloat(float Volume, TArray<float>& OutImpulseResponse) const
+{
+	int32 Length = 0;
+	for (int32 i = 0; i < Samples.Num(); ++i)
+	{
+		if (FMath::Abs(Samples[i]) > 100)
+		{
+			Length = i + 1;
+		}
+	}
+	Length = FMath::Min(Length, MaxImpulseResponseSamples);
+
+	const float Scale = Volume / INT16_MAX;
+
+	OutImpulseResponse.SetNumUninitialized(Length);
+	for (int32 i = 0; i < Length; ++i)
+	{
+		OutImpulseResponse[i] = Samples[i] * Scale;
+	}
+}
+
+FImpulseResponseCache& FImpulseResponseCache::Get()
+{
+	static FImpulseResponseCache Cache;
+	return Cache;
+}
+
+FImpulseResponseSamplesPtr FImpulseResponseCache::FindOrLoad(const FString& Filename)
+{
+	const FString Key = FPaths::ConvertRelativePathToFull(Filename);
+
+	FScopeLock Lock(&Mutex);
+
+	if (const TWeakPtr<const FImpulseResponseSamples, ESPMode::ThreadSafe>* Entry = Entries.Find(Key))
+	{
+		if (FImpulseResponseSamplesPtr Samples = Entry->Pin())
+		{
+			return Samples;
+		}
+	}
+
+	if (!FPaths::FileExists(Key))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Impulse response doesn't exist: %s"), *Key);
+		return nullptr;
+	}
+
+	UE_LOG(LogTemp, Warning, TEXT("Loading audio file: %s"), *Key);
+	ENGINESIMULATOR_SCOPE_CYCLE_COUNTER(STAT_EngineSimulatorPlugin_LoadImpulseResponse);
+
+	ysWindowsAudioWaveFile waveFile;
+	waveFile.OpenFile(TCHAR_TO_UTF8(*Key));
+	waveFile.InitializeInternalBuffer(waveFile.GetSampleCount());
+	waveFile.FillBuffer(0);
+	waveFile.CloseFile();
+
+	TSharedPtr<FImpulseResponseSamples, ESPMode::ThreadSafe> Samples = MakeShared<FImpulseResponseSamples, ESPMode::ThreadSafe>();
+	Samples->Filename = Key;
+	Samples->Samples.Append(reinterpret_cast<const int16*>(waveFile.GetBuffer()), waveFile.GetSampleCount());
+
+	waveFile.DestroyInternalBuffer();
+
+	Entries.Add(Key, Samples);
+	return Samples;
+}
@@ -0,0 +1,37 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Decoded samples of one impulse response wav file. Shared read-only between every synthesizer using it.
+ */
+struct FImpulseResponseSamples
+{
+	FString Filename;
+	TArray<int16> Samples;
+
+	// The response Synthesizer::initializeImpulseResponse would convolve with: quiet tail trimmed, at most 10000 samples,
+	// scaled by Volume / INT16_MAX
+	void ToFloat(float Volume, TArray<float>& OutImpulseResponse) const;
+};
+
+using FImpulseResponseSamplesPtr = TSharedPtr<const FImpulseResponseSamples, ESPMode::ThreadSafe>;
+
+/**
+ * Process-wide cache of decoded impulse responses keyed by path.
+ * Entries are only referenced weakly here, they stay in memory for as long as a definition or simulator holds on to them.
+ */
+class FImpulseResponseCache
+{
+public:
+	static FImpulseResponseCache& Get();
+
+	// Returns the decoded samples, reading the file only if nobody currently holds it. Null if it can't be read.
+	FImpulseResponseSamplesPtr FindOrLoad(const FString& Filename);
+
+private:
+	FCriticalSection Mutex;
+	TMap<FString, TWeakPtr<const FImpulseResponseSamples, ESPMode::ThreadSafe>> Entries;
+};
@@ -0,0 +1,176 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PartitionedConvolver.h"
+#include "DSP/FFTAlgorithm.h"
+
+namespace
+{
+	float GetScalingFactor(Audio::EFFTScaling Scaling, float Size)
+	{
+		switch (Scaling)
+		{
+		case Audio::EFFTScaling::MultipliedByFFTSize:
+			return Size;
+		case Audio::EFFTScaling::MultipliedBySqrtFFTSize:
+			return FMath::Sqrt(Size);
+		case Audio::EFFTScaling::DividedByFFTSize:
+			return 1.f / Size;
+		case Audio::EFFTScaling::DividedBySqrtFFTSize:
+			return 1.f / FMath::Sqrt(Size);
+		default:
+			return 1.f;
+		}
+	}
+}
+
+FPartitionedConvolver::FPartitionedConvolver()
+	: BlockSize(0)
+	, FFTSize(0)
+	, NumPartitions(0)
+	, NumSpectrumFloats(0)
+	, InputSpectraHead(0)
+	, BlockOffset(0)
+{
+}
+
+FPartitionedConvolver::~FPartitionedConvolver()
+{
+}
+
+bool FPartitionedConvolver::Initialize(const float* ImpulseResponse, int32 NumSamples, int32 InBlockSize)
+{
+	check(FMath::IsPowerOfTwo(InBlockSize));
+
+	BlockSize = InBlockSize;
+	FFTSize = 2 * BlockSize;
+	NumPartitions = FMath::Max(1, FMath::DivideAndRoundUp(NumSamples, BlockSize));
+
+	Audio::FFFTSettings Settings;
+	Settings.Log2Size = FMath::CountTrailingZeros(FFTSize);
+	Settings.bArrays128BitAligned = true;
+	Settings.bEnableHardwareAcceleration = true;
+	FFT = Audio::FFFTFactory::NewFFTAlgorithm(Settings);
+	if (!FFT.IsValid())
+	{
+		return false;
+	}
+
+	NumSpectrumFloats = FFT->NumOutputFloats();
+
+	// Forward transform the input and the impulse response, multiply, inverse transform. Whatever scaling the
+	// algorithm applies along that path plus the FFTSize an unscaled round trip leaves gets folded into the spectra here.
+	const float Size = static_cast<float>(FFTSize);
+	const float ForwardScale = GetScalingFactor(FFT->ForwardScaling(), Size);
+	const float InverseScale = GetScalingFactor(FFT->InverseScaling(), Size);
+	const float Correction = 1.f / (ForwardScale * ForwardScale * InverseScale * Size);
+
+	ImpulseResponseSpectra.SetNumZeroed(NumPartitions * NumSpectrumFloats);
+
+	Audio::FAlignedFloatBuffer Partition;
+	Partition.SetNumUninitialized(FFT->NumInputFloats());
+	for (int32 p = 0; p < NumPartitions; ++p)
+	{
+		FMemory::Memzero(Partition.GetData(), Partition.Num() * sizeof(float));
+
+		const int32 Start = p * BlockSize;
+		const int32 Count = FMath::Min(BlockSize, NumSamples - Start);
+		for (int32 i = 0; i < Count; ++i)
+		{
+			Partition[i] = ImpulseResponse[Start + i] * Correction;
+		}
+
+		FFT->ForwardRealToComplex(Partition.GetData(), ImpulseResponseSpectra.GetData() + p * NumSpectrumFloats);
+	}
+
+	InputSpectra.SetNumZeroed(NumPartitions * NumSpectrumFloats);
+	InputSpectraHead = 0;
+
+	InputWindow.SetNumZeroed(FFT->NumInputFloats());
+	AccumulatedSpectrum.SetNumZeroed(NumSpectrumFloats);
+	TimeDomainOutput.SetNumZeroed(FFT->NumInputFloats());
+
+	BlockOffset = 0;
+
+	return true;
+}
+
+void FPartitionedConvolver::Process(const float* Input, float* Output, int32 NumSamples)
+{
+	check(FFT.IsValid());
+
+	float* NewInput = InputWindow.GetData() + BlockSize;
+	const float* BlockOutput = TimeDomainOutput.GetData() + BlockSize;
+
+	int32 Done = 0;
+	while (Done < NumSamples)
+	{
+		const int32 Count = FMath::Min(NumSamples - Done, BlockSize - BlockOffset);
+
+		// Read all of this chunk before writing any of it so the buffers can alias
+		FMemory::Memcpy(NewInput + BlockOffset, Input + Done, Count * sizeof(float));
+		FMemory::Memcpy(Output + Done, BlockOutput + BlockOffset, Count * sizeof(float));
+
+		BlockOffset += Count;
+		Done += Count;
+
+		if (BlockOffset == BlockSize)
+		{
+			ProcessBlock();
+			BlockOffset = 0;
+		}
+	}
+}
+
+void FPartitionedConvolver::ProcessBlock()
+{
+	// The newest input spectrum goes into the delay line slot after the previous one
+	InputSpectraHead = (InputSpectraHead + 1) % NumPartitions;
+	FFT->ForwardRealToComplex(InputWindow.GetData(), InputSpectra.GetData() + InputSpectraHead * NumSpectrumFloats);
+
+	FMemory::Memzero(AccumulatedSpectrum.GetData(), NumSpectrumFloats * sizeof(float));
+	float* RESTRICT Accumulated = AccumulatedSpectrum.GetData();
+
+	// Partition p of the impulse response is applied to the input from p blocks ago
+	int32 Slot = InputSpectraHead;
+	for (int32 p = 0; p < NumPartitions; ++p)
+	{
+		const float* RESTRICT X = InputSpectra.GetData() + Slot * NumSpectrumFloats;
+		const float* RESTRICT H = ImpulseResponseSpectra.GetData() + p * NumSpectrumFloats;
+
+		for (int32 i = 0; i < NumSpectrumFloats; i += 2)
+		{
+			Accumulated[i] += X[i] * H[i] - X[i + 1] * H[i + 1];
+			Accumulated[i + 1] += X[i] * H[i + 1] + X[i + 1] * H[i];
+		}
+
+		Slot = (Slot == 0 ? NumPartitions : Slot) - 1;
+	}
+
+	FFT->InverseComplexToReal(AccumulatedSpectrum.GetData(), TimeDomainOutput.GetData());
+
+	// Overlap-save: the first half of the window is the previous block, slide the new block into its place
+	FMemory::Memcpy(InputWindow.GetData(), InputWindow.GetData() + BlockSize, BlockSize * sizeof(float));
+}
+
+void FPartitionedConvolver::SerializeState(FArchive& Ar)
+{
+	int32 SavedBlockSize = BlockSize;
+	int32 SavedNumPartitions = NumPartitions;
+	Ar << SavedBlockSize << SavedNumPartitions;
+
+	if (Ar.IsLoading() && (SavedBlockSize != BlockSize || SavedNumPartitions != NumPartitions))
+	{
+		Audio::FAlignedFloatBuffer Discard;
+		int32 DiscardInt = 0;
+		Ar << Discard << DiscardInt << Discard << Discard << DiscardInt;
+
+		FMemory::Memzero(InputSpectra.GetData(), InputSpectra.Num() * sizeof(float));
+		FMemory::Memzero(InputWindow.GetData(), InputWindow.Num() * sizeof(float));
+		FMemory::Memzero(TimeDomainOutput.GetData(), TimeDomainOutput.Num() * sizeof(float));
+		InputSpectraHead = 0;
+		BlockOffset = 0;
+		return;
+	}
+
+	Ar << InputSpectra << InputSpectraHead << InputWindow << TimeDomainOutput << BlockOffset;
+}
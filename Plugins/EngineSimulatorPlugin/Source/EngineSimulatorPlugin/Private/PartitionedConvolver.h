@@ -0,0 +1,56 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DSP/AlignedBuffer.h"
+
+namespace Audio
+{
+	class IFFTAlgorithm;
+}
+
+/**
+ * Uniformly partitioned FFT convolution (overlap-save with a frequency domain delay line).
+ * The impulse response spectra are computed once in Initialize(), after that each block of BlockSize samples
+ * costs two FFTs plus one complex multiply-add per partition, instead of one multiply-add per impulse response sample per sample.
+ * Output lags input by BlockSize samples.
+ */
+class FPartitionedConvolver
+{
+public:
+	FPartitionedConvolver();
+	~FPartitionedConvolver();
+
+	// BlockSize has to be a power of two
+	bool Initialize(const float* ImpulseResponse, int32 NumSamples, int32 InBlockSize = 256);
+
+	// Input and Output may point to the same buffer
+	void Process(const float* Input, float* Output, int32 NumSamples);
+
+	int32 GetLatency() const { return BlockSize; }
+
+	// Saves or restores the delay line and the block in flight, so a restored engine doesn't start from silence.
+	// State saved by a convolver of a different shape is read past and the delay line cleared instead.
+	void SerializeState(FArchive& Ar);
+
+private:
+	void ProcessBlock();
+
+	int32 BlockSize;
+	int32 FFTSize;
+	int32 NumPartitions;
+	int32 NumSpectrumFloats;
+
+	TUniquePtr<Audio::IFFTAlgorithm> FFT;
+
+	Audio::FAlignedFloatBuffer ImpulseResponseSpectra;
+	Audio::FAlignedFloatBuffer InputSpectra;
+	int32 InputSpectraHead;
+
+	Audio::FAlignedFloatBuffer InputWindow;
+	Audio::FAlignedFloatBuffer AccumulatedSpectrum;
+	Audio::FAlignedFloatBuffer TimeDomainOutput;
+
+	int32 BlockOffset;
+};
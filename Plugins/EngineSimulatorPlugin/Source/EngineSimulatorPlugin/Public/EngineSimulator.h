@@ -3,11 +3,53 @@
 #pragma once
 
 #include "Templates/UniquePtr.h"
+#include "Tasks/Task.h"
+#include "EngineSimulatorLOD.h"
 
 class Simulator;
 class Engine;
 class Vehicle;
 class Transmission;
+class FEngineTelemetryRecorder;
+class FEngineSimulatorScopes;
+class USoundWaveProcedural;
+
+// Health of the handoff between the simulation and the audio callback
+struct FEngineSimulatorAudioStats
+{
+	uint32 QueuedSamples = 0; // Currently waiting for the audio callback
+	uint32 CapacitySamples = 0;
+	uint64 Underruns = 0; // Callbacks that couldn't be filled completely
+	uint64 UnderrunSamples = 0; // Samples missing across all underruns
+};
+
+// Cost of the simulation since the engine was created. Step counts and times are only safe to read from the thread
+// that steps the engine.
+struct FEngineSimulatorPerformanceStats
+{
+	uint64 Frames = 0; // Simulate() calls that ran at least one step
+	uint64 Steps = 0; // simulateStep() calls across all frames
+	double StepSeconds = 0.0; // Time spent inside simulateStep()
+	uint32 LastFrameSteps = 0;
+	uint32 MinFrameSteps = 0;
+	uint32 MaxFrameSteps = 0;
+	uint64 SamplesProduced = 0; // Read out of the synthesizer
+	uint64 SamplesConsumed = 0; // Handed to the sound wave
+	uint64 DegradedFrames = 0; // Frames that ran with fewer fluid steps, less simulated time or were cut short to stay in budget
+	double DroppedSeconds = 0.0; // Simulated time given up to stay in budget, the engine ran slow by this much
+};
+
+// What carries over when a vehicle switches between the full simulator and its surrogate
+struct FEngineSimulatorHandoffState
+{
+	float RPM = 0.f;
+	int32 Gear = -1;
+	float SpeedControl = 0.f;
+	float ClutchPressure = 1.f;
+	bool bStarterEnabled = false;
+	bool bIgnitionEnabled = true;
+	bool bDynoEnabled = true;
+};
 
 class ENGINESIMULATORPLUGIN_API IEngineSimulatorInterface
 {
@@ -32,13 +74,83 @@ public:
 	virtual bool IsDynoEnabled() = 0;
 	virtual bool HasEngine() = 0;
 	virtual FString GetName() = 0;
+	virtual FEngineSimulatorAudioStats GetAudioStats() { return FEngineSimulatorAudioStats(); }
+	virtual FEngineSimulatorPerformanceStats GetPerformanceStats() { return FEngineSimulatorPerformanceStats(); }
+	virtual void SetLOD(EEngineSimulatorLOD LOD) {}
+	virtual EEngineSimulatorLOD GetLOD() { return EEngineSimulatorLOD::Full; }
+
+	// Streams every simulation step to the recorder until it's set back to null. The surrogate has nothing to record.
+	virtual void SetTelemetryRecorder(FEngineTelemetryRecorder* Recorder) {}
+
+	// Hands synthesized audio to the wave, from its underflow callback on the audio render thread. Engines don't bind
+	// to the wave themselves, whoever owns them forwards the callback to the one that's running. Silent by default.
+	virtual void FillAudio(USoundWaveProcedural* Wave, int32 SamplesNeeded) {}
+	virtual FEngineSimulatorHandoffState GetHandoffState() = 0;
+	virtual void ApplyHandoffState(const FEngineSimulatorHandoffState& State) = 0;
+
+	// Compact binary snapshot of the running engine. OutState is reset rather than freed, reuse it to snapshot every frame.
+	// Of the audio path only the partitioned convolver's delay line is saved. The synthesizer's filters, leveler gain
+	// and convolution history are engine-sim internals, on load they carry on from wherever the loading engine had them.
+	virtual void SaveState(TArray<uint8>& OutState) = 0;
+
+	// Restores a snapshot taken by SaveState. Returns false if it came from a different engine, or the other
+	// implementation, in which case only RPM, gear and the controls carry over.
+	virtual bool LoadState(const TArray<uint8>& State) = 0;
 	virtual ~IEngineSimulatorInterface() {};
 };
 
 struct FEngineSimulatorParameters
 {
 	bool bShowGUI = false;
-	class USoundWaveProcedural* SoundWaveOutput = nullptr;
+
+	// Wave the engine is heard through, see IEngineSimulatorInterface::FillAudio
+	USoundWaveProcedural* SoundWaveOutput = nullptr;
+
+	// Engine script relative to the plugin's assets directory, empty uses main.mr
+	FString ScriptPath;
+
+	// Convolve the exhaust impulse response with FFT partitions instead of directly in the synthesizer. The output is
+	// convolved after the synthesizer's leveler, which is fed the response's RMS gain so the level stays within 1 dB.
+	bool bPartitionedConvolution = false;
+
+	// Rate SoundWaveOutput plays at, 0 for the synthesizer's own 44.1kHz. The synthesizer's output is resampled to
+	// anything else, e.g. the audio mixer's rate so it doesn't resample again.
+	int32 OutputSampleRate = 0;
+
+	// Start with the baked torque map surrogate instead of the full simulation
+	bool bSurrogate = false;
+
+	// Step the engine inside each physics substep and use its torque in that same substep, instead of a frame behind on
+	// the task system
+	bool bInlineStepping = false;
+
+	// CPU time one engine may spend stepping per frame, 0 for no limit. Over budget the engine drops fluid steps and then
+	// simulates less time than passed instead of falling further behind.
+	float StepBudgetMs = 0.f;
+
+	// Start from a snapshot of the engine already idling instead of from rest, see FEngineWarmStartCache
+	bool bWarmStart = false;
+
+	// With bWarmStart, put the engine on the starter if it comes up stopped or stalls in its first seconds, e.g. when
+	// there's no warm state for the script
+	bool bStarterIfStalled = false;
+
+	// Waveform taps the engine feeds while something listens, owned by the vehicle and outliving its engines
+	FEngineSimulatorScopes* Scopes = nullptr;
 };
 
 TUniquePtr<IEngineSimulatorInterface> CreateEngine(const FEngineSimulatorParameters& Parameters);
+
+// Torque map driven stand-in for the full simulation, silent and a fraction of the cost. Bakes the map on first use.
+TUniquePtr<IEngineSimulatorInterface> CreateSurrogateEngine(const FEngineSimulatorParameters& Parameters);
+
+using FEngineSimulatorCreateTask = UE::Tasks::TTask<TUniquePtr<IEngineSimulatorInterface>>;
+
+// Creates the engine, or its surrogate, on a task system worker: compiles the script, loads its impulse responses,
+// sets up the simulator and then restores InitialState, or the warm start state if there isn't one
+ENGINESIMULATORPLUGIN_API FEngineSimulatorCreateTask CreateEngineAsync(const FEngineSimulatorParameters& Parameters, TArray<uint8> InitialState = TArray<uint8>());
+
+// Does the expensive part of creating an engine ahead of time, e.g. while a level loads: compiles the script and loads
+// its impulse responses, and rolls the warm start state or bakes the torque map if the parameters ask for them.
+// Engines created afterwards only have to set up their simulator, as long as no more than NumEngines spawn at once.
+ENGINESIMULATORPLUGIN_API UE::Tasks::FTask PreloadEngine(const FEngineSimulatorParameters& Parameters, int32 NumEngines = 1);
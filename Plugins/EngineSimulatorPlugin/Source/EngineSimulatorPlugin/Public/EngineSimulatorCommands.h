@@ -0,0 +1,192 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EngineSimulator.h"
+#include "EngineSimulatorLOD.h"
+#include <atomic>
+
+enum class EEngineSimulatorCommand : uint8
+{
+	// Continuous controls, only the latest value is applied
+	SetThrottle,
+	SetClutchPressure,
+	NumContinuous,
+
+	// Applied in the order they were sent
+	SetGear = NumContinuous,
+	SetStarter,
+	SetIgnition,
+	SetLOD,
+};
+
+/**
+ * One control change for an engine, small enough to copy around by value.
+ */
+struct FEngineSimulatorCommand
+{
+	EEngineSimulatorCommand Type = EEngineSimulatorCommand::SetThrottle;
+	union
+	{
+		float Float;
+		int32 Int;
+		bool Bool;
+		EEngineSimulatorLOD LOD;
+	};
+
+	FEngineSimulatorCommand() : Float(0.f) {}
+
+	// Throttle is the engine's speed control, 0 - 1
+	static FEngineSimulatorCommand SetThrottle(float Throttle) { FEngineSimulatorCommand Command; Command.Type = EEngineSimulatorCommand::SetThrottle; Command.Float = Throttle; return Command; }
+	static FEngineSimulatorCommand SetClutchPressure(float Pressure) { FEngineSimulatorCommand Command; Command.Type = EEngineSimulatorCommand::SetClutchPressure; Command.Float = Pressure; return Command; }
+	static FEngineSimulatorCommand SetGear(int32 Gear) { FEngineSimulatorCommand Command; Command.Type = EEngineSimulatorCommand::SetGear; Command.Int = Gear; return Command; }
+	static FEngineSimulatorCommand SetStarter(bool bEnabled) { FEngineSimulatorCommand Command; Command.Type = EEngineSimulatorCommand::SetStarter; Command.Bool = bEnabled; return Command; }
+	static FEngineSimulatorCommand SetIgnition(bool bEnabled) { FEngineSimulatorCommand Command; Command.Type = EEngineSimulatorCommand::SetIgnition; Command.Bool = bEnabled; return Command; }
+	static FEngineSimulatorCommand SetLOD(EEngineSimulatorLOD InLOD) { FEngineSimulatorCommand Command; Command.Type = EEngineSimulatorCommand::SetLOD; Command.LOD = InLOD; return Command; }
+
+	bool IsContinuous() const { return Type < EEngineSimulatorCommand::NumContinuous; }
+
+	void Apply(IEngineSimulatorInterface& Engine) const
+	{
+		switch (Type)
+		{
+		case EEngineSimulatorCommand::SetThrottle:
+			Engine.SetSpeedControl(Float);
+			break;
+		case EEngineSimulatorCommand::SetClutchPressure:
+			Engine.SetClutchPressure(Float);
+			break;
+		case EEngineSimulatorCommand::SetGear:
+			Engine.SetGear(Int);
+			break;
+		case EEngineSimulatorCommand::SetStarter:
+			Engine.SetStarterEnabled(Bool);
+			break;
+		case EEngineSimulatorCommand::SetIgnition:
+			Engine.SetIgnitionEnabled(Bool);
+			break;
+		case EEngineSimulatorCommand::SetLOD:
+			Engine.SetLOD(LOD);
+			break;
+		default:
+			break;
+		}
+	}
+};
+
+static_assert(sizeof(FEngineSimulatorCommand) <= 8, "Engine commands are meant to stay a couple of words");
+
+/**
+ * Lock-free multiple producer, single consumer queue of engine commands with all of its storage inline.
+ * Continuous controls overwrite a slot per control, so a throttle sent every physics step is one store rather than a
+ * queue entry. Everything else goes through a bounded ring (Vyukov's, each cell carries the sequence number of the lap
+ * it's valid for), sending never allocates.
+ */
+class FEngineSimulatorCommandQueue
+{
+public:
+	FEngineSimulatorCommandQueue()
+		: EnqueuePosition(0)
+		, DequeuePosition(0)
+		, DirtyControls(0)
+	{
+		for (uint32 i = 0; i < Capacity; ++i)
+		{
+			Cells[i].Sequence.store(i, std::memory_order_relaxed);
+		}
+		for (std::atomic<float>& Control : Controls)
+		{
+			Control.store(0.f, std::memory_order_relaxed);
+		}
+	}
+
+	// Any thread. Returns false if the ring is full and the command was dropped, which only happens if nothing has
+	// drained it for a long while.
+	bool Enqueue(const FEngineSimulatorCommand& Command)
+	{
+		if (Command.IsContinuous())
+		{
+			const uint32 Index = static_cast<uint32>(Command.Type);
+			Controls[Index].store(Command.Float, std::memory_order_relaxed);
+			DirtyControls.fetch_or(1u << Index, std::memory_order_release);
+			return true;
+		}
+
+		uint32 Position = EnqueuePosition.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			FCell& Cell = Cells[Position & Mask];
+			const uint32 Sequence = Cell.Sequence.load(std::memory_order_acquire);
+			const int32 Lap = static_cast<int32>(Sequence - Position);
+			if (Lap == 0)
+			{
+				if (EnqueuePosition.compare_exchange_weak(Position, Position + 1, std::memory_order_relaxed))
+				{
+					Cell.Command = Command;
+					Cell.Sequence.store(Position + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (Lap < 0)
+			{
+				return false;
+			}
+			else
+			{
+				Position = EnqueuePosition.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Consumer only. Applies the ordered commands, then the latest value of each continuous control that changed.
+	void Apply(IEngineSimulatorInterface& Engine)
+	{
+		uint32 Position = DequeuePosition.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			FCell& Cell = Cells[Position & Mask];
+			if (Cell.Sequence.load(std::memory_order_acquire) != Position + 1)
+			{
+				break;
+			}
+
+			const FEngineSimulatorCommand Command = Cell.Command;
+			Cell.Sequence.store(Position + Capacity, std::memory_order_release);
+			++Position;
+
+			Command.Apply(Engine);
+		}
+		DequeuePosition.store(Position, std::memory_order_relaxed);
+
+		uint32 Dirty = DirtyControls.exchange(0, std::memory_order_acquire);
+		while (Dirty)
+		{
+			const uint32 Index = FMath::CountTrailingZeros(Dirty);
+			Dirty &= Dirty - 1;
+
+			FEngineSimulatorCommand Command;
+			Command.Type = static_cast<EEngineSimulatorCommand>(Index);
+			Command.Float = Controls[Index].load(std::memory_order_relaxed);
+			Command.Apply(Engine);
+		}
+	}
+
+private:
+	static constexpr uint32 Capacity = 64;
+	static constexpr uint32 Mask = Capacity - 1;
+	static constexpr uint32 NumControls = static_cast<uint32>(EEngineSimulatorCommand::NumContinuous);
+
+	struct FCell
+	{
+		std::atomic<uint32> Sequence;
+		FEngineSimulatorCommand Command;
+	};
+
+	FCell Cells[Capacity];
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint32> EnqueuePosition;
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint32> DequeuePosition;
+
+	std::atomic<float> Controls[NumControls];
+	std::atomic<uint32> DirtyControls;
+};
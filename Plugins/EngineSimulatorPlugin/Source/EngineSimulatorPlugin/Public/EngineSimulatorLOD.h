@@ -0,0 +1,17 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EngineSimulatorLOD.generated.h"
+
+// Simulation quality tiers an engine can move between at runtime without being reset, cheapest last
+UENUM(BlueprintType)
+enum class EEngineSimulatorLOD : uint8
+{
+	Full,		// Script simulation frequency, 8 fluid steps
+	Reduced,	// Half frequency, 4 fluid steps
+	Silent,		// Half frequency, 4 fluid steps, no audio synthesis
+	Minimal,	// Quarter frequency, 2 fluid steps, no audio synthesis
+	Num UMETA(Hidden)
+};
@@ -14,6 +14,9 @@ public:
 
 	static FString GetAssetDirectory();
 private:
+	FDelegateHandle PreSimulateVehiclesHandle;
+	FDelegateHandle PostSimulateVehiclesHandle;
+
 	/** Handle to the test dll we will load */
 	//void*	ExampleLibraryHandle;
 };
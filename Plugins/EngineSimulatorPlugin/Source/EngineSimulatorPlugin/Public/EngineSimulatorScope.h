@@ -0,0 +1,75 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+#include "EngineSimulatorScope.generated.h"
+
+// Signals an engine can feed to a scope
+UENUM(BlueprintType)
+enum class EEngineSimulatorSignal : uint8
+{
+	CylinderPressure,	// First cylinder's chamber pressure in Pa, against crank angle
+	IntakeFlow,			// First cylinder's intake valve flow per step, against crank angle
+	ExhaustFlow,		// First cylinder's exhaust valve flow per step, against crank angle
+	Audio,				// Final output, -1 - 1 against seconds played
+	Num UMETA(Hidden)
+};
+
+/**
+ * Waveform taps for scope widgets, one fixed size ring per signal.
+ * The simulation and audio threads write without locking and only check a bit mask while nobody listens. Readers on the
+ * game thread copy the newest points and drop any the writer lapped while they were copying. Rings are allocated on the
+ * first Listen() and kept until the scopes go away, so writers never see one disappear.
+ */
+class ENGINESIMULATORPLUGIN_API FEngineSimulatorScopes
+{
+public:
+	static constexpr uint32 Capacity = 4096;
+
+	FEngineSimulatorScopes();
+	~FEngineSimulatorScopes();
+
+	// Starts recording the signal, keeping one sample in every Decimation. Listeners are counted.
+	void Listen(EEngineSimulatorSignal Signal, int32 Decimation = 1);
+	void StopListening(EEngineSimulatorSignal Signal);
+
+	// Newest points of the signal, oldest first. X is crank angle in degrees through the cycle, or seconds for audio.
+	int32 Read(EEngineSimulatorSignal Signal, TArray<FVector2D>& OutPoints, int32 MaxPoints = Capacity) const;
+
+	// Writer side, cheap enough to call every step
+	bool IsListening(EEngineSimulatorSignal Signal) const { return (ListeningMask.load(std::memory_order_relaxed) & (1u << static_cast<uint32>(Signal))) != 0; }
+	bool IsListeningToAny() const { return ListeningMask.load(std::memory_order_relaxed) != 0; }
+
+	// Writer side, one thread per signal. X is kept as a double so audio time stays sample accurate over a long session.
+	void Push(EEngineSimulatorSignal Signal, double X, float Y)
+	{
+		FRing* Ring = Rings[static_cast<uint32>(Signal)].load(std::memory_order_acquire);
+		if (Ring == nullptr || ++Ring->DecimationCounter < Ring->Decimation.load(std::memory_order_relaxed))
+		{
+			return;
+		}
+		Ring->DecimationCounter = 0;
+
+		const uint32 Write = Ring->WriteIndex.load(std::memory_order_relaxed);
+		Ring->X[Write % Capacity] = X;
+		Ring->Y[Write % Capacity] = Y;
+		Ring->WriteIndex.store(Write + 1, std::memory_order_release);
+	}
+
+private:
+	struct FRing
+	{
+		double X[Capacity];
+		float Y[Capacity];
+		std::atomic<uint32> WriteIndex = 0;
+		std::atomic<int32> Decimation = 1;
+		int32 DecimationCounter = 0; // Writer only
+	};
+
+	std::atomic<FRing*> Rings[static_cast<uint32>(EEngineSimulatorSignal::Num)];
+	std::atomic<uint32> ListeningMask;
+	int32 Listeners[static_cast<uint32>(EEngineSimulatorSignal::Num)];
+	FCriticalSection ListenMutex;
+};
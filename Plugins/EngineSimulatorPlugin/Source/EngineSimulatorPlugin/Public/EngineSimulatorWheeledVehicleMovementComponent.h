@@ -6,6 +6,8 @@
 #include "UObject/NoExportTypes.h"
 #include "ChaosWheeledVehicleMovementComponent.h"
 #include "EngineSimulatorWheeledVehicleSimulation.h"
+#include "EngineSimulatorLOD.h"
+#include "EngineSimulatorScope.h"
 #include "EngineSimulatorWheeledVehicleMovementComponent.generated.h"
 
 class USoundWave;
@@ -18,6 +20,9 @@ class ENGINESIMULATORPLUGIN_API UEngineSimulatorWheeledVehicleMovementComponent
 
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
+	// Starts preloading EngineScript in game, so the level or Blueprint this comes from carries the compile with its load
+	virtual void PostLoad() override;
+
 	/** Set the user input for gear up */
 	UFUNCTION(BlueprintCallable, Category = "Game|Components|EngineSimulatorVehicleMovement")
 	void SetEngineSimChangeGearUp(bool bNewGearUp);
@@ -45,8 +50,113 @@ class ENGINESIMULATORPLUGIN_API UEngineSimulatorWheeledVehicleMovementComponent
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Engine Simulator Vehicle Component")
 		bool bStarterAutomaticallyEnabled = true;
 
+	// Recreates the engine, e.g. after changing EngineScript. With bKeepRunning it picks up the running engine's state
+	// instead of starting stopped, if the script didn't change.
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|EngineSimulatorVehicleMovement")
+		void RespawnEngine(bool bKeepRunning = false);
+
+	// Snapshot of the running engine for save games and checkpoints, small enough to take every frame
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|EngineSimulatorVehicleMovement")
+		bool SaveEngineState(TArray<uint8>& OutState);
+
+	// Puts the engine back to a snapshot from SaveEngineState. Returns false if the snapshot came from a different
+	// engine, only RPM, gear and the controls are restored then.
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|EngineSimulatorVehicleMovement")
+		bool RestoreEngineState(const TArray<uint8>& State);
+
+	// Engine script to run, relative to the plugin's assets directory (e.g. engines/atg-video-2/08_ferrari_f136_v8.mr). Empty uses main.mr
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Engine Simulator Vehicle Component")
+		FString EngineScript;
+
+	// Convolve the exhaust impulse response with FFT partitions, much cheaper for long impulse responses.
+	// Only takes effect when every exhaust on the engine uses the same impulse response. It's applied after the engine
+	// sound is leveled rather than before, with the leveler compensated so the level stays within 1 dB of direct convolution.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Engine Simulator Vehicle Component")
+		bool bPartitionedConvolution = false;
+
+	// Rate the engine sound is produced at, 0 for the audio mixer's own rate so it's only resampled once, by the engine.
+	// Takes effect on respawn.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Engine Simulator Vehicle Component", meta = (ClampMin = "0", Units = "Hz"))
+		int32 AudioSampleRate = 0;
+
+	// Spawn with the engine already idling, from a snapshot simulated once per engine script and cached under Saved,
+	// rather than cranking it on the starter
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Engine Simulator Vehicle Component")
+		bool bWarmStart = false;
+
+	// Step the engine in every physics substep alongside the rest of the vehicle, so wheel torque isn't a frame behind.
+	// Costs more on the physics thread, meant for the player's vehicle rather than traffic. Takes effect on respawn.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Engine Simulator Vehicle Component")
+		bool bInlineStepping = false;
+
+	// CPU time the engine may spend simulating per frame, 0 for no limit. Over budget it drops fluid steps and then runs
+	// slow for a moment rather than falling behind after a hitch. Takes effect on respawn.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Engine Simulator Vehicle Component", meta = (ClampMin = "0", Units = "ms"))
+		float SimulationBudgetMs = 0.f;
+
+	// Drive the vehicle from a torque map baked from the engine script instead of the full simulation.
+	// Meant for AI and background traffic, the surrogate makes no sound.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Engine Simulator Vehicle Component")
+		bool bUseSurrogate = false;
+
+	// Switch between the full simulation and the surrogate at runtime, RPM and gear carry over
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|EngineSimulatorVehicleMovement")
+		void SetUseSurrogate(bool bInUseSurrogate);
+
+	// Compiles engine scripts and loads their impulse responses in the background, e.g. during a loading screen, so
+	// vehicles spawned with them later start quickly. Warm start states and torque maps are prepared too when asked for.
+	// NumVehicles is how many vehicles per script may spawn at once, each needs its own copy of the engine.
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|EngineSimulatorVehicleMovement")
+		static void PreloadEngineScripts(const TArray<FString>& EngineScripts, bool bPreloadWarmStart = true, bool bPreloadSurrogate = false, int32 NumVehicles = 1);
+
+	// Streams every engine step to Saved/EngineSimulator/Telemetry/<FileName>.estl until stopped or respawned, convert
+	// captures with -run=EngineSimulatorTelemetryToCsv. An empty name picks one. Returns the capture's path, empty on failure.
 	UFUNCTION(BlueprintCallable, Category = "Game|Components|EngineSimulatorVehicleMovement")
-		void RespawnEngine();
+		FString StartEngineTelemetry(const FString& FileName);
+
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|EngineSimulatorVehicleMovement")
+		void StopEngineTelemetry();
+
+	// Starts feeding a signal to this vehicle's scope, for UMG or Slate scope widgets. Keeps one sample in every Decimation.
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|EngineSimulatorVehicleMovement")
+		void ListenToEngineSignal(EEngineSimulatorSignal Signal, int32 Decimation = 1);
+
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|EngineSimulatorVehicleMovement")
+		void StopListeningToEngineSignal(EEngineSimulatorSignal Signal);
+
+	// Newest points of a signal being listened to, oldest first. X is crank angle in degrees, or seconds for audio.
+	UFUNCTION(BlueprintCallable, Category = "Game|Components|EngineSimulatorVehicleMovement")
+		int32 ReadEngineSignal(EEngineSimulatorSignal Signal, TArray<FVector2D>& OutPoints, int32 MaxPoints = 1024) const;
+
+	// Copies the torque curve, redline, idle and inertia baked from EngineScript into EngineSetup, baking first if needed
+	UFUNCTION(CallInEditor, BlueprintCallable, Category = "Engine Simulator Vehicle Component")
+		void ApplyBakedTorqueCurve();
+
+	// Move the engine between simulation quality tiers based on camera distance, screen size and whether it can be heard
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Engine Simulator Vehicle Component|LOD")
+		bool bEnableLOD = false;
+
+	// Distance from the closest local camera past which the engine runs at Reduced
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Engine Simulator Vehicle Component|LOD", meta = (EditCondition = "bEnableLOD", Units = "cm"))
+		float ReducedLODDistance = 2500.f;
+
+	// Distance past which the engine is no longer synthesized
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Engine Simulator Vehicle Component|LOD", meta = (EditCondition = "bEnableLOD", Units = "cm"))
+		float SilentLODDistance = 8000.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Engine Simulator Vehicle Component|LOD", meta = (EditCondition = "bEnableLOD", Units = "cm"))
+		float MinimalLODDistance = 20000.f;
+
+	// Vehicles covering at least this fraction of the view run at Full regardless of distance, as long as they can be heard
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Engine Simulator Vehicle Component|LOD", meta = (EditCondition = "bEnableLOD", ClampMin = "0", ClampMax = "1"))
+		float FullLODScreenSize = 0.3f;
+
+	// How far back over a threshold the vehicle has to come before it returns to the better tier, as a fraction of the threshold
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Engine Simulator Vehicle Component|LOD", meta = (EditCondition = "bEnableLOD", ClampMin = "0", ClampMax = "0.9"))
+		float LODHysteresis = 0.15f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Transient, Category = "Engine Simulator Vehicle Component|LOD")
+		EEngineSimulatorLOD CurrentLOD = EEngineSimulatorLOD::Full;
 
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Transient, Category = "Engine Simulator Vehicle Movement")
 		USoundWaveProcedural* OutputEngineSound;
@@ -60,4 +170,22 @@ public:
 #if WITH_GAMEPLAY_DEBUGGER
 	virtual void DescribeSelfToGameplayDebugger(class FGameplayDebuggerCategory* DebuggerCategory) const;
 #endif // WITH_GAMEPLAY_DEBUGGER
+
+protected:
+	FEngineSimulatorParameters MakeEngineSimulatorParameters() const;
+
+	// AudioSampleRate, or the audio mixer's rate, or the synthesizer's without an audio device
+	int32 GetEngineSoundSampleRate() const;
+
+	// Plays OutputEngineSound at the rate the engine produces, restarting whatever is playing it if the rate changed
+	void SetEngineSoundSampleRate(int32 SampleRate);
+
+	// Rate OutputEngineSound was last set to
+	int32 EngineSoundSampleRate = 44100;
+
+	void UpdateLOD();
+	EEngineSimulatorLOD ComputeLOD() const;
+
+	// How far away the engine sound can still be heard, 0 when it isn't playing
+	float GetAudibleDistance() const;
 };
\ No newline at end of file
@@ -5,12 +5,17 @@
 #include "CoreMinimal.h"
 #include "UObject/NoExportTypes.h"
 #include "ChaosWheeledVehicleMovementComponent.h"
-#include "HAL/Runnable.h"
+#include "Tasks/Task.h"
+#include "Containers/TripleBuffer.h"
+#include <atomic>
 #include "EngineSimulator.h"
+#include "EngineSimulatorCommands.h"
+#include "EngineSimulatorScope.h"
 #include "EngineSimulatorWheeledVehicleSimulation.generated.h"
 
 class IEngineSimulatorInterface;
 class USoundWaveProcedural;
+class FEngineTelemetryRecorder;
 
 struct FEngineSimulatorInput
 {
@@ -20,6 +25,24 @@ struct FEngineSimulatorInput
 	uint64 FrameCounter = 0;
 };
 
+// What an engine publishes every step. Plain data, so it can go through a triple buffer without locking or allocating.
+struct FEngineSimulatorOutputBlock
+{
+	float Torque = 0.f;
+	float RPM = 0.f;
+	float Redline = 0.f;
+	float Horsepower = 0.f;
+	int32 CurrentGear = -1;
+	int32 NumGears = 1;
+	uint32 NameSerial = 0; // Changes along with the engine, the name itself is only read then
+	uint64 FrameCounter = 0;
+
+	// For the gameplay debugger, formatted only when it's showing
+	float DynoRPM = 0.f;
+	bool bHasEngine = false;
+	bool bGrounded = true;
+};
+
 USTRUCT(BlueprintType)
 struct FEngineSimulatorOutput
 {
@@ -51,55 +74,125 @@ struct FEngineSimulatorOutput
 
 class FGameplayDebuggerCategory;
 
-class FEngineSimulatorThread : public FRunnable
+/**
+ * Engine simulation state of a single vehicle. Steps are run by FEngineSimulatorScheduler on the task system workers,
+ * or straight from the physics substep when stepping inline.
+ */
+class FEngineSimulatorInstance
 {
 public:
+	// Starts creating the engine in the background, no steps run until that's done.
+	// A snapshot from SaveState() picks the new engine up where that one left off.
+	FEngineSimulatorInstance(const FEngineSimulatorParameters& InParameters, TArray<uint8> InitialState = TArray<uint8>());
 
-	// Constructor, create the thread by calling this
-	FEngineSimulatorThread(const FEngineSimulatorParameters& InParameters);
+	// Waits for any creation or step still in flight
+	~FEngineSimulatorInstance();
 
-	// Destructor
-	virtual ~FEngineSimulatorThread() override;
+	// Simulates one frame with the latest input and publishes the output
+	void Step();
 
+	// Simulates one frame with the given input and publishes the output, on the calling thread
+	void Simulate(const FEngineSimulatorInput& ThisInput);
 
-	// Overriden from FRunnable
-	// Do not call these functions youself, that will happen automatically
-	bool Init() override; // Do your setup here, allocate memory, ect.
-	uint32 Run() override; // Main data processing happens here
-	void Stop() override; // Clean up any memory you allocated here
-	void Exit() override;
+	// Whether the engine has been created, nothing can be stepped before that
+	bool IsReady() const { return CreateTask.IsCompleted(); }
 
-	void Trigger();
-	void PrintGameplayDebuggerInfo(FGameplayDebuggerCategory* GameplayDebugger);
+	bool IsInline() const { return Parameters.bInlineStepping; }
+
+	const FString& GetScriptPath() const { return Parameters.ScriptPath; }
+
+	// Snapshot of the engine, see IEngineSimulatorInterface::SaveState. Landing on a running step it takes the snapshot
+	// the step published on request of the previous call, so calling every frame never waits. Game thread only.
+	bool SaveState(TArray<uint8>& OutState);
+	bool LoadState(const TArray<uint8>& State);
+
+	// Switches between the full simulation and the torque map surrogate on a later step, carrying RPM and gear over
+	void SetUseSurrogate(bool bInUseSurrogate) { bWantSurrogate = bInUseSurrogate; }
+
+	// Recreates the engine from its rebuilt definition on a later step, carrying RPM and gear over
+	void RequestReload() { bReloadRequested = true; }
+
+	// Streams every step of the running engine to the recorder, null stops. Waits for a step that's running to finish.
+	void SetTelemetryRecorder(TSharedPtr<FEngineTelemetryRecorder, ESPMode::ThreadSafe> Recorder);
+
+	// Audio render thread. Forwards the wave's underflow callback to whichever engine is running.
+	void FillAudio(USoundWaveProcedural* Wave, int32 SamplesNeeded);
 
 protected:
-	TAtomic<bool> bStopRequested;
+	// Takes the engine from the finished CreateTask on first use. StateMutex must be held.
+	void AcquireEngine();
+
+	// Points the audio callback at the running engine. Once this returns the callback no longer touches the engine
+	// that ran before, so it can be destroyed.
+	void UpdateAudioEngine();
+
+	// Swaps in the other engine implementation once it's been created
+	void UpdateEngineSwitch();
+
+	// Swaps in the engine built from the reloaded script once it's been created
+	void UpdateReload();
+
+	// Publishes the running engine's name when it changes. Only called from the stepping thread.
+	void UpdateEngineName();
+
+	// Name of the running engine, with its NameSerial
+	FString GetEngineName() const;
+
+	// Written by the physics thread, read by whichever thread steps the engine
+	TTripleBuffer<FEngineSimulatorInput> InputBuffer;
 
-	FCriticalSection InputMutex;
-	FEngineSimulatorInput Input;
+	// Written by the step, read by the physics thread
+	TTripleBuffer<FEngineSimulatorOutputBlock> OutputBuffer;
 
-	FCriticalSection OutputMutex;
-	FEngineSimulatorOutput Output;
+	// Only taken when the engine changes
+	mutable FCriticalSection NameMutex;
+	FString EngineName;
+	const IEngineSimulatorInterface* NamedEngine = nullptr;
+	uint32 NameSerial = 0;
+
+	// Held for a whole step, so the engine can be touched from other threads in between
+	FCriticalSection StateMutex;
+
+	// Snapshots taken at the end of a step, for SaveState() calls that land while one is running
+	std::atomic<bool> bSnapshotRequested = false;
+	TTripleBuffer<TArray<uint8>> Snapshots;
 
-	FEvent* Semaphore;
 	TUniquePtr<IEngineSimulatorInterface> EngineSimulator;
 	FEngineSimulatorParameters Parameters;
 
-	TQueue<TFunction<void(IEngineSimulatorInterface*)>, EQueueMode::Mpsc> UpdateQueue;
+	// Held by the audio callback while it fills the wave, so the engine it's reading from can't be swapped out or destroyed
+	FCriticalSection AudioMutex;
+	IEngineSimulatorInterface* AudioEngine = nullptr;
 
-	FRunnableThread* Thread;
+	// The implementation that isn't running, kept so switching back doesn't have to create it again
+	TUniquePtr<IEngineSimulatorInterface> InactiveSimulator;
+	FEngineSimulatorCreateTask SwitchTask;
+	std::atomic<bool> bWantSurrogate;
+	bool bSurrogateActive;
+
+	FEngineSimulatorCreateTask ReloadTask;
+	std::atomic<bool> bReloadRequested = false;
+
+	// Seconds left in which a warm started engine that's stopped gets the starter, see bStarterIfStalled
+	float WarmStartWatchTime = 0.f;
+
+	TSharedPtr<FEngineTelemetryRecorder, ESPMode::ThreadSafe> TelemetryRecorder;
+
+	FEngineSimulatorCommandQueue Commands;
+
+	FEngineSimulatorCreateTask CreateTask;
+	UE::Tasks::FTask StepTask;
 
-#if WITH_GAMEPLAY_DEBUGGER
-	TFunction<void(FGameplayDebuggerCategory*)> GameplayDebuggerPrint;
-#endif
 	friend class UEngineSimulatorWheeledVehicleSimulation;
+	friend class FEngineSimulatorScheduler;
+	friend class UEngineSimulatorBenchmarkCommandlet;
 };
 
 class UEngineSimulatorWheeledVehicleSimulation : public UChaosWheeledVehicleSimulation
 {
 public:
 	UEngineSimulatorWheeledVehicleSimulation(TArray<class UChaosVehicleWheel*>& WheelsIn, const FEngineSimulatorParameters& InParameters);
-	virtual ~UEngineSimulatorWheeledVehicleSimulation() = default;
+	virtual ~UEngineSimulatorWheeledVehicleSimulation();
 
 	/** Update the engine/transmission simulation */
 	virtual void ProcessMechanicalSimulation(float DeltaTime) override;
@@ -107,24 +200,54 @@ public:
 	/** Pass control Input to the vehicle systems */
 	virtual void ApplyInput(const FControlInputs& ControlInputs, float DeltaTime) override;
 
-	void AsyncUpdateSimulation(TFunction<void(IEngineSimulatorInterface*)> InCallable);
+	// Sends a control change to the engine, applied before its next step. Never blocks or allocates.
+	void AsyncUpdateSimulation(const FEngineSimulatorCommand& Command);
 
-	FEngineSimulatorOutput GetLastOutput();
+	void SetUseSurrogate(bool bUseSurrogate);
 
-	// Destroys the engine and the engine thread and remakes them
-	void Reset(const FEngineSimulatorParameters& InParameters);
+	void SetTelemetryRecorder(TSharedPtr<FEngineTelemetryRecorder, ESPMode::ThreadSafe> Recorder);
+
+	// Game thread. Updates OutOutput with the latest published step, the name is only copied when the engine changed.
+	void GetLastOutput(FEngineSimulatorOutput& OutOutput);
+
+	// Destroys the engine and remakes it. With bKeepState the new engine carries on from the old one's state instead of
+	// starting stopped, as long as it runs the same script.
+	void Reset(const FEngineSimulatorParameters& InParameters, bool bKeepState = false);
+
+	// See IEngineSimulatorInterface::SaveState. False while the engine is still being created.
+	bool SaveEngineState(TArray<uint8>& OutState);
+
+	// OutGear is the gear the engine ends up in, set whenever the engine exists even if the snapshot didn't match
+	bool LoadEngineState(const TArray<uint8>& State, int32& OutGear);
 
 #if WITH_GAMEPLAY_DEBUGGER
 	void PrintGameplayDebuggerInfo(FGameplayDebuggerCategory* GameplayDebugger);
 #endif
 
+	// Waveform taps of whichever engine the vehicle is running
+	FEngineSimulatorScopes& GetScopes() { return Scopes; }
+
 protected:
-	TUniquePtr<FEngineSimulatorThread> EngineSimulatorThread;
+	// Declared ahead of the instance so engines never outlive the scopes they write to
+	FEngineSimulatorScopes Scopes;
+
+	TUniquePtr<FEngineSimulatorInstance> EngineSimulatorInstance;
+
+	// Audio render thread, the wave stays bound to the vehicle while its instances are replaced
+	void FillAudio(USoundWaveProcedural* Wave, int32 SamplesNeeded);
+
+	// Held while the audio callback uses EngineSimulatorInstance and while Reset() replaces it
+	FCriticalSection AudioMutex;
 
 	FEngineSimulatorParameters Parameters;
 
-	FEngineSimulatorOutput LastOutput;
-	mutable FCriticalSection LastOutputMutex;
+	// Written by the physics thread, read by the game thread
+	TTripleBuffer<FEngineSimulatorOutputBlock> LastOutputBuffer;
+
+	// Game thread copies of the last read block and the engine's name
+	FEngineSimulatorOutputBlock LastOutput;
+	FString LastName;
+	uint32 LastNameSerial = 0;
 
 	bool bStarterEnabled;
 	bool bDynoEnabled;